@@ -0,0 +1,74 @@
+#!/bin/sh
+# Benchmark riproducibile (make bench): avvia il server in ogni modalità, lo
+# misura con loadgen in più scenari e scrive una riga CSV per misura in
+# $RESULTS. Se esiste $BASELINE (creato con make bench-baseline) confronta
+# il throughput e fallisce se una misura perde più di BENCH_TOLERANCE%.
+#
+# Variabili: BENCH_PORT (8099), BENCH_DURATION (secondi per scenario, 5),
+#            BENCH_TOLERANCE (10), BENCH_MODES (sottoinsieme di modalità).
+
+cd "$(dirname "$0")/.." || exit 1
+
+RESULTS=${1:-bench/results.csv}
+BASELINE=${2:-bench/baseline.csv}
+PORT=${BENCH_PORT:-8099}
+DURATION=${BENCH_DURATION:-5}
+TOLERANCE=${BENCH_TOLERANCE:-10}
+MODES=${BENCH_MODES:-"default zerocopy reuseport io_uring"}
+MIX="1k.html:4,2k.html:2,5k.html:2,10k.html:2,100k.html:1,200k.html:1,500k.html:1,1M.html:1"
+
+mode_flags() {
+    case "$1" in
+        default) echo "" ;;
+        zerocopy) echo "--zerocopy" ;;
+        reuseport) echo "--reuseport" ;;
+        io_uring) echo "--io-uring" ;;
+        *) echo "Modalità sconosciuta: $1" >&2; exit 1 ;;
+    esac
+}
+
+# scenario: etichetta e opzioni di loadgen
+run_scenarios() {
+    mode=$1
+    ./loadgen -p "$PORT" -d 1 -c 8 -m "$MIX" >/dev/null   # riscaldamento (cache, connessioni)
+    ./loadgen -p "$PORT" -d "$DURATION" -c 32 -m "$MIX" -l "$mode/keepalive" -o "$RESULTS"
+    ./loadgen -p "$PORT" -d "$DURATION" -c 8 -P 8 -m "1k.html:1,10k.html:1" -l "$mode/pipeline" -o "$RESULTS"
+    ./loadgen -p "$PORT" -d "$DURATION" -c 16 -K -m "$MIX" -l "$mode/close" -o "$RESULTS"
+    ./loadgen -p "$PORT" -d "$DURATION" -c 32 -r 5000 -m "$MIX" -l "$mode/open5k" -o "$RESULTS"
+}
+
+mkdir -p "$(dirname "$RESULTS")"
+rm -f "$RESULTS"
+
+for mode in $MODES; do
+    flags=$(mode_flags "$mode")
+    echo "== $mode $flags"
+    # shellcheck disable=SC2086
+    ./server "$PORT" $flags >/dev/null 2>&1 &
+    server_pid=$!
+    sleep 1
+    run_scenarios "$mode"
+    pkill -P "$server_pid" 2>/dev/null
+    kill "$server_pid" 2>/dev/null
+    wait "$server_pid" 2>/dev/null
+    sleep 1
+done
+
+echo "Risultati in $RESULTS"
+if [ ! -f "$BASELINE" ]; then
+    echo "Nessun baseline ($BASELINE): make bench-baseline per salvarne uno."
+    exit 0
+fi
+
+# Confronto per etichetta: colonna 10 = req/s, colonna 14 = p99 (us)
+awk -F, -v tol="$TOLERANCE" '
+    FNR == 1 { next }
+    NR == FNR { rps[$1] = $10; p99[$1] = $14; next }
+    ($1 in rps) && rps[$1] > 0 {
+        delta = ($10 - rps[$1]) * 100 / rps[$1]
+        status = delta < -tol ? "REGRESSIONE" : "ok"
+        if (status != "ok") failed = 1
+        printf "%-22s %10.0f req/s (%+6.1f%%)  p99 %9.1f us (baseline %9.1f)  %s\n", $1, $10, delta, $14, p99[$1], status
+    }
+    END { exit failed }
+' "$BASELINE" "$RESULTS"
@@ -0,0 +1,404 @@
+#include "bundle.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define BUNDLE_MAX_SEED 65536   // tentativi per bucket prima di allargare la tabella
+#define BUNDLE_BUILD_ATTEMPTS 4
+
+struct bundle_writer {
+    char *out_path;
+    char *tmp_path;
+    FILE *f;
+    uint64_t pos;               // byte scritti nel file
+    bundle_entry_t *entries;    // path e header con offset relativi a strings fino a finish
+    uint32_t count;
+    uint32_t cap;
+    char *strings;              // path e blocchi header, scritti in coda al file
+    size_t strings_len;
+    size_t strings_cap;
+};
+
+static const char zeros[BUNDLE_ALIGN];
+
+/**
+ * @brief true se [offset, offset + len) sta nel file di size byte.
+ */
+static bool in_bounds(uint64_t offset, uint64_t len, uint64_t size) {
+    return offset <= size && len <= size - offset;
+}
+
+int bundle_open(bundle_t *bundle, const char *path) {
+    memset(bundle, 0, sizeof(*bundle));
+    open_file_t *file = open_file_map(path);
+    if (!file) {
+        fprintf(stderr, "[bundle] Impossibile mappare %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    const bundle_header_t *h = (const bundle_header_t *)file->map;
+    uint64_t size = file->size;
+    bool ok = size >= sizeof(*h) && memcmp(h->magic, BUNDLE_MAGIC, sizeof(h->magic)) == 0 &&
+              h->version == BUNDLE_VERSION && h->size == size && h->table_size >= h->count &&
+              h->seed_count > 0 && h->seeds % sizeof(uint32_t) == 0 && h->table % sizeof(uint32_t) == 0 &&
+              h->entries % sizeof(uint64_t) == 0 &&
+              in_bounds(h->seeds, (uint64_t)h->seed_count * sizeof(uint32_t), size) &&
+              in_bounds(h->table, (uint64_t)h->table_size * sizeof(uint32_t), size) &&
+              in_bounds(h->entries, (uint64_t)h->count * sizeof(bundle_entry_t), size);
+
+    // Ogni riferimento dell'indice deve restare dentro il file: dopo questo
+    // controllo i lookup non verificano più nulla
+    const bundle_entry_t *entries = ok ? (const bundle_entry_t *)(file->map + h->entries) : NULL;
+    for (uint32_t i = 0; ok && i < h->count; i++) {
+        const bundle_entry_t *e = &entries[i];
+        ok = in_bounds(e->path, (uint64_t)e->path_len + 1, size) && file->map[e->path + e->path_len] == '\0' &&
+             e->data[FILE_CACHE_IDENTITY].offset != 0;
+        for (int enc = 0; ok && enc < FILE_CACHE_ENCODINGS; enc++) {
+            const bundle_variant_t *v = &e->data[enc];
+            bool listed = enc == FILE_CACHE_IDENTITY || (e->variants & (1u << enc));
+            ok = v->offset == 0 ? !listed
+                                : in_bounds(v->offset, v->len, size) && in_bounds(v->header, v->header_len, size) &&
+                                  memchr(v->etag, '\0', sizeof(v->etag)) != NULL;
+        }
+    }
+    const uint32_t *table = ok ? (const uint32_t *)(file->map + h->table) : NULL;
+    for (uint32_t i = 0; ok && i < h->table_size; i++) {
+        ok = table[i] <= h->count;
+    }
+    if (!ok) {
+        fprintf(stderr, "[bundle] %s non è un bundle valido (versione %d)\n", path, BUNDLE_VERSION);
+        open_file_release(file);
+        return -1;
+    }
+
+    bundle->file = file;
+    bundle->header = h;
+    bundle->seeds = (const uint32_t *)(file->map + h->seeds);
+    bundle->table = table;
+    bundle->entries = entries;
+    return 0;
+}
+
+const bundle_entry_t *bundle_find(const bundle_t *bundle, const char *path, size_t len) {
+    const bundle_header_t *h = bundle->header;
+    if (h->count == 0) {
+        return NULL;
+    }
+    uint32_t seed = bundle->seeds[bundle_hash(path, len, 0) % h->seed_count];
+    uint32_t index = bundle->table[bundle_hash(path, len, seed) % h->table_size];
+    if (index == 0) {
+        return NULL;
+    }
+    // La hash perfetta non conosce i path assenti: confronto obbligatorio
+    const bundle_entry_t *e = &bundle->entries[index - 1];
+    if (e->path_len != len || memcmp(bundle_data(bundle, e->path), path, len) != 0) {
+        return NULL;
+    }
+    return e;
+}
+
+void bundle_close(bundle_t *bundle) {
+    open_file_release(bundle->file);
+    memset(bundle, 0, sizeof(*bundle));
+}
+
+/**
+ * @brief Scrive len byte nel file temporaneo.
+ */
+static int write_bytes(bundle_writer_t *w, const void *data, size_t len) {
+    if (len > 0 && fwrite(data, 1, len, w->f) != len) {
+        return -1;
+    }
+    w->pos += len;
+    return 0;
+}
+
+/**
+ * @brief Completa con zeri fino a un multiplo di align.
+ */
+static int pad_to(bundle_writer_t *w, uint64_t align) {
+    size_t pad = (size_t)((align - w->pos % align) % align);
+    return write_bytes(w, zeros, pad);
+}
+
+/**
+ * @brief Copia len byte nell'area delle stringhe.
+ * @return offset relativo all'area, oppure UINT64_MAX se manca la memoria.
+ */
+static uint64_t add_string(bundle_writer_t *w, const char *data, size_t len) {
+    if (w->strings_cap - w->strings_len < len + 1) {
+        size_t cap = w->strings_cap ? w->strings_cap : 4096;
+        while (cap - w->strings_len < len + 1) {
+            cap *= 2;
+        }
+        char *tmp = (char *)realloc(w->strings, cap);
+        if (!tmp) {
+            return UINT64_MAX;
+        }
+        w->strings = tmp;
+        w->strings_cap = cap;
+    }
+    uint64_t offset = w->strings_len;
+    memcpy(w->strings + offset, data, len);
+    w->strings[offset + len] = '\0';
+    w->strings_len += len + 1;
+    return offset;
+}
+
+static void free_writer(bundle_writer_t *w) {
+    if (w->f) {
+        fclose(w->f);
+    }
+    free(w->out_path);
+    free(w->tmp_path);
+    free(w->entries);
+    free(w->strings);
+    free(w);
+}
+
+bundle_writer_t *bundle_writer_create(const char *out_path) {
+    bundle_writer_t *w = (bundle_writer_t *)calloc(1, sizeof(*w));
+    if (!w) {
+        return NULL;
+    }
+    size_t len = strlen(out_path) + 8;
+    w->out_path = strdup(out_path);
+    w->tmp_path = (char *)malloc(len);
+    if (!w->out_path || !w->tmp_path) {
+        free_writer(w);
+        return NULL;
+    }
+    snprintf(w->tmp_path, len, "%s.tmp", out_path);
+    w->f = fopen(w->tmp_path, "wb");
+    if (!w->f) {
+        fprintf(stderr, "[bundle] Impossibile creare %s: %s\n", w->tmp_path, strerror(errno));
+        free_writer(w);
+        return NULL;
+    }
+
+    // La prima pagina è dell'intestazione, scritta alla fine
+    if (write_bytes(w, zeros, BUNDLE_ALIGN) < 0) {
+        bundle_writer_abort(w);
+        return NULL;
+    }
+    return w;
+}
+
+int bundle_writer_add(bundle_writer_t *w, const char *path, time_t mtime,
+                      const bundle_source_t variants[FILE_CACHE_ENCODINGS]) {
+    if (!variants[FILE_CACHE_IDENTITY].data || w->count == UINT32_MAX - 1) {
+        return -1;
+    }
+    if (w->count == w->cap) {
+        uint32_t cap = w->cap ? w->cap * 2 : 64;
+        bundle_entry_t *tmp = (bundle_entry_t *)realloc(w->entries, (size_t)cap * sizeof(*tmp));
+        if (!tmp) {
+            return -1;
+        }
+        w->entries = tmp;
+        w->cap = cap;
+    }
+
+    bundle_entry_t *e = &w->entries[w->count];
+    memset(e, 0, sizeof(*e));
+    e->path = add_string(w, path, strlen(path));
+    e->path_len = (uint32_t)strlen(path);
+    e->mtime = (int64_t)mtime;
+    if (e->path == UINT64_MAX) {
+        return -1;
+    }
+
+    for (int enc = 0; enc < FILE_CACHE_ENCODINGS; enc++) {
+        const bundle_source_t *src = &variants[enc];
+        if (!src->data) {
+            continue;
+        }
+        bundle_variant_t *v = &e->data[enc];
+        if (pad_to(w, BUNDLE_ALIGN) < 0) {
+            return -1;
+        }
+        v->offset = w->pos;
+        v->len = src->len;
+        if (write_bytes(w, src->data, src->len) < 0) {
+            return -1;
+        }
+        v->header = add_string(w, src->header, src->header_len);
+        v->header_len = (uint32_t)src->header_len;
+        snprintf(v->etag, sizeof(v->etag), "%s", src->etag);
+        if (v->header == UINT64_MAX) {
+            return -1;
+        }
+        if (enc != FILE_CACHE_IDENTITY) {
+            e->variants |= 1u << enc;
+        }
+    }
+    w->count++;
+    return 0;
+}
+
+/**
+ * @brief Costruisce la hash perfetta (hash and displace): i bucket, dal più
+ *        affollato, cercano un seed che porti tutte le loro chiavi in posizioni
+ *        libere della tabella.
+ * @return 0 se ok, -1 se nessun seed funziona per qualche bucket.
+ */
+static int build_index(const bundle_writer_t *w, uint32_t *seeds, uint32_t seed_count,
+                       uint32_t *table, uint32_t table_size) {
+    uint32_t n = w->count;
+    uint32_t *bucket_of = (uint32_t *)malloc((size_t)n * sizeof(uint32_t) + 1);
+    uint32_t *start = (uint32_t *)calloc((size_t)seed_count + 1, sizeof(uint32_t));
+    uint32_t *members = (uint32_t *)malloc((size_t)n * sizeof(uint32_t) + 1);
+    uint32_t *slots = (uint32_t *)malloc((size_t)n * sizeof(uint32_t) + 1);
+    int rc = -1;
+    if (!bucket_of || !start || !members || !slots) {
+        goto out;
+    }
+
+    // Chiavi raggruppate per bucket (counting sort): bucket b = members[start[b] .. start[b + 1])
+    for (uint32_t i = 0; i < n; i++) {
+        const bundle_entry_t *e = &w->entries[i];
+        bucket_of[i] = (uint32_t)(bundle_hash(w->strings + e->path, e->path_len, 0) % seed_count);
+        start[bucket_of[i] + 1]++;
+    }
+    uint32_t max_size = 0;
+    for (uint32_t b = 0; b < seed_count; b++) {
+        if (start[b + 1] > max_size) {
+            max_size = start[b + 1];
+        }
+        start[b + 1] += start[b];
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        members[start[bucket_of[i]]++] = i;
+    }
+    for (uint32_t b = seed_count; b > 0; b--) {
+        start[b] = start[b - 1];
+    }
+    start[0] = 0;
+
+    // Prima i bucket più grandi, quando la tabella è ancora vuota
+    memset(table, 0, (size_t)table_size * sizeof(uint32_t));
+    memset(seeds, 0, (size_t)seed_count * sizeof(uint32_t));
+    for (uint32_t size = max_size; size > 0; size--) {
+        for (uint32_t b = 0; b < seed_count; b++) {
+            uint32_t first = start[b];
+            if (start[b + 1] - first != size) {
+                continue;
+            }
+            uint32_t seed;
+            for (seed = 1; seed < BUNDLE_MAX_SEED; seed++) {
+                bool fits = true;
+                for (uint32_t k = 0; k < size && fits; k++) {
+                    const bundle_entry_t *e = &w->entries[members[first + k]];
+                    slots[k] = (uint32_t)(bundle_hash(w->strings + e->path, e->path_len, seed) % table_size);
+                    fits = table[slots[k]] == 0;
+                    for (uint32_t m = 0; m < k && fits; m++) {
+                        fits = slots[m] != slots[k];
+                    }
+                }
+                if (fits) {
+                    break;
+                }
+            }
+            if (seed == BUNDLE_MAX_SEED) {
+                goto out;
+            }
+            seeds[b] = seed;
+            for (uint32_t k = 0; k < size; k++) {
+                table[slots[k]] = members[first + k] + 1;
+            }
+        }
+    }
+    rc = 0;
+
+out:
+    free(bucket_of);
+    free(start);
+    free(members);
+    free(slots);
+    return rc;
+}
+
+long bundle_writer_finish(bundle_writer_t *w) {
+    uint32_t seed_count = w->count / 4 + 1;
+    uint32_t table_size = w->count + w->count / 4 + 1;
+    uint32_t *seeds = NULL;
+    uint32_t *table = NULL;
+    int attempt;
+    for (attempt = 0; attempt < BUNDLE_BUILD_ATTEMPTS; attempt++, table_size *= 2) {
+        free(seeds);
+        free(table);
+        seeds = (uint32_t *)malloc((size_t)seed_count * sizeof(uint32_t));
+        table = (uint32_t *)malloc((size_t)table_size * sizeof(uint32_t));
+        if (!seeds || !table || build_index(w, seeds, seed_count, table, table_size) == 0) {
+            break;
+        }
+    }
+    if (!seeds || !table || attempt == BUNDLE_BUILD_ATTEMPTS) {
+        fprintf(stderr, "[bundle] Indice non costruito (path duplicati?)\n");
+        free(seeds);
+        free(table);
+        bundle_writer_abort(w);
+        return -1;
+    }
+
+    bundle_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BUNDLE_MAGIC, sizeof(h.magic));
+    h.version = BUNDLE_VERSION;
+    h.count = w->count;
+    h.seed_count = seed_count;
+    h.table_size = table_size;
+
+    // Indice in coda ai contenuti, poi le stringhe: gli offset relativi diventano assoluti
+    int rc = pad_to(w, sizeof(uint64_t));
+    h.seeds = w->pos;
+    rc |= write_bytes(w, seeds, (size_t)seed_count * sizeof(uint32_t));
+    h.table = w->pos;
+    rc |= write_bytes(w, table, (size_t)table_size * sizeof(uint32_t));
+    rc |= pad_to(w, sizeof(uint64_t));
+    h.entries = w->pos;
+    uint64_t strings = h.entries + (uint64_t)w->count * sizeof(bundle_entry_t);
+    for (uint32_t i = 0; i < w->count; i++) {
+        bundle_entry_t *e = &w->entries[i];
+        e->path += strings;
+        for (int enc = 0; enc < FILE_CACHE_ENCODINGS; enc++) {
+            if (e->data[enc].offset != 0) {
+                e->data[enc].header += strings;
+            }
+        }
+    }
+    rc |= write_bytes(w, w->entries, (size_t)w->count * sizeof(bundle_entry_t));
+    rc |= write_bytes(w, w->strings, w->strings_len);
+    h.size = w->pos;
+    free(seeds);
+    free(table);
+
+    if (rc < 0 || fseeko(w->f, 0, SEEK_SET) < 0 || fwrite(&h, sizeof(h), 1, w->f) != 1 ||
+        fflush(w->f) != 0 || fsync(fileno(w->f)) < 0) {
+        fprintf(stderr, "[bundle] Scrittura di %s fallita: %s\n", w->tmp_path, strerror(errno));
+        bundle_writer_abort(w);
+        return -1;
+    }
+    fclose(w->f);
+    w->f = NULL;
+    if (rename(w->tmp_path, w->out_path) < 0) {
+        fprintf(stderr, "[bundle] Impossibile pubblicare %s: %s\n", w->out_path, strerror(errno));
+        unlink(w->tmp_path);
+        free_writer(w);
+        return -1;
+    }
+    long count = (long)w->count;
+    free_writer(w);
+    return count;
+}
+
+void bundle_writer_abort(bundle_writer_t *w) {
+    if (w->f) {
+        fclose(w->f);
+        w->f = NULL;
+    }
+    unlink(w->tmp_path);
+    free_writer(w);
+}
@@ -0,0 +1,153 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "file_cache.h"
+#include "open_file_cache.h"
+
+#define BUNDLE_MAGIC "CWSBNDL1"   // primi 8 byte del file
+#define BUNDLE_VERSION 1
+#define BUNDLE_ALIGN 4096          // contenuti allineati alla pagina (sendfile e mmap)
+
+/**
+ * @brief Una variante (identità, gzip, brotli) di un file nel bundle.
+ */
+typedef struct {
+    uint64_t offset;            // contenuto, allineato a BUNDLE_ALIGN (0 = variante assente)
+    uint64_t len;
+    uint64_t header;            // blocco header HTTP precalcolato del 200 (senza Date)
+    uint32_t header_len;
+    uint32_t reserved;
+    char etag[FILE_CACHE_ETAG_MAX];
+} bundle_variant_t;
+
+/**
+ * @brief Voce dell'indice: un path servibile.
+ */
+typedef struct {
+    uint64_t path;              // offset del path URL ("/a/b.html", terminato da '\0')
+    uint32_t path_len;
+    uint32_t variants;          // bit (1 << file_cache_encoding_t) delle varianti compresse
+    int64_t mtime;
+    bundle_variant_t data[FILE_CACHE_ENCODINGS];
+} bundle_entry_t;
+
+/**
+ * @brief Intestazione all'offset 0. Gli offset sono dall'inizio del file.
+ *
+ *        L'indice è una hash perfetta (hash and displace): il path sceglie un
+ *        seed in seeds[], il seed la posizione in table[], che contiene
+ *        l'indice della voce + 1. Un lookup è quindi sempre due accessi e un
+ *        confronto del path, senza collisioni da scorrere.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;             // voci
+    uint32_t seed_count;
+    uint32_t table_size;        // >= count
+    uint64_t seeds;             // uint32_t[seed_count]
+    uint64_t table;             // uint32_t[table_size]
+    uint64_t entries;           // bundle_entry_t[count]
+    uint64_t size;              // dimensione del file, per riconoscerne uno troncato
+} bundle_header_t;
+
+/**
+ * @brief Bundle aperto: il file mappato in sola lettura e i puntatori alle sue tabelle.
+ */
+typedef struct {
+    open_file_t *file;          // riferimento condiviso con i segmenti in uscita
+    const bundle_header_t *header;
+    const uint32_t *seeds;
+    const uint32_t *table;
+    const bundle_entry_t *entries;
+} bundle_t;
+
+/**
+ * @brief Hash del path con un seed (FNV-1a seguito dal finalizer di MurmurHash3).
+ *        Uguale per chi scrive e chi legge il bundle.
+ */
+static inline uint64_t bundle_hash(const char *path, size_t len, uint32_t seed) {
+    uint64_t h = 14695981039346656037ULL ^ ((uint64_t)seed * 0x9e3779b97f4a7c15ULL);
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)path[i];
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * @brief Mappa il bundle path e ne verifica intestazione e tabelle.
+ * @return 0 se ok, -1 in caso di errore (con messaggio su stderr).
+ */
+int bundle_open(bundle_t *bundle, const char *path);
+
+/**
+ * @brief Cerca il path URL (len byte) nel bundle: nessuna syscall.
+ * @return la voce, oppure NULL se non c'è.
+ */
+const bundle_entry_t *bundle_find(const bundle_t *bundle, const char *path, size_t len);
+
+/**
+ * @brief Puntatore ai byte del bundle all'offset indicato.
+ */
+static inline const char *bundle_data(const bundle_t *bundle, uint64_t offset) {
+    return bundle->file->map + offset;
+}
+
+/**
+ * @brief Rilascia il bundle (la mappa resta finché i segmenti in uscita la usano).
+ */
+void bundle_close(bundle_t *bundle);
+
+/**
+ * @brief Scrittura di un bundle: i contenuti vengono accodati man mano in un
+ *        file temporaneo, l'indice alla fine; bundle_writer_finish() lo rinomina
+ *        al posto di quello finale, così un server che usa il vecchio non lo vede a metà.
+ */
+typedef struct bundle_writer bundle_writer_t;
+
+/**
+ * @brief Crea il file temporaneo per out_path.
+ * @return lo scrittore, oppure NULL in caso di errore.
+ */
+bundle_writer_t *bundle_writer_create(const char *out_path);
+
+/**
+ * @brief Una variante da scrivere nel bundle (data == NULL se assente).
+ */
+typedef struct {
+    const char *data;
+    size_t len;
+    const char *header;         // blocco header del 200, senza Date
+    size_t header_len;
+    const char *etag;
+} bundle_source_t;
+
+/**
+ * @brief Aggiunge il path URL con le sue varianti (indicizzate per file_cache_encoding_t).
+ * @return 0 se ok, -1 in caso di errore.
+ */
+int bundle_writer_add(bundle_writer_t *w, const char *path, time_t mtime,
+                      const bundle_source_t variants[FILE_CACHE_ENCODINGS]);
+
+/**
+ * @brief Calcola la hash perfetta, scrive indice e intestazione e pubblica il
+ *        bundle; in ogni caso libera lo scrittore.
+ * @return numero di voci scritte, -1 in caso di errore.
+ */
+long bundle_writer_finish(bundle_writer_t *w);
+
+/**
+ * @brief Abbandona la scrittura: cancella il file temporaneo e libera lo scrittore.
+ */
+void bundle_writer_abort(bundle_writer_t *w);
+
+#endif // BUNDLE_H
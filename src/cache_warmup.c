@@ -0,0 +1,186 @@
+#include "cache_warmup.h"
+#include "http_response.h"
+#include "shm_arena.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define WARMUP_PATH_LEN 4096
+
+/**
+ * @brief Avanzamento del pre-riscaldamento, riportato alla fine.
+ */
+typedef struct {
+    file_cache_t *cache;
+    const cache_warmup_options_t *opts;
+    unsigned long files;        // file caricati
+    unsigned long pinned;       // ... di cui bloccati dal manifest
+    unsigned long too_large;    // saltati dalla scansione per dimensione
+    unsigned long no_room;      // saltati perché il budget era esaurito
+    unsigned long missing;      // path del manifest non trovati
+    size_t bytes;               // byte caricati (varianti comprese)
+    size_t pinned_bytes;
+} warmup_t;
+
+/**
+ * @brief true se size byte entrano nel budget senza eliminare voci già caricate.
+ */
+static bool has_room(file_cache_t *cache, size_t size) {
+    file_cache_stats_t cs;
+    file_cache_get_stats(cache, &cs);
+    return cs.bytes + size <= cs.budget;
+}
+
+/**
+ * @brief Carica i path elencati nel manifest e li blocca contro l'evizione.
+ */
+static void load_manifest(warmup_t *w, const char *docroot) {
+    FILE *f = fopen(w->opts->manifest, "r");
+    if (!f) {
+        fprintf(stderr, "[warmup] Manifest %s non leggibile: %s\n", w->opts->manifest, strerror(errno));
+        return;
+    }
+    file_cache_stats_t cs;
+    file_cache_get_stats(w->cache, &cs);
+    size_t pin_budget = cs.budget / 100 * CACHE_WARMUP_PIN_PERCENT;
+
+    char line[WARMUP_PATH_LEN];
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *p = line;
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+        if (*p != '/' || strstr(p, "..")) {
+            fprintf(stderr, "[warmup] Path non valido nel manifest: %s\n", p);
+            continue;
+        }
+
+        // Stessa traduzione URL -> file di serve_file()
+        char local_path[WARMUP_PATH_LEN];
+        snprintf(local_path, sizeof(local_path), "%s%s", docroot, strcmp(p, "/") == 0 ? "/index.html" : p);
+
+        struct stat st;
+        if (stat(local_path, &st) < 0 || !S_ISREG(st.st_mode)) {
+            w->missing++;
+            continue;
+        }
+        if (w->pinned_bytes + (size_t)st.st_size > pin_budget) {
+            w->no_room++;
+            continue;
+        }
+        size_t bytes = http_preload_file(local_path, true);
+        if (bytes == 0) {
+            w->no_room++;
+            continue;
+        }
+        w->files++;
+        w->pinned++;
+        w->bytes += bytes;
+        w->pinned_bytes += bytes;
+    }
+    fclose(f);
+}
+
+/**
+ * @brief true se name è un fratello precompresso (.gz, .br): viene caricato
+ *        come variante del file originale, non come file a sé.
+ */
+static bool is_precompressed(const char *name) {
+    size_t len = strlen(name);
+    return len > 3 && (strcmp(name + len - 3, ".gz") == 0 || strcmp(name + len - 3, ".br") == 0);
+}
+
+/**
+ * @brief Carica i file di dir (ricorsivamente) fino a max_file_size.
+ */
+static void scan_tree(warmup_t *w, const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.') {
+            continue; // ".", ".." e file nascosti
+        }
+        char path[WARMUP_PATH_LEN];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        if (stat(path, &st) < 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            scan_tree(w, path);
+            continue;
+        }
+        // Niente file speciali né file già caricati dal manifest
+        if (!S_ISREG(st.st_mode) || is_precompressed(de->d_name) ||
+            file_cache_contains(w->cache, path, FILE_CACHE_IDENTITY)) {
+            continue;
+        }
+        if ((size_t)st.st_size > w->opts->max_file_size) {
+            w->too_large++;
+            continue;
+        }
+        if (!has_room(w->cache, (size_t)st.st_size)) {
+            w->no_room++;
+            continue;
+        }
+        size_t bytes = http_preload_file(path, false);
+        if (bytes > 0) {
+            w->files++;
+            w->bytes += bytes;
+        }
+    }
+    closedir(d);
+}
+
+unsigned long cache_warmup(file_cache_t *cache, const char *docroot, const cache_warmup_options_t *opts) {
+    warmup_t w;
+    memset(&w, 0, sizeof(w));
+    w.cache = cache;
+    w.opts = opts;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (opts->manifest) {
+        load_manifest(&w, docroot);
+    }
+    if (opts->scan) {
+        scan_tree(&w, docroot);
+    }
+
+    size_t locked = 0;
+    int lock_error = 0;
+    if (opts->lock_memory) {
+        locked = shm_arena_lock(cache->arena);
+        lock_error = locked == 0 ? errno : 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed_ms = (double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) / 1e6;
+
+    printf("[warmup] %lu file in cache (%zu KB, %lu bloccati per %zu KB) in %.1f ms\n",
+           w.files, w.bytes / 1024, w.pinned, w.pinned_bytes / 1024, elapsed_ms);
+    if (w.too_large || w.no_room || w.missing) {
+        printf("[warmup] Saltati: %lu oltre %zu KB, %lu per budget esaurito, %lu non trovati dal manifest\n",
+               w.too_large, opts->max_file_size / 1024, w.no_room, w.missing);
+    }
+    if (opts->lock_memory) {
+        if (locked > 0) {
+            printf("[warmup] %zu KB bloccati in RAM (mlock)\n", locked / 1024);
+        } else {
+            printf("[warmup] mlock non riuscito: %s\n", strerror(lock_error));
+        }
+    }
+    fflush(stdout);
+    return w.files;
+}
@@ -0,0 +1,37 @@
+#ifndef CACHE_WARMUP_H
+#define CACHE_WARMUP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "file_cache.h"
+
+#define CACHE_WARMUP_DEFAULT_MAX_FILE (256 * 1024) // file caricati dalla scansione fino a questa dimensione
+#define CACHE_WARMUP_PIN_PERCENT 50                // quota massima del budget bloccata dal manifest
+
+/**
+ * @brief Opzioni del pre-riscaldamento della cache.
+ */
+typedef struct {
+    bool scan;                  // carica i file della document root fino a max_file_size
+    size_t max_file_size;
+    const char *manifest;       // file con i path caldi da caricare e bloccare (o NULL)
+    bool lock_memory;           // mlock delle pagine caricate
+} cache_warmup_options_t;
+
+/**
+ * @brief Carica la cache condivisa prima del fork, così i worker partono con
+ *        i file già in memoria invece di andare tutti su disco alla prima ondata
+ *        di richieste:
+ *        - prima i path del manifest (uno per riga, come nell'URL, '#' per i
+ *          commenti), bloccati contro l'evizione fino a CACHE_WARMUP_PIN_PERCENT
+ *          del budget;
+ *        - poi, se richiesto, i file della document root fino a max_file_size,
+ *          finché c'è spazio nel budget (senza eliminare quelli già caricati);
+ *        - infine, se richiesto, blocca in RAM con mlock la memoria usata.
+ *        Stampa un riepilogo (file, byte, tempo impiegato).
+ *
+ * @return numero di file caricati.
+ */
+unsigned long cache_warmup(file_cache_t *cache, const char *docroot, const cache_warmup_options_t *opts);
+
+#endif // CACHE_WARMUP_H
@@ -0,0 +1,291 @@
+#include "connection.h"
+#include "request_parser.h"
+#include "http_response.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <stdatomic.h>
+
+#define CONN_INITIAL_BUFFER 4096
+
+extern bool g_verbose;
+extern unsigned g_max_requests; // 0 = nessun limite
+extern atomic_bool g_draining;   // il worker sta uscendo: definito in main.c
+
+connection_t *connection_create(int fd) {
+    connection_t *conn = (connection_t *)calloc(1, sizeof(connection_t));
+    if (!conn) {
+        return NULL;
+    }
+    conn->in_buf = (char *)malloc(CONN_INITIAL_BUFFER);
+    if (!conn->in_buf) {
+        free(conn);
+        return NULL;
+    }
+    conn->in_buf[0] = '\0';
+    conn->in_cap = CONN_INITIAL_BUFFER;
+    conn->fd = fd;
+    conn->state = CONN_STATE_IDLE;
+    conn->deadline_ms = timer_now_ms() + CONN_IDLE_TIMEOUT_SEC * 1000;
+    timer_init(&conn->timer);
+    init_http_request_parser(&conn->parser);
+    output_queue_init(&conn->out);
+    return conn;
+}
+
+void connection_destroy(connection_t *conn) {
+    close(conn->fd);
+    output_queue_free(&conn->out);
+    free(conn->in_buf);
+    free(conn);
+}
+
+/**
+ * @brief Controlla se la connessione deve restare aperta (keep-alive) o no
+ *
+ * Politica semplificata: 
+ * - se "Connection: close" => chiude
+ * - se "HTTP/1.0" senza header => chiude
+ * - altrimenti (HTTP/1.1 default o "Connection: keep-alive") => keep-alive
+ */
+static bool should_keep_alive(const http_request_parser_t *parser) {
+    // Se c'è "Connection: close" => no keep-alive
+    if (parser->connection_close) {
+        return false;
+    }
+
+    // HTTP/1.0 di default non fa keep-alive se non lo dichiari esplicitamente
+    if (http_span_equals(parser, parser->version, "HTTP/1.0")) {
+        return parser->connection_keep_alive;
+    }
+
+    // HTTP/1.1 di default ha keep-alive, salvo "Connection: close"
+    return true;
+}
+
+/**
+ * @brief Legge dal socket (non bloccante) finché ci sono dati, accodandoli al buffer.
+ * @return 1 se la lettura è terminata con EAGAIN, 0 se il peer ha chiuso, -1 se errore.
+ */
+static int fill_input_buffer(connection_t *conn) {
+    while (1) {
+        // Lasciamo sempre un byte per il terminatore
+        if (conn->in_cap - conn->in_len < 2) {
+            size_t limit = REQUEST_BUFFER_SIZE + MAX_REQUEST_BODY_LEN;
+            if (conn->in_cap >= limit) {
+                return 1; // buffer pieno: ci penserà il parser a rifiutare
+            }
+            size_t new_cap = conn->in_cap * 2;
+            if (new_cap > limit) {
+                new_cap = limit;
+            }
+            char *tmp = (char *)realloc(conn->in_buf, new_cap);
+            if (!tmp) {
+                return -1;
+            }
+            conn->in_buf = tmp;
+            conn->in_cap = new_cap;
+        }
+
+        ssize_t n = read(conn->fd, conn->in_buf + conn->in_len,
+                         conn->in_cap - 1 - conn->in_len);
+        if (n > 0) {
+            conn->in_len += (size_t)n;
+            conn->in_buf[conn->in_len] = '\0';
+            continue;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 1;
+        }
+        return -1;
+    }
+}
+
+/**
+ * @brief Dopo l'ultima risposta chiudiamo solo la scrittura e scartiamo quello
+ *        che il client manda ancora (es. richieste in pipeline oltre il limite):
+ *        chiudere con dati non letti farebbe inviare un RST dal kernel, che può
+ *        far perdere al client le risposte non ancora lette.
+ * @return true se il client ha chiuso (o errore) e la connessione va chiusa.
+ */
+static bool discard_input(connection_t *conn) {
+    int rc;
+    do {
+        conn->in_len = 0;
+        rc = fill_input_buffer(conn);
+    } while (rc > 0 && conn->in_len > 0);
+    conn->in_len = 0;
+    return rc <= 0;
+}
+
+/**
+ * @brief Chiusura dopo l'ultima risposta, già inviata del tutto: con linger
+ *        chiudiamo prima solo la scrittura (vedi discard_input()).
+ */
+static void finish_close(connection_t *conn, bool linger) {
+    if (linger && shutdown(conn->fd, SHUT_WR) == 0 && !discard_input(conn)) {
+        conn->state = CONN_STATE_LINGERING;
+        conn->deadline_ms = timer_now_ms() + CONN_LINGER_TIMEOUT_SEC * 1000;
+        return;
+    }
+    conn->state = CONN_STATE_CLOSING;
+}
+
+void connection_handle(connection_t *conn) {
+    if (conn->state == CONN_STATE_LINGERING) {
+        if (discard_input(conn)) {
+            conn->state = CONN_STATE_CLOSING;
+        }
+        return; // la scadenza resta quella fissata all'inizio dell'attesa
+    }
+
+    // Socket di nuovo scrivibile: l'invio riprende da dove si era fermato
+    if (conn->state == CONN_STATE_WRITING) {
+        int sent = output_queue_flush(&conn->out, conn->fd);
+        if (sent < 0) {
+            conn->state = CONN_STATE_CLOSING;
+            return;
+        }
+        if (sent == 0) {
+            conn->deadline_ms = timer_now_ms() + CONN_WRITE_TIMEOUT_MS;
+            return;
+        }
+        if (conn->close_after_write) {
+            finish_close(conn, conn->linger_after_write);
+            return;
+        }
+        // Coda vuota: serviamo le richieste rimaste nel buffer e ne leggiamo altre
+    }
+
+    int rc = fill_input_buffer(conn);
+    bool linger = false;
+    bool close_after = false;
+    bool stalled = false; // coda piena e socket pieno: le richieste restanti aspettano
+    size_t start = 0; // inizio della prossima richiesta nel buffer
+
+    // Serviamo una dopo l'altra tutte le richieste complete presenti nel buffer
+    // (pipelining), accodando le risposte. Il parser riprende da dove si era
+    // fermato all'evento precedente.
+    while (start < conn->in_len) {
+        http_request_parser_t *parser = &conn->parser;
+
+        // Backpressure: con troppe risposte in coda non ne generiamo altre
+        // finché il client non le ha lette
+        if (output_queue_full(&conn->out)) {
+            int sent = output_queue_flush(&conn->out, conn->fd);
+            if (sent < 0) {
+                close_after = true;
+                break;
+            }
+            if (sent == 0) {
+                stalled = true;
+                break;
+            }
+        }
+
+        int consumed = parse_http_request(parser, conn->in_buf + start, conn->in_len - start);
+        if (consumed == 0) {
+            break; // richiesta incompleta: aspettiamo altri dati
+        }
+        if (consumed < 0) {
+            if (g_verbose) {
+                printf("[connection] Richiesta malformata o troppo grande (fd=%d). Chiudo.\n", conn->fd);
+            }
+            close_after = true;
+            break;
+        }
+
+        // Decide se rimanere aperti: oltre g_max_requests, o se il worker sta
+        // uscendo, la risposta annuncia la chiusura
+        conn->requests++;
+        bool keep_alive = should_keep_alive(parser) &&
+                          (g_max_requests == 0 || conn->requests < g_max_requests) &&
+                          !atomic_load_explicit(&g_draining, memory_order_relaxed);
+
+        // Genera risposta
+        handle_http_request(&conn->out, parser, !keep_alive);
+
+        start += (size_t)consumed;
+        init_http_request_parser(parser);
+        conn->request_start_ms = 0;
+        conn->body_start_ms = 0;
+
+        if (!keep_alive) {
+            if (g_verbose) {
+                printf("[connection] Chiusura post-richiesta su fd=%d (no keep-alive)\n", conn->fd);
+            }
+            close_after = true;
+            linger = rc > 0;
+            break;
+        }
+    }
+
+    // Le risposte accodate partono insieme, con il minimo numero di syscall
+    int sent = output_queue_flush(&conn->out, conn->fd);
+
+    // Compattiamo il buffer una sola volta per tutte le richieste servite
+    if (start > 0) {
+        conn->in_len -= start;
+        memmove(conn->in_buf, conn->in_buf + start, conn->in_len + 1);
+    }
+
+    if (sent < 0) {
+        conn->state = CONN_STATE_CLOSING;
+        return;
+    }
+    if (rc <= 0 && !close_after && !stalled) {
+        // Peer chiuso o errore: se c'era ancora qualcosa di incompleto lo scartiamo
+        if (g_verbose) {
+            printf("[connection] Connessione chiusa dal client (fd=%d)\n", conn->fd);
+        }
+        close_after = true;
+    }
+
+    // Socket pieno: la connessione aspetta di essere scrivibile, con una
+    // scadenza che si rinnova a ogni progresso dell'invio
+    if (sent == 0) {
+        conn->state = CONN_STATE_WRITING;
+        conn->close_after_write = close_after;
+        conn->linger_after_write = linger;
+        conn->deadline_ms = timer_now_ms() + CONN_WRITE_TIMEOUT_MS;
+        return;
+    }
+    if (close_after) {
+        finish_close(conn, linger);
+        return;
+    }
+
+    // Scadenza dello stato in cui la connessione torna all'event loop
+    uint64_t now = timer_now_ms();
+    if (conn->in_len == 0) {
+        conn->state = CONN_STATE_IDLE;
+        conn->deadline_ms = now + CONN_IDLE_TIMEOUT_SEC * 1000;
+        if (g_verbose) {
+            printf("[connection] Resto in keep-alive su fd=%d\n", conn->fd);
+        }
+        return;
+    }
+
+    conn->state = CONN_STATE_READING;
+    if (conn->request_start_ms == 0) {
+        conn->request_start_ms = now;
+    }
+    if (!http_request_headers_done(&conn->parser)) {
+        conn->deadline_ms = conn->request_start_ms + CONN_HEADER_TIMEOUT_SEC * 1000;
+    } else {
+        if (conn->body_start_ms == 0) {
+            conn->body_start_ms = now;
+        }
+        conn->deadline_ms = conn->body_start_ms + CONN_BODY_TIMEOUT_SEC * 1000;
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "request_parser.h"
+#include "output_queue.h"
+#include "timer_wheel.h"
+
+#define CONN_IDLE_TIMEOUT_SEC 5    // keep-alive senza nessun byte della richiesta successiva
+#define CONN_HEADER_TIMEOUT_SEC 10 // tempo totale per ricevere gli header di una richiesta
+#define CONN_BODY_TIMEOUT_SEC 30   // tempo totale per ricevere il body
+#define CONN_LINGER_TIMEOUT_SEC 2  // attesa della chiusura del client dopo l'ultima risposta
+#define CONN_WRITE_TIMEOUT_MS 5000 // invio fermo (socket pieno) oltre il quale si chiude
+#define CONN_MAX_REQUESTS 1000     // richieste per connessione (default di --max-requests)
+#define CONN_FD_RESERVE 64         // fd lasciati liberi chiudendo le connessioni inattive più vecchie
+
+/**
+ * @brief Stati della macchina a stati di una connessione.
+ */
+typedef enum {
+    CONN_STATE_IDLE,     // keep-alive, nessun byte della prossima richiesta
+    CONN_STATE_READING,  // header della richiesta arrivati solo in parte
+    CONN_STATE_WRITING,  // socket pieno, risposte in coda: si aspetta che torni scrivibile
+    CONN_STATE_LINGERING, // ultima risposta inviata, si scarta l'input fino alla chiusura del client
+    CONN_STATE_CLOSING   // la connessione va chiusa
+} connection_state_t;
+
+/**
+ * @brief Stato per-connessione. Il buffer di lettura sopravvive tra un evento e
+ *        l'altro, così una richiesta può arrivare in più pezzi senza bloccare
+ *        un thread del pool.
+ *
+ *        Il ciclo di vita è gestito dall'event loop del worker: la connessione
+ *        viene passata al thread pool solo quando il socket è pronto e torna
+ *        all'event loop (per essere riarmata o chiusa) a lavoro finito.
+ */
+typedef struct connection_t {
+    int fd;
+    connection_state_t state;
+
+    char *in_buf;       // dati letti e non ancora consumati (terminati da '\0')
+    size_t in_len;
+    size_t in_cap;
+    http_request_parser_t parser; // stato del parsing della richiesta in arrivo
+    output_queue_t out;           // risposte accodate e non ancora inviate
+    bool close_after_write;       // WRITING: chiudere appena la coda è vuota
+    bool linger_after_write;      // ... chiudendo prima solo la scrittura
+
+    unsigned requests;          // richieste servite su questa connessione
+    uint64_t request_start_ms;  // arrivo del primo byte della richiesta in corso (0 = nessuna)
+    uint64_t body_start_ms;     // fine degli header della richiesta in corso (0 = non ancora)
+    uint64_t deadline_ms;       // scadenza da armare al ritorno nell'event loop
+
+    // Stato posseduto dal solo thread dell'event loop
+    bool in_pool;               // true mentre è in mano al thread pool
+    timer_node_t timer;         // scadenza nella timer wheel del worker
+    struct connection_t *lru_prev; // connessioni in attesa, dalla meno recente
+    struct connection_t *lru_next;
+
+    struct connection_t *next; // per la coda delle connessioni completate
+} connection_t;
+
+/**
+ * @brief Alloca lo stato per un socket client appena accettato (già non bloccante).
+ * @return la connessione, oppure NULL in caso di errore.
+ */
+connection_t *connection_create(int fd);
+
+/**
+ * @brief Chiude il socket e libera la connessione.
+ */
+void connection_destroy(connection_t *conn);
+
+/**
+ * @brief Gestisce una connessione pronta in lettura (eseguita dai thread del pool):
+ *        legge tutto quello che c'è sul socket senza bloccare, serve le richieste
+ *        complete (anche in pipeline, con un unico invio delle risposte) e
+ *        aggiorna conn->state. Al ritorno la connessione è IDLE/READING/LINGERING
+ *        (da riarmare in lettura), WRITING (da riarmare in scrittura: la coda
+ *        riprende l'invio al prossimo evento), oppure CLOSING (da chiudere);
+ *        tranne che per CLOSING la scadenza da armare è in conn->deadline_ms.
+ *
+ *        Le scadenze non si spostano con i byte che arrivano: header e body
+ *        hanno un tempo totale dall'inizio della richiesta, così un client che
+ *        manda un byte alla volta non tiene aperta la connessione all'infinito.
+ */
+void connection_handle(connection_t *conn);
+
+#endif // CONNECTION_H
@@ -4,6 +4,13 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+
+static event_backend_t g_backend = EVENT_BACKEND_DEFAULT;
+
+void set_event_loop_backend(event_backend_t backend) {
+    g_backend = backend;
+}
 
 #ifdef USE_KQUEUE
 
@@ -29,6 +36,101 @@ int add_event(int loop_fd, int fd) {
     return 0;
 }
 
+int add_exclusive_event(int loop_fd, int fd) {
+    // kqueue non ha un equivalente di EPOLLEXCLUSIVE
+    return add_event(loop_fd, fd);  // 0 oppure -1
+}
+
+int add_oneshot_event(int loop_fd, int fd) {
+    struct kevent evSet;
+    EV_SET(&evSet, fd, EVFILT_READ, EV_ADD | EV_ENABLE | EV_DISPATCH, 0, 0, NULL);
+    if (kevent(loop_fd, &evSet, 1, NULL, 0, NULL) == -1) {
+        perror("kevent ADD oneshot");
+        return -1;
+    }
+    return 0;
+}
+
+int rearm_event(int loop_fd, int fd) {
+    struct kevent evSet;
+    EV_SET(&evSet, fd, EVFILT_READ, EV_ENABLE | EV_DISPATCH, 0, 0, NULL);
+    if (kevent(loop_fd, &evSet, 1, NULL, 0, NULL) == -1) {
+        perror("kevent ENABLE");
+        return -1;
+    }
+    return 0;
+}
+
+int rearm_write_event(int loop_fd, int fd) {
+    // Filtro separato da quello in lettura, che resta disabilitato dall'ultimo evento
+    struct kevent evSet;
+    EV_SET(&evSet, fd, EVFILT_WRITE, EV_ADD | EV_ENABLE | EV_DISPATCH, 0, 0, NULL);
+    if (kevent(loop_fd, &evSet, 1, NULL, 0, NULL) == -1) {
+        perror("kevent ADD write");
+        return -1;
+    }
+    return 0;
+}
+
+int remove_event(int loop_fd, int fd) {
+    (void)loop_fd;
+    (void)fd;
+    return 0; // close() rimuove il fd dalla kqueue
+}
+
+int add_accept_event(int loop_fd, int listen_fd) {
+    (void)loop_fd;
+    (void)listen_fd;
+    return 0;
+}
+
+bool accept_event_pending(int loop_fd) {
+    (void)loop_fd;
+    return false;
+}
+
+int remove_accept_event(int loop_fd, int listen_fd) {
+    struct kevent evSet;
+    EV_SET(&evSet, listen_fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    if (kevent(loop_fd, &evSet, 1, NULL, 0, NULL) == -1) {
+        perror("kevent DELETE");
+        return -1;
+    }
+    return 0;
+}
+
+int take_accepted_fds(int loop_fd, int *fds, int max) {
+    (void)loop_fd;
+    (void)fds;
+    (void)max;
+    return 0;
+}
+
+int create_notify_fd(int *read_fd, int *write_fd) {
+    int fds[2];
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        return -1;
+    }
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+    *read_fd = fds[0];
+    *write_fd = fds[1];
+    return 0;
+}
+
+void notify_event_loop(int write_fd) {
+    char c = 1;
+    // Se la pipe è piena c'è già una notifica pendente: va bene così
+    (void)write(write_fd, &c, 1);
+}
+
+void drain_notify_fd(int read_fd) {
+    char buf[256];
+    while (read(read_fd, buf, sizeof(buf)) > 0) {
+    }
+}
+
 int wait_for_events(int loop_fd, int max_events, int timeout, int *fds_out) {
     struct kevent *evList = (struct kevent *)calloc(max_events, sizeof(struct kevent));
     if (!evList) {
@@ -45,8 +147,11 @@ int wait_for_events(int loop_fd, int max_events, int timeout, int *fds_out) {
 
     int nevents = kevent(loop_fd, NULL, 0, evList, max_events, pts);
     if (nevents < 0) {
-        perror("kevent wait");
         free(evList);
+        if (errno == EINTR) {
+            return 0; // interrotta da un segnale (ad es. l'uscita graduale del worker)
+        }
+        perror("kevent wait");
         return -1;
     }
 
@@ -60,9 +165,23 @@ int wait_for_events(int loop_fd, int max_events, int timeout, int *fds_out) {
 
 #elif defined(USE_EPOLL)
 
+#include "event_loop_uring.h"
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <stdint.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1u << 28)
+#endif
 
 int create_event_loop() {
+    if (g_backend == EVENT_BACKEND_IO_URING) {
+        int ring_fd = uring_create_loop();
+        if (ring_fd >= 0) {
+            return ring_fd;
+        }
+        perror("io_uring non disponibile, uso epoll");
+    }
     int epfd = epoll_create1(0);
     if (epfd == -1) {
         perror("epoll_create1");
@@ -71,6 +190,9 @@ int create_event_loop() {
 }
 
 int add_event(int loop_fd, int fd) {
+    if (uring_is_loop(loop_fd)) {
+        return uring_add_poll(loop_fd, fd, true); // multishot: come edge-triggered
+    }
     struct epoll_event event;
     memset(&event, 0, sizeof(event));
     event.events = EPOLLIN | EPOLLET; // edge-triggered
@@ -82,7 +204,129 @@ int add_event(int loop_fd, int fd) {
     return 0;
 }
 
+int add_exclusive_event(int loop_fd, int fd) {
+    if (uring_is_loop(loop_fd)) {
+        return uring_add_poll(loop_fd, fd, true) < 0 ? -1 : 0; // nessun equivalente esclusivo
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLEXCLUSIVE; // level-triggered: chi non accetta sveglia un altro
+    event.data.fd = fd;
+    if (epoll_ctl(loop_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        if (errno == EINVAL) {
+            // Kernel < 4.5: niente EPOLLEXCLUSIVE
+            return add_event(loop_fd, fd);
+        }
+        perror("epoll_ctl ADD exclusive");
+        return -1;
+    }
+    return 1;
+}
+
+int add_oneshot_event(int loop_fd, int fd) {
+    if (uring_is_loop(loop_fd)) {
+        return uring_add_poll(loop_fd, fd, false);
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.fd = fd;
+    if (epoll_ctl(loop_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        perror("epoll_ctl ADD oneshot");
+        return -1;
+    }
+    return 0;
+}
+
+int rearm_event(int loop_fd, int fd) {
+    if (uring_is_loop(loop_fd)) {
+        return uring_add_poll(loop_fd, fd, false); // il poll one-shot si è consumato
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.fd = fd;
+    if (epoll_ctl(loop_fd, EPOLL_CTL_MOD, fd, &event) < 0) {
+        perror("epoll_ctl MOD");
+        return -1;
+    }
+    return 0;
+}
+
+int rearm_write_event(int loop_fd, int fd) {
+    if (uring_is_loop(loop_fd)) {
+        return uring_add_write_poll(loop_fd, fd);
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLOUT | EPOLLONESHOT;
+    event.data.fd = fd;
+    if (epoll_ctl(loop_fd, EPOLL_CTL_MOD, fd, &event) < 0) {
+        perror("epoll_ctl MOD write");
+        return -1;
+    }
+    return 0;
+}
+
+int remove_event(int loop_fd, int fd) {
+    if (uring_is_loop(loop_fd)) {
+        return uring_remove_poll(loop_fd, fd);
+    }
+    return 0; // close() rimuove il fd dall'epoll
+}
+
+int add_accept_event(int loop_fd, int listen_fd) {
+    if (!uring_is_loop(loop_fd)) {
+        return 0;
+    }
+    return uring_add_accept(loop_fd, listen_fd) < 0 ? -1 : 1;
+}
+
+int remove_accept_event(int loop_fd, int listen_fd) {
+    if (uring_is_loop(loop_fd)) {
+        return uring_remove_accept(loop_fd, listen_fd);
+    }
+    if (epoll_ctl(loop_fd, EPOLL_CTL_DEL, listen_fd, NULL) < 0) {
+        perror("epoll_ctl DEL");
+        return -1;
+    }
+    return 0;
+}
+
+bool accept_event_pending(int loop_fd) {
+    return uring_is_loop(loop_fd) && uring_accept_pending(loop_fd);
+}
+
+int take_accepted_fds(int loop_fd, int *fds, int max) {
+    return uring_take_accepted(loop_fd, fds, max);
+}
+
+int create_notify_fd(int *read_fd, int *write_fd) {
+    int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd < 0) {
+        perror("eventfd");
+        return -1;
+    }
+    *read_fd = efd;
+    *write_fd = efd;
+    return 0;
+}
+
+void notify_event_loop(int write_fd) {
+    uint64_t one = 1;
+    // Un errore (EAGAIN) significa contatore saturo: c'è già una notifica pendente
+    (void)write(write_fd, &one, sizeof(one));
+}
+
+void drain_notify_fd(int read_fd) {
+    uint64_t value;
+    (void)read(read_fd, &value, sizeof(value));
+}
+
 int wait_for_events(int loop_fd, int max_events, int timeout, int *fds_out) {
+    if (uring_is_loop(loop_fd)) {
+        return uring_wait(loop_fd, max_events, timeout, fds_out);
+    }
     struct epoll_event *events = (struct epoll_event *)calloc(max_events, sizeof(struct epoll_event));
     if (!events) {
         return -1;
@@ -90,8 +334,11 @@ int wait_for_events(int loop_fd, int max_events, int timeout, int *fds_out) {
 
     int nevents = epoll_wait(loop_fd, events, max_events, timeout);
     if (nevents < 0) {
-        perror("epoll_wait");
         free(events);
+        if (errno == EINTR) {
+            return 0; // interrotta da un segnale (ad es. l'uscita graduale del worker)
+        }
+        perror("epoll_wait");
         return -1;
     }
 
@@ -1,6 +1,8 @@
 #ifndef EVENT_LOOP_H
 #define EVENT_LOOP_H
 
+#include <stdbool.h>
+
 #ifdef __APPLE__
     #define USE_KQUEUE
 #else
@@ -8,7 +10,22 @@
 #endif
 
 /**
- * @brief Crea e restituisce un "event loop" (kqueue o epoll).
+ * @brief Backend dell'event loop su Linux. Con EVENT_BACKEND_IO_URING
+ *        create_event_loop() usa io_uring e ricade su epoll se il kernel non lo
+ *        supporta; altrove il valore viene ignorato.
+ */
+typedef enum {
+    EVENT_BACKEND_DEFAULT,
+    EVENT_BACKEND_IO_URING
+} event_backend_t;
+
+/**
+ * @brief Sceglie il backend per i loop creati successivamente (va chiamata prima del fork).
+ */
+void set_event_loop_backend(event_backend_t backend);
+
+/**
+ * @brief Crea e restituisce un "event loop" (kqueue, epoll o io_uring).
  * @return file descriptor dell'evento, o -1 in caso di errore.
  */
 int create_event_loop();
@@ -21,6 +38,105 @@ int create_event_loop();
  */
 int add_event(int loop_fd, int fd);
 
+/**
+ * @brief Registra un socket in ascolto condiviso tra più processi in modalità
+ *        esclusiva (EPOLLEXCLUSIVE, level-triggered): a ogni nuova connessione
+ *        viene svegliato un solo worker invece di tutti. Se il kernel non lo
+ *        supporta (o con kqueue) ricade su add_event().
+ * @param loop_fd file descriptor dell'event loop.
+ * @param fd file descriptor del socket in ascolto.
+ * @return 1 se registrato in modalità esclusiva (level-triggered), 0 se si è
+ *         ricaduti su add_event() (edge-triggered), -1 in caso di errore.
+ */
+int add_exclusive_event(int loop_fd, int fd);
+
+/**
+ * @brief Registra un socket client in modalità "one-shot": dopo il primo evento
+ *        il fd viene disabilitato finché non viene riarmato con rearm_event().
+ *        Così un solo thread alla volta gestisce la stessa connessione.
+ * @param loop_fd file descriptor dell'event loop.
+ * @param fd file descriptor del client.
+ * @return 0 se ok, -1 in caso di errore.
+ */
+int add_oneshot_event(int loop_fd, int fd);
+
+/**
+ * @brief Riarma un fd registrato con add_oneshot_event() per il prossimo evento in lettura.
+ * @param loop_fd file descriptor dell'event loop.
+ * @param fd file descriptor del client.
+ * @return 0 se ok, -1 in caso di errore.
+ */
+int rearm_event(int loop_fd, int fd);
+
+/**
+ * @brief Come rearm_event(), ma per il prossimo evento in scrittura: la
+ *        connessione ha risposte in coda e aspetta che il socket si liberi.
+ * @param loop_fd file descriptor dell'event loop.
+ * @param fd file descriptor del client.
+ * @return 0 se ok, -1 in caso di errore.
+ */
+int rearm_write_event(int loop_fd, int fd);
+
+/**
+ * @brief Rimuove la registrazione one-shot di un fd prima di chiuderlo. Serve
+ *        solo con io_uring (il poll pendente non sparisce con close()); con
+ *        epoll e kqueue la chiusura basta e la funzione non fa nulla.
+ * @return 0 se ok, -1 in caso di errore.
+ */
+int remove_event(int loop_fd, int fd);
+
+/**
+ * @brief Affida le accept sul socket in ascolto all'event loop (accept multishot
+ *        di io_uring): i nuovi client, già non bloccanti, si prelevano con
+ *        take_accepted_fds() dopo ogni wait_for_events().
+ * @return 1 se l'event loop accetta da sé, 0 se non supportato (il chiamante
+ *         registra il socket con add_event()/add_exclusive_event()), -1 in caso di errore.
+ */
+int add_accept_event(int loop_fd, int listen_fd);
+
+/**
+ * @brief Smette di accettare da listen_fd (uscita graduale del worker): il
+ *        socket resta aperto negli altri processi, che ricevono da qui in poi
+ *        tutte le nuove connessioni. Va chiamata esplicitamente: il socket è
+ *        condiviso con il master, quindi chiuderlo qui non lo toglie dall'epoll.
+ *        Con io_uring i client già accettati arrivano ancora da take_accepted_fds().
+ * @return 0 se ok, -1 in caso di errore.
+ */
+int remove_accept_event(int loop_fd, int listen_fd);
+
+/**
+ * @brief true finché l'event loop può ancora consegnare client accettati
+ *        dopo remove_accept_event(): con io_uring la cancellazione dell'accept
+ *        è asincrona, e un worker che uscisse prima chiuderebbe con un reset i
+ *        client accettati all'ultimo momento. Con epoll e kqueue sempre false.
+ */
+bool accept_event_pending(int loop_fd);
+
+/**
+ * @brief Preleva i client accettati dall'event loop (vedi add_accept_event()).
+ * @return numero di fd scritti in fds (0 se non ce ne sono).
+ */
+int take_accepted_fds(int loop_fd, int *fds, int max);
+
+/**
+ * @brief Crea un canale di notifica (eventfd su Linux, pipe altrove) con cui i thread
+ *        possono svegliare l'event loop.
+ * @param read_fd fd da registrare nell'event loop.
+ * @param write_fd fd su cui scrivere con notify_event_loop() (può coincidere con read_fd).
+ * @return 0 se ok, -1 in caso di errore.
+ */
+int create_notify_fd(int *read_fd, int *write_fd);
+
+/**
+ * @brief Sveglia l'event loop scrivendo sul canale di notifica.
+ */
+void notify_event_loop(int write_fd);
+
+/**
+ * @brief Svuota il canale di notifica (da chiamare quando read_fd risulta pronto).
+ */
+void drain_notify_fd(int read_fd);
+
 /**
  * @brief Attende eventi su loop_fd. Restituisce il numero di eventi pronti.
  * @param loop_fd file descriptor dell'event loop.
@@ -0,0 +1,443 @@
+#ifdef __linux__
+
+#define _GNU_SOURCE // POLLRDHUP
+#include "event_loop_uring.h"
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define URING_ENTRIES 256        // SQE per ring (il CQ è il doppio)
+#define URING_MAX_LOOPS 4        // ring per processo (ne serve uno per worker)
+#define URING_ACCEPT_QUEUE 256   // fd accettati in attesa di uring_take_accepted()
+
+// Tipo di richiesta nei 32 bit alti di user_data, fd in quelli bassi
+enum {
+    URING_OP_POLL = 1,   // poll one-shot di un client
+    URING_OP_POLL_MULTI, // poll multishot (socket in ascolto, notifiche del pool)
+    URING_OP_ACCEPT,     // accept multishot
+    URING_OP_CANCEL      // rimozione di un poll
+};
+#define URING_DATA(op, fd) (((uint64_t)(op) << 32) | (uint32_t)(fd))
+
+/**
+ * @brief Stato di un ring: puntatori alle code condivise con il kernel (mmap),
+ *        SQE non ancora inviate e fd accettati dall'accept multishot.
+ */
+typedef struct {
+    int ring_fd;
+    int enter_fd;          // indice del ring registrato, oppure ring_fd
+    unsigned enter_flags;  // IORING_ENTER_REGISTERED_RING se registrato
+
+    _Atomic unsigned *sq_head;
+    _Atomic unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sq_local_tail; // tail comprensiva delle SQE non ancora pubblicate
+    unsigned pending;       // SQE pubblicate ma non ancora inviate al kernel
+
+    _Atomic unsigned *cq_head;
+    _Atomic unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    int listen_fd;
+    bool accept_works;     // almeno un accept multishot è riuscito
+    bool accept_fallback;  // kernel senza accept multishot: poll sul socket in ascolto
+    bool accept_stopped;   // uring_remove_accept(): l'accept non va più riarmato
+    bool accept_armed;     // accept (o poll di ripiego) ancora attivo nel kernel
+    int accepted[URING_ACCEPT_QUEUE];
+    int accepted_count;
+} uring_loop_t;
+
+static uring_loop_t *g_loops[URING_MAX_LOOPS];
+
+static uring_loop_t *lookup(int loop_fd) {
+    for (int i = 0; i < URING_MAX_LOOPS; i++) {
+        if (g_loops[i] && g_loops[i]->ring_fd == loop_fd) {
+            return g_loops[i];
+        }
+    }
+    return NULL;
+}
+
+bool uring_is_loop(int loop_fd) {
+    return lookup(loop_fd) != NULL;
+}
+
+static int sys_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_uring_enter(uring_loop_t *r, unsigned to_submit, unsigned min_complete,
+                           unsigned flags, void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, r->enter_fd, to_submit, min_complete,
+                        flags | r->enter_flags, arg, argsz);
+}
+
+static int sys_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * @brief Pubblica le SQE preparate e le invia al kernel senza attendere.
+ */
+static int submit(uring_loop_t *r) {
+    atomic_store_explicit(r->sq_tail, r->sq_local_tail, memory_order_release);
+    while (r->pending > 0) {
+        int n = sys_uring_enter(r, r->pending, 0, 0, NULL, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        r->pending -= (unsigned)n;
+        if (n == 0) {
+            break;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Prende la prossima SQE libera (azzerata). Se la coda è piena invia
+ *        prima quelle accumulate.
+ * @return la SQE, oppure NULL se la coda resta piena.
+ */
+static struct io_uring_sqe *get_sqe(uring_loop_t *r) {
+    unsigned head = atomic_load_explicit(r->sq_head, memory_order_acquire);
+    if (r->sq_local_tail - head >= r->sq_entries) {
+        if (submit(r) < 0) {
+            return NULL;
+        }
+        head = atomic_load_explicit(r->sq_head, memory_order_acquire);
+        if (r->sq_local_tail - head >= r->sq_entries) {
+            return NULL;
+        }
+    }
+    unsigned idx = r->sq_local_tail & r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[idx] = idx;
+    r->sq_local_tail++;
+    r->pending++;
+    return sqe;
+}
+
+/**
+ * @brief Verifica con IORING_REGISTER_PROBE che il kernel supporti le operazioni usate.
+ */
+static bool probe_ops(int ring_fd) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = (struct io_uring_probe *)calloc(1, size);
+    if (!probe) {
+        return false;
+    }
+    bool ok = false;
+    if (sys_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+        static const int needed[] = { IORING_OP_POLL_ADD, IORING_OP_POLL_REMOVE, IORING_OP_ACCEPT,
+                                      IORING_OP_ASYNC_CANCEL };
+        ok = true;
+        for (size_t i = 0; i < sizeof(needed) / sizeof(needed[0]); i++) {
+            if (needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED)) {
+                ok = false;
+            }
+        }
+    }
+    free(probe);
+    return ok;
+}
+
+int uring_create_loop(void) {
+    int slot = -1;
+    for (int i = 0; i < URING_MAX_LOOPS && slot < 0; i++) {
+        if (!g_loops[i]) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        return -1;
+    }
+
+    // Un solo thread (l'event loop) invia le richieste: lo diciamo al kernel, che
+    // evita così interruzioni per il task work. Kernel più vecchi: flag base.
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CLAMP | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+              IORING_SETUP_SINGLE_ISSUER;
+    int fd = sys_uring_setup(URING_ENTRIES, &p);
+    if (fd < 0 && errno == EINVAL) {
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CLAMP;
+        fd = sys_uring_setup(URING_ENTRIES, &p);
+    }
+    if (fd < 0) {
+        return -1;
+    }
+
+    // Servono un'unica mmap per SQ e CQ e il timeout nell'attesa (kernel >= 5.11)
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG) ||
+        !probe_ops(fd)) {
+        close(fd);
+        errno = ENOSYS;
+        return -1;
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    size_t ring_size = sq_size > cq_size ? sq_size : cq_size;
+    char *ring = (char *)mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              fd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    struct io_uring_sqe *sqes = (struct io_uring_sqe *)mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                                                            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                                            fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        munmap(ring, ring_size);
+        close(fd);
+        return -1;
+    }
+
+    uring_loop_t *r = (uring_loop_t *)calloc(1, sizeof(uring_loop_t));
+    if (!r) {
+        munmap(sqes, p.sq_entries * sizeof(struct io_uring_sqe));
+        munmap(ring, ring_size);
+        close(fd);
+        return -1;
+    }
+    r->ring_fd = fd;
+    r->enter_fd = fd;
+    r->sq_head = (_Atomic unsigned *)(ring + p.sq_off.head);
+    r->sq_tail = (_Atomic unsigned *)(ring + p.sq_off.tail);
+    r->sq_mask = *(unsigned *)(ring + p.sq_off.ring_mask);
+    r->sq_entries = *(unsigned *)(ring + p.sq_off.ring_entries);
+    r->sq_array = (unsigned *)(ring + p.sq_off.array);
+    r->sqes = sqes;
+    r->sq_local_tail = atomic_load_explicit(r->sq_tail, memory_order_relaxed);
+    r->cq_head = (_Atomic unsigned *)(ring + p.cq_off.head);
+    r->cq_tail = (_Atomic unsigned *)(ring + p.cq_off.tail);
+    r->cq_mask = *(unsigned *)(ring + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+    r->listen_fd = -1;
+
+    // Ring registrato: io_uring_enter() non deve risolvere il fd a ogni chiamata (kernel >= 5.18)
+    struct io_uring_rsrc_update up;
+    memset(&up, 0, sizeof(up));
+    up.offset = -1U;
+    up.data = (uint64_t)fd;
+    if (sys_uring_register(fd, IORING_REGISTER_RING_FDS, &up, 1) == 1) {
+        r->enter_fd = (int)up.offset;
+        r->enter_flags = IORING_ENTER_REGISTERED_RING;
+    }
+
+    g_loops[slot] = r;
+    return fd;
+}
+
+/**
+ * @brief Accoda un poll su fd per gli eventi indicati.
+ */
+static int add_poll(int loop_fd, int fd, unsigned events, bool multishot) {
+    uring_loop_t *r = lookup(loop_fd);
+    struct io_uring_sqe *sqe = r ? get_sqe(r) : NULL;
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    if (multishot) {
+        sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->user_data = URING_DATA(URING_OP_POLL_MULTI, fd);
+    } else {
+        sqe->user_data = URING_DATA(URING_OP_POLL, fd);
+    }
+    return 0;
+}
+
+int uring_add_poll(int loop_fd, int fd, bool multishot) {
+    return add_poll(loop_fd, fd, POLLIN | POLLRDHUP, multishot);
+}
+
+int uring_add_write_poll(int loop_fd, int fd) {
+    // Stesso user_data del poll in lettura: uring_remove_poll() cancella anche questo
+    return add_poll(loop_fd, fd, POLLOUT, false);
+}
+
+int uring_remove_poll(int loop_fd, int fd) {
+    uring_loop_t *r = lookup(loop_fd);
+    struct io_uring_sqe *sqe = r ? get_sqe(r) : NULL;
+    if (!sqe) {
+        return -1;
+    }
+    // Le SQE sono elaborate in ordine: un poll aggiunto dopo per un nuovo
+    // client con lo stesso fd non viene toccato
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = URING_DATA(URING_OP_POLL, fd);
+    sqe->user_data = URING_DATA(URING_OP_CANCEL, fd);
+    return 0;
+}
+
+int uring_add_accept(int loop_fd, int listen_fd) {
+    uring_loop_t *r = lookup(loop_fd);
+    if (!r) {
+        return -1;
+    }
+    r->listen_fd = listen_fd;
+    r->accept_armed = true;
+    if (r->accept_fallback) {
+        return uring_add_poll(loop_fd, listen_fd, true);
+    }
+    struct io_uring_sqe *sqe = get_sqe(r);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = URING_DATA(URING_OP_ACCEPT, listen_fd);
+    return 0;
+}
+
+int uring_remove_accept(int loop_fd, int listen_fd) {
+    uring_loop_t *r = lookup(loop_fd);
+    struct io_uring_sqe *sqe = r ? get_sqe(r) : NULL;
+    if (!sqe) {
+        return -1;
+    }
+    r->accept_stopped = true;
+    if (r->accept_fallback) {
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = URING_DATA(URING_OP_POLL_MULTI, listen_fd);
+    } else {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = URING_DATA(URING_OP_ACCEPT, listen_fd);
+    }
+    sqe->user_data = URING_DATA(URING_OP_CANCEL, listen_fd);
+    return 0;
+}
+
+bool uring_accept_pending(int loop_fd) {
+    uring_loop_t *r = lookup(loop_fd);
+    return r && (r->accept_armed || r->accepted_count > 0);
+}
+
+int uring_take_accepted(int loop_fd, int *fds, int max) {
+    uring_loop_t *r = lookup(loop_fd);
+    if (!r || r->accepted_count == 0) {
+        return 0;
+    }
+    int n = r->accepted_count < max ? r->accepted_count : max;
+    memcpy(fds, r->accepted, (size_t)n * sizeof(int));
+    r->accepted_count -= n;
+    memmove(r->accepted, r->accepted + n, (size_t)r->accepted_count * sizeof(int));
+    return n;
+}
+
+/**
+ * @brief Gestisce il completamento di un accept multishot.
+ * @return false se il fd non può essere accodato (coda piena: il CQE resta nel ring).
+ */
+static bool handle_accept(uring_loop_t *r, int fd, const struct io_uring_cqe *cqe) {
+    if (cqe->res >= 0) {
+        if (r->accepted_count == URING_ACCEPT_QUEUE) {
+            return false;
+        }
+        r->accepted[r->accepted_count++] = cqe->res;
+        r->accept_works = true;
+    } else if (cqe->res == -EINVAL && !r->accept_works && !r->accept_stopped) {
+        // Kernel senza accept multishot (< 5.19): accetta il worker quando il
+        // socket in ascolto risulta pronto
+        r->accept_fallback = true;
+        uring_add_poll(r->ring_fd, fd, true);
+        return true;
+    }
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        r->accept_armed = false;
+        if (!r->accept_stopped) {
+            uring_add_accept(r->ring_fd, fd); // il kernel ha terminato il multishot: lo riarmiamo
+        }
+    }
+    return true;
+}
+
+int uring_wait(int loop_fd, int max_events, int timeout, int *fds_out) {
+    uring_loop_t *r = lookup(loop_fd);
+    if (!r) {
+        return -1;
+    }
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (timeout >= 0) {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (long long)(timeout % 1000) * 1000000;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+
+    // Una sola syscall: invia registrazioni/riarmi accumulati e attende. Se ci
+    // sono già completamenti da leggere non aspettiamo.
+    atomic_store_explicit(r->sq_tail, r->sq_local_tail, memory_order_release);
+    unsigned head = atomic_load_explicit(r->cq_head, memory_order_relaxed);
+    unsigned min_complete = atomic_load_explicit(r->cq_tail, memory_order_acquire) != head ? 0 : 1;
+    int rc = sys_uring_enter(r, r->pending, min_complete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                             &arg, sizeof(arg));
+    if (rc >= 0) {
+        r->pending -= (unsigned)rc;
+    } else if (errno != ETIME && errno != EINTR && errno != EBUSY) {
+        perror("io_uring_enter");
+        return -1;
+    }
+
+    int n = 0;
+    unsigned tail = atomic_load_explicit(r->cq_tail, memory_order_acquire);
+    while (head != tail && n < max_events) {
+        const struct io_uring_cqe *cqe = &r->cqes[head & r->cq_mask];
+        int op = (int)(cqe->user_data >> 32);
+        int fd = (int)(uint32_t)cqe->user_data;
+
+        if (op == URING_OP_POLL) {
+            // Errori (ad es. -ECANCELED dopo una rimozione) non sono eventi
+            if (cqe->res > 0) {
+                fds_out[n++] = fd;
+            }
+        } else if (op == URING_OP_POLL_MULTI) {
+            if (cqe->res > 0) {
+                fds_out[n++] = fd;
+            }
+            if (!(cqe->flags & IORING_CQE_F_MORE) && cqe->res != -ECANCELED) {
+                uring_add_poll(loop_fd, fd, true);
+            } else if (!(cqe->flags & IORING_CQE_F_MORE) && fd == r->listen_fd && r->accept_fallback) {
+                r->accept_armed = false; // poll di ripiego sul socket in ascolto rimosso
+            }
+        } else if (op == URING_OP_ACCEPT) {
+            if (!handle_accept(r, fd, cqe)) {
+                break;
+            }
+        }
+        head++;
+    }
+    atomic_store_explicit(r->cq_head, head, memory_order_release);
+    return n;
+}
+
+#endif // __linux__
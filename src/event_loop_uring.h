@@ -0,0 +1,75 @@
+#ifndef EVENT_LOOP_URING_H
+#define EVENT_LOOP_URING_H
+
+#include <stdbool.h>
+
+/**
+ * Backend io_uring dell'event loop (solo Linux, syscall dirette senza liburing).
+ * Non va usato direttamente: le funzioni di event_loop.h lo selezionano quando
+ * il loop è stato creato con EVENT_BACKEND_IO_URING.
+ *
+ * Tutte le registrazioni (poll dei client, riarmi, rimozioni) diventano SQE
+ * accodate e vengono inviate insieme all'attesa con un'unica io_uring_enter();
+ * il socket in ascolto può essere servito da un accept multishot, che consegna
+ * direttamente i nuovi fd già non bloccanti.
+ */
+
+/**
+ * @brief Crea un ring. Fallisce se il kernel non ha io_uring o le funzioni richieste.
+ * @return fd del ring (handle del loop), oppure -1.
+ */
+int uring_create_loop(void);
+
+/**
+ * @brief true se loop_fd è un ring creato con uring_create_loop().
+ */
+bool uring_is_loop(int loop_fd);
+
+/**
+ * @brief Accoda un poll in lettura su fd: multishot (resta attivo) oppure one-shot.
+ * @return 0 se ok, -1 in caso di errore.
+ */
+int uring_add_poll(int loop_fd, int fd, bool multishot);
+
+/**
+ * @brief Accoda un poll one-shot in scrittura su fd.
+ * @return 0 se ok, -1 in caso di errore.
+ */
+int uring_add_write_poll(int loop_fd, int fd);
+
+/**
+ * @brief Cancella il poll one-shot pendente su fd (prima di chiuderlo).
+ */
+int uring_remove_poll(int loop_fd, int fd);
+
+/**
+ * @brief Accoda un accept multishot su listen_fd.
+ * @return 0 se ok, -1 in caso di errore.
+ */
+int uring_add_accept(int loop_fd, int listen_fd);
+
+/**
+ * @brief Cancella l'accept multishot (o il poll di ripiego) su listen_fd e non lo riarma più.
+ * @return 0 se ok, -1 in caso di errore.
+ */
+int uring_remove_accept(int loop_fd, int listen_fd);
+
+/**
+ * @brief true se l'accept su listen_fd è ancora attivo nel kernel o ci sono
+ *        fd accettati non ancora prelevati.
+ */
+bool uring_accept_pending(int loop_fd);
+
+/**
+ * @brief Preleva i fd accettati dal ring nell'ultima attesa.
+ * @return numero di fd scritti in fds.
+ */
+int uring_take_accepted(int loop_fd, int *fds, int max);
+
+/**
+ * @brief Invia le SQE accodate e attende almeno un evento (o il timeout in ms).
+ * @return numero di fd pronti scritti in fds_out, -1 in caso di errore.
+ */
+int uring_wait(int loop_fd, int max_events, int timeout, int *fds_out);
+
+#endif // EVENT_LOOP_URING_H
@@ -3,63 +3,623 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <sys/stat.h>
 
-void file_cache_init(file_cache_t *cache) {
-    for (int i = 0; i < FILE_CACHE_MAX_SLOTS; i++) {
-        cache->slots[i].path[0] = '\0';
-        cache->slots[i].entry.content = NULL;
-        cache->slots[i].entry.size = 0;
-        cache->slots[i].entry.last_modified = 0;
+#define FILE_CACHE_TOMBSTONE UINT32_MAX
+#define FILE_CACHE_LOOKUP_RETRIES 4
+
+/**
+ * @brief Hash FNV-1a a 64 bit della chiave (path + codifica della variante).
+ */
+static uint64_t hash_key(const char *path, file_cache_encoding_t encoding) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    h ^= (uint64_t)encoding;
+    h *= 1099511628211ULL;
+    return h;
+}
+
+/**
+ * @brief true se la voce ha la chiave (path, encoding) con hash h.
+ */
+static bool key_equals(const file_cache_entry_t *entry, uint64_t h, const char *path,
+                       file_cache_encoding_t encoding) {
+    return entry->hash == h && entry->encoding == encoding && strcmp(entry->path, path) == 0;
+}
+
+int file_cache_init(file_cache_t *cache, size_t budget) {
+    uint32_t max_entries = FILE_CACHE_MAX_ENTRIES;
+    uint32_t table_size = 1;
+    while (table_size < 2 * max_entries) {
+        table_size <<= 1;
+    }
+
+    // Spazio per i metadati più il budget, con margine (25%) per la
+    // frammentazione dell'arena, per i path e per le voci in uso già eliminate
+    size_t metadata = sizeof(file_cache_index_t)
+                    + (size_t)table_size * sizeof(uint32_t)
+                    + (size_t)max_entries * (sizeof(file_cache_entry_t) + 128);
+    size_t arena_size = budget + budget / 4 + metadata + (1UL << 20);
+
+    cache->arena = shm_arena_create("file_cache", arena_size);
+    if (!cache->arena) {
+        return -1;
+    }
+
+    // L'indice è allocato nell'arena, così è visibile da tutti i worker.
+    // I blocchi nuovi dell'arena sono già azzerati.
+    file_cache_index_t *index = (file_cache_index_t *)shm_alloc(cache->arena, sizeof(file_cache_index_t));
+    if (!index || shm_mutex_init(&index->lock) != 0) {
+        shm_arena_destroy(cache->arena);
+        return -1;
+    }
+    index->table = (_Atomic uint32_t *)shm_alloc(cache->arena, (size_t)table_size * sizeof(uint32_t));
+    index->entries = (file_cache_entry_t *)shm_alloc(cache->arena, (size_t)max_entries * sizeof(file_cache_entry_t));
+    if (!index->table || !index->entries) {
+        shm_arena_destroy(cache->arena);
+        return -1;
+    }
+    memset((void *)index->table, 0, (size_t)table_size * sizeof(uint32_t));
+
+    atomic_init(&index->seq, 0);
+    index->table_mask = table_size - 1;
+    index->tombstones = 0;
+    index->max_entries = max_entries;
+    index->entries_used = 0;
+    index->free_head = 0;
+    index->clock_hand = 0;
+    index->live = 0;
+    index->budget = budget;
+    index->bytes_used = 0;
+    index->sourced = 0;
+    atomic_init(&index->hits, 0);
+    atomic_init(&index->misses, 0);
+    atomic_init(&index->evictions, 0);
+    atomic_init(&index->generation, 0);
+
+    cache->index = index;
+    return 0;
+}
+
+/**
+ * @brief Prende un riferimento solo se la voce è ancora viva (refcount > 0).
+ */
+static bool try_acquire(file_cache_entry_t *entry) {
+    unsigned refs = atomic_load_explicit(&entry->refcount, memory_order_relaxed);
+    while (refs != 0) {
+        if (atomic_compare_exchange_weak_explicit(&entry->refcount, &refs, refs + 1,
+                                                  memory_order_acquire, memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Libera contenuto, header e path di una voce senza più riferimenti e la rimette nel pool.
+ *        Con locked == true il chiamante possiede già index->lock.
+ */
+static void free_entry(file_cache_t *cache, file_cache_entry_t *entry, bool locked) {
+    file_cache_index_t *index = cache->index;
+
+    shm_free(cache->arena, entry->content);
+    shm_free(cache->arena, entry->header);
+    shm_free(cache->arena, entry->source);
+    shm_free(cache->arena, entry->path);
+    entry->content = NULL;
+    entry->header = NULL;
+    entry->source = NULL;
+    entry->path = NULL;
+
+    if (!locked) {
+        shm_mutex_lock(&index->lock);
+    }
+    entry->next_free = index->free_head;
+    index->free_head = (uint32_t)(entry - index->entries) + 1;
+    if (!locked) {
+        pthread_mutex_unlock(&index->lock);
+    }
+}
+
+static void put_entry(file_cache_t *cache, file_cache_entry_t *entry, bool locked) {
+    if (atomic_fetch_sub_explicit(&entry->refcount, 1, memory_order_acq_rel) == 1) {
+        free_entry(cache, entry, locked);
+    }
+}
+
+file_cache_entry_t* file_cache_get(file_cache_t *cache, const char *path, file_cache_encoding_t encoding) {
+    file_cache_index_t *index = cache->index;
+    uint64_t h = hash_key(path, encoding);
+
+    for (int attempt = 0; attempt < FILE_CACHE_LOOKUP_RETRIES; attempt++) {
+        unsigned seq = atomic_load(&index->seq);
+        if (seq & 1) {
+            continue; // tabella in ricostruzione
+        }
+
+        uint32_t pos = (uint32_t)h & index->table_mask;
+        for (uint32_t probes = 0; probes <= index->table_mask; probes++) {
+            uint32_t value = atomic_load_explicit(&index->table[pos], memory_order_acquire);
+            if (value == 0) {
+                break;
+            }
+            if (value != FILE_CACHE_TOMBSTONE) {
+                file_cache_entry_t *entry = &index->entries[value - 1];
+                if (entry->hash == h && try_acquire(entry)) {
+                    // Con il riferimento la voce non può più essere liberata:
+                    // verifichiamo che sia ancora quella cercata
+                    if (entry->linked && key_equals(entry, h, path, encoding)) {
+                        atomic_store_explicit(&entry->referenced, true, memory_order_relaxed);
+                        atomic_fetch_add_explicit(&index->hits, 1, memory_order_relaxed);
+                        return entry;
+                    }
+                    put_entry(cache, entry, false);
+                }
+            }
+            pos = (pos + 1) & index->table_mask;
+        }
+
+        if (atomic_load(&index->seq) == seq) {
+            break; // nessuna ricostruzione nel frattempo: è davvero un miss
+        }
     }
+
+    atomic_fetch_add_explicit(&index->misses, 1, memory_order_relaxed);
+    return NULL;
+}
+
+void file_cache_release(file_cache_t *cache, file_cache_entry_t *entry) {
+    if (entry) {
+        put_entry(cache, entry, false);
+    }
+}
+
+void file_cache_retain(file_cache_entry_t *entry) {
+    // Il chiamante ha già un riferimento: il contatore non può essere a zero
+    atomic_fetch_add_explicit(&entry->refcount, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Rimuove una voce dall'indice (lock preso) e rilascia il riferimento dell'indice.
+ */
+static void unlink_entry(file_cache_t *cache, file_cache_entry_t *entry) {
+    file_cache_index_t *index = cache->index;
+
+    atomic_store_explicit(&index->table[entry->slot], FILE_CACHE_TOMBSTONE, memory_order_release);
+    index->tombstones++;
+    entry->linked = false;
+    index->bytes_used -= entry->size;
+    index->live--;
+    if (entry->source) {
+        index->sourced--;
+    }
+    put_entry(cache, entry, true);
 }
 
-static int find_slot_index(file_cache_t *cache, const char *path) {
-    // Semplice scan lineare (inefficiente ma semplice)
-    for (int i = 0; i < FILE_CACHE_MAX_SLOTS; i++) {
-        if (strcmp(cache->slots[i].path, path) == 0) {
-            return i;
+/**
+ * @brief Evizione CLOCK (lock preso): la lancetta scorre il pool, le voci usate
+ *        dall'ultimo passaggio perdono il bit di accesso, la prima senza viene rimossa.
+ * @return true se una voce è stata rimossa.
+ */
+static bool evict_one(file_cache_t *cache) {
+    file_cache_index_t *index = cache->index;
+    if (index->live == 0) {
+        return false;
+    }
+
+    for (uint32_t scanned = 0; scanned < 2 * index->entries_used + 1; scanned++) {
+        if (index->clock_hand >= index->entries_used) {
+            index->clock_hand = 0;
+        }
+        file_cache_entry_t *entry = &index->entries[index->clock_hand++];
+        if (!entry->linked || entry->pinned) {
+            continue;
         }
+        if (atomic_exchange_explicit(&entry->referenced, false, memory_order_relaxed)) {
+            continue; // seconda possibilità
+        }
+        unlink_entry(cache, entry);
+        atomic_fetch_add_explicit(&index->evictions, 1, memory_order_relaxed);
+        return true;
     }
-    return -1;
+    return false;
 }
 
-file_cache_entry_t* file_cache_get(file_cache_t *cache, const char *path) {
-    int idx = find_slot_index(cache, path);
-    if (idx < 0) {
+/**
+ * @brief Ricostruisce la tabella eliminando le tombstone (lock preso).
+ *        Il seqlock dispari segnala ai lettori di ripetere la ricerca.
+ */
+static void rebuild_table(file_cache_index_t *index) {
+    atomic_fetch_add(&index->seq, 1);
+
+    for (uint32_t i = 0; i <= index->table_mask; i++) {
+        atomic_store_explicit(&index->table[i], 0, memory_order_relaxed);
+    }
+    for (uint32_t i = 0; i < index->entries_used; i++) {
+        file_cache_entry_t *entry = &index->entries[i];
+        if (!entry->linked) {
+            continue;
+        }
+        uint32_t pos = (uint32_t)entry->hash & index->table_mask;
+        while (atomic_load_explicit(&index->table[pos], memory_order_relaxed) != 0) {
+            pos = (pos + 1) & index->table_mask;
+        }
+        atomic_store_explicit(&index->table[pos], i + 1, memory_order_relaxed);
+        entry->slot = pos;
+    }
+    index->tombstones = 0;
+
+    atomic_fetch_add(&index->seq, 1);
+}
+
+/**
+ * @brief Prende una voce libera dal pool (lock preso), oppure NULL se esaurito.
+ */
+static file_cache_entry_t *alloc_entry(file_cache_index_t *index) {
+    if (index->free_head != 0) {
+        file_cache_entry_t *entry = &index->entries[index->free_head - 1];
+        index->free_head = entry->next_free;
+        return entry;
+    }
+    if (index->entries_used < index->max_entries) {
+        return &index->entries[index->entries_used++];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Alloca un blocco nell'arena; se è piena elimina voci finché
+ *        l'allocazione riesce o non c'è più nulla da eliminare. I blocchi
+ *        liberati si fondono con quelli vicini, quindi ogni evizione rende
+ *        spazio utilizzabile da richieste di qualunque dimensione.
+ *        I blocchi di voci ancora in uso tornano disponibili solo al rilascio.
+ */
+static void *alloc_with_eviction(file_cache_t *cache, size_t size) {
+    void *block = shm_alloc(cache->arena, size);
+    while (!block) {
+        shm_mutex_lock(&cache->index->lock);
+        bool evicted = evict_one(cache);
+        pthread_mutex_unlock(&cache->index->lock);
+        if (!evicted) {
+            return NULL;
+        }
+        block = shm_alloc(cache->arena, size);
+    }
+    return block;
+}
+
+file_cache_entry_t *file_cache_reserve(file_cache_t *cache, const char *path,
+                                       file_cache_encoding_t encoding, size_t size) {
+    file_cache_index_t *index = cache->index;
+    if (size > index->budget) {
+        return NULL; // troppo grande per la cache
+    }
+
+    // Path e contenuto vengono allocati nell'arena condivisa fuori dalla sezione critica
+    size_t path_len = strlen(path);
+    char *shared_path = (char *)alloc_with_eviction(cache, path_len + 1);
+    char *shared_content = (char *)alloc_with_eviction(cache, size > 0 ? size : 1);
+    if (!shared_path || !shared_content) {
+        shm_free(cache->arena, shared_path);
+        shm_free(cache->arena, shared_content);
         return NULL;
     }
-    return &cache->slots[idx].entry;
+    memcpy(shared_path, path, path_len + 1);
+
+    shm_mutex_lock(&index->lock);
+    file_cache_entry_t *entry = alloc_entry(index);
+    if (!entry && evict_one(cache)) {
+        entry = alloc_entry(index);
+    }
+    pthread_mutex_unlock(&index->lock);
+
+    if (!entry) {
+        // Pool esaurito: niente caching
+        shm_free(cache->arena, shared_path);
+        shm_free(cache->arena, shared_content);
+        return NULL;
+    }
+
+    // Voce non ancora nell'indice: l'unico riferimento è del chiamante
+    entry->content = shared_content;
+    entry->size = size;
+    entry->header = NULL;
+    entry->header_len = 0;
+    entry->etag[0] = '\0';
+    entry->last_modified = 0;
+    entry->encoding = (uint8_t)encoding;
+    entry->source = NULL;
+    entry->source_size = size;
+    atomic_store_explicit(&entry->variants, 0, memory_order_relaxed);
+    entry->path = shared_path;
+    entry->hash = hash_key(path, encoding);
+    entry->linked = false;
+    entry->pinned = false;
+    atomic_store_explicit(&entry->referenced, false, memory_order_relaxed);
+    atomic_store_explicit(&entry->refcount, 1, memory_order_release);
+    return entry;
 }
 
-void file_cache_put(file_cache_t *cache, const char *path, const char *content, size_t size, time_t last_modified) {
-    // Se esiste già, sovrascriviamo
-    int idx = find_slot_index(cache, path);
-
-    if (idx < 0) {
-        // Trova uno slot libero
-        for (int i = 0; i < FILE_CACHE_MAX_SLOTS; i++) {
-            if (cache->slots[i].path[0] == '\0') {
-                idx = i;
+bool file_cache_commit(file_cache_t *cache, file_cache_entry_t *entry, time_t last_modified) {
+    file_cache_index_t *index = cache->index;
+    uint64_t h = entry->hash;
+    size_t size = entry->size;
+
+    entry->last_modified = last_modified;
+
+    shm_mutex_lock(&index->lock);
+
+    // Se esiste già, sovrascriviamo; altrimenti usiamo la prima tombstone
+    // o il primo slot vuoto della sequenza di probing
+    uint32_t pos = (uint32_t)h & index->table_mask;
+    uint32_t insert_pos = UINT32_MAX;
+    file_cache_entry_t *old = NULL;
+    while (1) {
+        uint32_t value = atomic_load_explicit(&index->table[pos], memory_order_relaxed);
+        if (value == 0) {
+            if (insert_pos == UINT32_MAX) {
+                insert_pos = pos;
+            }
+            break;
+        }
+        if (value == FILE_CACHE_TOMBSTONE) {
+            if (insert_pos == UINT32_MAX) {
+                insert_pos = pos;
+            }
+        } else {
+            file_cache_entry_t *other = &index->entries[value - 1];
+            if (key_equals(other, h, entry->path, entry->encoding)) {
+                old = other;
+                insert_pos = pos;
                 break;
             }
         }
+        pos = (pos + 1) & index->table_mask;
     }
 
-    if (idx < 0) {
-        // Non abbiamo trovato slot: niente caching
-        return;
+    // Rispettiamo il budget (la voce sostituita non conta). L'evizione crea solo
+    // tombstone, quindi insert_pos resta una posizione valida; se elimina proprio
+    // la voce da sostituire, il suo slot diventa una tombstone riutilizzabile.
+    while (index->bytes_used - (old ? old->size : 0) + size > index->budget && evict_one(cache)) {
+        if (old && !old->linked) {
+            old = NULL;
+        }
+    }
+    if (index->bytes_used - (old ? old->size : 0) + size > index->budget) {
+        // Budget non rispettabile: la voce resta fuori dall'indice
+        pthread_mutex_unlock(&index->lock);
+        return false;
+    }
+
+    // La voce diventa visibile ai lettori con il riferimento dell'indice
+    // (una nuova versione di un file caldo resta bloccata come la precedente)
+    entry->pinned = old && old->pinned;
+    entry->slot = insert_pos;
+    entry->linked = true;
+    atomic_fetch_add_explicit(&entry->refcount, 1, memory_order_relaxed);
+
+    uint32_t previous = atomic_load_explicit(&index->table[insert_pos], memory_order_relaxed);
+    atomic_store_explicit(&index->table[insert_pos], (uint32_t)(entry - index->entries) + 1,
+                          memory_order_release);
+    if (previous == FILE_CACHE_TOMBSTONE) {
+        index->tombstones--;
+    }
+    index->bytes_used += size;
+    index->live++;
+    if (entry->source) {
+        index->sourced++;
+    }
+
+    if (old) {
+        // I lettori che la stanno servendo la tengono viva finché non la rilasciano
+        old->linked = false;
+        index->bytes_used -= old->size;
+        index->live--;
+        if (old->source) {
+            index->sourced--;
+        }
+        put_entry(cache, old, true);
     }
 
-    strncpy(cache->slots[idx].path, path, sizeof(cache->slots[idx].path) - 1);
-    if (cache->slots[idx].entry.content) {
-        free(cache->slots[idx].entry.content);
-        cache->slots[idx].entry.content = NULL;
+    if (index->tombstones > (index->table_mask + 1) / 4) {
+        rebuild_table(index);
     }
-    cache->slots[idx].entry.content = (char*)malloc(size);
-    if (!cache->slots[idx].entry.content) {
+
+    pthread_mutex_unlock(&index->lock);
+    return true;
+}
+
+void file_cache_put(file_cache_t *cache, const char *path, const char *content, size_t size, time_t last_modified) {
+    file_cache_entry_t *entry = file_cache_reserve(cache, path, FILE_CACHE_IDENTITY, size);
+    if (!entry) {
         return;
     }
-    memcpy(cache->slots[idx].entry.content, content, size);
-    cache->slots[idx].entry.size = size;
-    cache->slots[idx].entry.last_modified = last_modified;
+    memcpy(entry->content, content, size);
+    file_cache_commit(cache, entry, last_modified);
+    file_cache_release(cache, entry);
+}
+
+int file_cache_fd(const file_cache_t *cache) {
+    return shm_arena_fd(cache->arena);
+}
+
+off_t file_cache_offset(const file_cache_t *cache, const void *ptr) {
+    return (off_t)shm_arena_offset(cache->arena, ptr);
+}
+
+bool file_cache_set_header(file_cache_t *cache, file_cache_entry_t *entry, const char *header, size_t len) {
+    char *shared_header = (char *)alloc_with_eviction(cache, len);
+    if (!shared_header) {
+        return false;
+    }
+    memcpy(shared_header, header, len);
+    shm_free(cache->arena, entry->header);
+    entry->header = shared_header;
+    entry->header_len = len;
+    return true;
+}
+
+bool file_cache_set_source(file_cache_t *cache, file_cache_entry_t *entry, const char *source, size_t source_size) {
+    size_t len = strlen(source);
+    char *shared_source = (char *)alloc_with_eviction(cache, len + 1);
+    if (!shared_source) {
+        return false;
+    }
+    memcpy(shared_source, source, len + 1);
+    shm_free(cache->arena, entry->source);
+    entry->source = shared_source;
+    entry->source_size = source_size;
+    return true;
+}
+
+/**
+ * @brief Cerca la voce (path, encoding) nell'indice (lock preso).
+ */
+static file_cache_entry_t *find_locked(file_cache_index_t *index, const char *path,
+                                       file_cache_encoding_t encoding) {
+    uint64_t h = hash_key(path, encoding);
+    uint32_t pos = (uint32_t)h & index->table_mask;
+    while (1) {
+        uint32_t value = atomic_load_explicit(&index->table[pos], memory_order_relaxed);
+        if (value == 0) {
+            return NULL;
+        }
+        if (value != FILE_CACHE_TOMBSTONE) {
+            file_cache_entry_t *entry = &index->entries[value - 1];
+            if (key_equals(entry, h, path, encoding)) {
+                return entry;
+            }
+        }
+        pos = (pos + 1) & index->table_mask;
+    }
+}
+
+bool file_cache_invalidate(file_cache_t *cache, const char *path) {
+    file_cache_index_t *index = cache->index;
+    bool removed = false;
+
+    // Anche se il file non è in cache: qualcosa nella document root è cambiato
+    atomic_fetch_add(&index->generation, 1);
+
+    shm_mutex_lock(&index->lock);
+    for (int enc = 0; enc < FILE_CACHE_ENCODINGS; enc++) {
+        file_cache_entry_t *entry = find_locked(index, path, (file_cache_encoding_t)enc);
+        if (entry) {
+            unlink_entry(cache, entry);
+            removed = true;
+        }
+    }
+
+    // Varianti costruite da questo file sotto un altro path (ad es. x.html.gz
+    // servito come variante gzip di x.html): poche, ma vanno cercate tutte
+    for (uint32_t i = 0; i < index->entries_used && index->sourced > 0; i++) {
+        file_cache_entry_t *entry = &index->entries[i];
+        if (entry->linked && entry->source && strcmp(entry->source, path) == 0) {
+            unlink_entry(cache, entry);
+            removed = true;
+        }
+    }
+    pthread_mutex_unlock(&index->lock);
+
+    return removed;
+}
+
+void file_cache_clear(file_cache_t *cache) {
+    file_cache_index_t *index = cache->index;
+
+    atomic_fetch_add(&index->generation, 1);
+    shm_mutex_lock(&index->lock);
+    for (uint32_t i = 0; i < index->entries_used; i++) {
+        if (index->entries[i].linked) {
+            unlink_entry(cache, &index->entries[i]);
+        }
+    }
+    rebuild_table(index);
+    pthread_mutex_unlock(&index->lock);
+}
+
+size_t file_cache_revalidate(file_cache_t *cache) {
+    file_cache_index_t *index = cache->index;
+    size_t removed = 0;
+
+    for (uint32_t i = 0; i < index->entries_used; i++) {
+        file_cache_entry_t *entry = &index->entries[i];
+
+        // Riferimento temporaneo: path e metadati restano validi durante la stat
+        if (!entry->linked || !try_acquire(entry)) {
+            continue;
+        }
+        if (entry->linked) {
+            struct stat st;
+            const char *source = entry->source ? entry->source : entry->path;
+            if (stat(source, &st) < 0 || st.st_mtime != entry->last_modified ||
+                (size_t)st.st_size != entry->source_size) {
+                shm_mutex_lock(&index->lock);
+                if (entry->linked) {
+                    unlink_entry(cache, entry);
+                    removed++;
+                }
+                pthread_mutex_unlock(&index->lock);
+            }
+        }
+        put_entry(cache, entry, false);
+    }
+    if (removed > 0) {
+        atomic_fetch_add(&index->generation, 1);
+    }
+    return removed;
+}
+
+bool file_cache_contains(file_cache_t *cache, const char *path, file_cache_encoding_t encoding) {
+    file_cache_index_t *index = cache->index;
+
+    shm_mutex_lock(&index->lock);
+    bool found = find_locked(index, path, encoding) != NULL;
+    pthread_mutex_unlock(&index->lock);
+    return found;
+}
+
+bool file_cache_pin(file_cache_t *cache, const char *path) {
+    file_cache_index_t *index = cache->index;
+    bool pinned = false;
+
+    shm_mutex_lock(&index->lock);
+    for (int enc = 0; enc < FILE_CACHE_ENCODINGS; enc++) {
+        file_cache_entry_t *entry = find_locked(index, path, (file_cache_encoding_t)enc);
+        if (entry) {
+            entry->pinned = true;
+            pinned = true;
+        }
+    }
+    pthread_mutex_unlock(&index->lock);
+    return pinned;
+}
+
+unsigned long file_cache_generation(const file_cache_t *cache) {
+    return atomic_load_explicit(&cache->index->generation, memory_order_acquire);
+}
+
+void file_cache_get_stats(file_cache_t *cache, file_cache_stats_t *stats) {
+    file_cache_index_t *index = cache->index;
+
+    stats->hits = atomic_load(&index->hits);
+    stats->misses = atomic_load(&index->misses);
+    stats->evictions = atomic_load(&index->evictions);
+
+    shm_mutex_lock(&index->lock);
+    stats->entries = index->live;
+    stats->bytes = index->bytes_used;
+    stats->budget = index->budget;
+    pthread_mutex_unlock(&index->lock);
+}
+
+void file_cache_destroy(file_cache_t *cache) {
+    if (cache->arena) {
+        shm_arena_destroy(cache->arena);
+        cache->arena = NULL;
+        cache->index = NULL;
+    }
 }
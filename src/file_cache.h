@@ -2,41 +2,253 @@
 #define FILE_CACHE_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 #include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "shm_arena.h"
 
+#define FILE_CACHE_DEFAULT_SIZE (64UL * 1024 * 1024) // budget dei contenuti: 64 MB
+#define FILE_CACHE_MAX_ENTRIES 65536                 // numero massimo di path in cache
+#define FILE_CACHE_ETAG_MAX 48                       // ETag tra virgolette, terminato da '\0'
+
+/**
+ * @brief Codifica del contenuto di una voce: lo stesso path può avere in cache
+ *        più varianti (identità, gzip, brotli), ognuna con la propria chiave.
+ */
+typedef enum {
+    FILE_CACHE_IDENTITY = 0,
+    FILE_CACHE_GZIP,
+    FILE_CACHE_BR,
+    FILE_CACHE_ENCODINGS
+} file_cache_encoding_t;
+
+#define FILE_CACHE_VARIANTS_MASK 0x0fu                 // in variants: bit delle varianti disponibili
+#define FILE_CACHE_VARIANT_BUILDING(enc) (0x10u << (enc)) // in variants: variante in costruzione
+
+/**
+ * @brief Voce della cache. Le voci sono contate per riferimento: l'indice ne
+ *        possiede uno e ogni lettore che l'ha ottenuta con file_cache_get()
+ *        un altro, da restituire con file_cache_release(). Il contenuto viene
+ *        liberato solo quando l'ultimo riferimento sparisce, quindi una voce
+ *        può essere servita anche mentre viene sostituita o rimossa.
+ */
 typedef struct {
     char *content;
     size_t size;
     time_t last_modified;
+    char *header;           // blocco header HTTP precalcolato (senza Date), o NULL
+    size_t header_len;
+    char etag[FILE_CACHE_ETAG_MAX]; // validatore calcolato all'inserimento ("" se assente)
+    uint8_t encoding;       // file_cache_encoding_t del contenuto
+    atomic_uchar variants;  // solo identità: bit (1 << encoding) delle varianti disponibili,
+                            // più FILE_CACHE_VARIANT_BUILDING(encoding) mentre un thread la crea
+                            // (se il worker muore a metà resta preso: si serve l'identità
+                            // finché la voce non viene sostituita)
+    char *source;           // file da cui deriva il contenuto, se diverso da path (o NULL)
+    size_t source_size;     // dimensione del file sorgente (per la rivalidazione)
+
+    // Campi interni
+    char *path;
+    uint64_t hash;
+    atomic_uint refcount;   // 0 = voce libera nel pool
+    atomic_bool referenced; // bit di accesso per l'evizione (CLOCK)
+    bool pinned;            // mai eliminata per far posto ad altre voci (file caldi)
+    uint32_t slot;          // posizione nella tabella hash (se linked)
+    bool linked;            // presente nell'indice
+    uint32_t next_free;     // free list del pool
 } file_cache_entry_t;
 
+/**
+ * @brief Contatori della cache (condivisi tra tutti i worker).
+ */
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    unsigned long entries;
+    size_t bytes;           // byte dei contenuti presenti nell'indice
+    size_t budget;          // limite configurato
+} file_cache_stats_t;
+
+/**
+ * @brief Indice della cache, nella memoria condivisa insieme ai contenuti.
+ *
+ *        - Tabella hash a indirizzamento aperto (probing lineare) di indici nel
+ *          pool delle voci: lookup O(1) anche con decine di migliaia di path.
+ *        - Lettori senza lock: le voci stanno in un pool che non viene mai
+ *          restituito all'allocatore, quindi un lettore può sempre tentare
+ *          di prendere un riferimento (solo se refcount > 0) e poi verificare
+ *          che la voce corrisponda ancora al path cercato.
+ *        - Gli scrittori (put, evizione) sono serializzati dal mutex condiviso;
+ *          seq è un seqlock che resta dispari durante la ricostruzione della
+ *          tabella, così un lettore non scambia per miss una voce spostata.
+ *        - Evizione CLOCK (approssimazione di LRU compatibile con lettori senza
+ *          lock) quando i contenuti superano il budget in byte.
+ */
 typedef struct {
-    char path[512];
-    file_cache_entry_t entry;
-} file_cache_slot_t;
+    pthread_mutex_t lock;
+    atomic_uint seq;
+
+    _Atomic uint32_t *table;    // 0 = vuoto, FILE_CACHE_TOMBSTONE = rimosso, altrimenti indice+1
+    uint32_t table_mask;
+    uint32_t tombstones;
+
+    file_cache_entry_t *entries;
+    uint32_t max_entries;
+    uint32_t entries_used;      // voci del pool mai usate oltre questo indice
+    uint32_t free_head;         // free list del pool (indice+1, 0 = vuota)
+    uint32_t clock_hand;
+    uint32_t live;
+
+    size_t budget;
+    size_t bytes_used;
+    uint32_t sourced;           // voci nell'indice con source != NULL
 
-#define FILE_CACHE_MAX_SLOTS 64
+    atomic_ulong hits;
+    atomic_ulong misses;
+    atomic_ulong evictions;
+    atomic_ulong generation;    // incrementato a ogni invalidazione
+} file_cache_index_t;
 
 /**
- * @brief Struttura base di un file cache
+ * @brief Struttura base di un file cache: riferimenti alla regione condivisa
+ *        (creata dal master prima del fork, quindi comune a tutti i worker).
  */
 typedef struct {
-    file_cache_slot_t slots[FILE_CACHE_MAX_SLOTS];
+    shm_arena_t *arena;
+    file_cache_index_t *index;
 } file_cache_t;
 
 /**
- * @brief Inizializza la cache.
+ * @brief Inizializza la cache in una regione condivisa con un budget di
+ *        budget byte per i contenuti. Va chiamata prima di creare i worker.
+ * @return 0 se ok, -1 in caso di errore.
  */
-void file_cache_init(file_cache_t *cache);
+int file_cache_init(file_cache_t *cache, size_t budget);
 
 /**
- * @brief Recupera il contenuto dalla cache. Se presente, restituisce puntatore a entry, altrimenti NULL.
+ * @brief Recupera la variante encoding di path dalla cache senza prendere lock.
+ *        Se presente restituisce la voce con un riferimento in più (da
+ *        rilasciare con file_cache_release()), altrimenti NULL.
  */
-file_cache_entry_t* file_cache_get(file_cache_t *cache, const char *path);
+file_cache_entry_t* file_cache_get(file_cache_t *cache, const char *path, file_cache_encoding_t encoding);
 
 /**
- * @brief Inserisce un file nella cache (path + contenuto).
+ * @brief Rilascia un riferimento ottenuto con file_cache_get().
+ */
+void file_cache_release(file_cache_t *cache, file_cache_entry_t *entry);
+
+/**
+ * @brief Aggiunge un riferimento a una voce di cui il chiamante ne possiede già
+ *        uno (ad es. per accodarne in uscita sia l'header sia il contenuto).
+ */
+void file_cache_retain(file_cache_entry_t *entry);
+
+/**
+ * @brief Inserisce (o sostituisce) un file nella cache (path + contenuto),
+ *        eliminando le voci meno usate se il budget è superato.
  */
 void file_cache_put(file_cache_t *cache, const char *path, const char *content, size_t size, time_t last_modified);
 
+/**
+ * @brief Prepara una voce di size byte per la variante encoding di path, non
+ *        ancora visibile ai lettori:
+ *        il chiamante scrive il contenuto direttamente in entry->content (ad es.
+ *        con read() dal file, senza buffer intermedi) e poi la pubblica con
+ *        file_cache_commit(). Il riferimento restituito va comunque rilasciato
+ *        con file_cache_release().
+ * @return la voce, oppure NULL se il file non può essere messo in cache.
+ */
+file_cache_entry_t *file_cache_reserve(file_cache_t *cache, const char *path,
+                                       file_cache_encoding_t encoding, size_t size);
+
+/**
+ * @brief Pubblica nell'indice una voce preparata con file_cache_reserve(),
+ *        sostituendo l'eventuale versione precedente.
+ * @return true se la voce è ora in cache, false se il budget non lo consente.
+ */
+bool file_cache_commit(file_cache_t *cache, file_cache_entry_t *entry, time_t last_modified);
+
+/**
+ * @brief File descriptor (memfd) della regione della cache, oppure -1 se la
+ *        regione non è un file. Permette di inviare i contenuti con sendfile().
+ */
+int file_cache_fd(const file_cache_t *cache);
+
+/**
+ * @brief Offset all'interno di file_cache_fd() di un puntatore nella regione
+ *        della cache (ad es. entry->content).
+ */
+off_t file_cache_offset(const file_cache_t *cache, const void *ptr);
+
+/**
+ * @brief Associa a una voce preparata con file_cache_reserve() (prima del
+ *        commit) il blocco header da servire con il contenuto. Dopo il commit
+ *        entry->header è immutabile come il contenuto.
+ * @return true se ok, false se la regione condivisa è esaurita.
+ */
+bool file_cache_set_header(file_cache_t *cache, file_cache_entry_t *entry, const char *header, size_t len);
+
+/**
+ * @brief Indica (prima del commit) il file da cui deriva il contenuto quando non
+ *        è path stesso, ad es. un fratello precompresso o il file originale di
+ *        una variante compressa. Rivalidazione e invalidazione useranno source.
+ * @return true se ok, false se la regione condivisa è esaurita.
+ */
+bool file_cache_set_source(file_cache_t *cache, file_cache_entry_t *entry, const char *source, size_t source_size);
+
+/**
+ * @brief Rimuove dalla cache tutte le varianti di path e quelle derivate da
+ *        path (se presenti). Chi le sta servendo le tiene vive fino al rilascio.
+ * @return true se la voce era presente.
+ */
+bool file_cache_invalidate(file_cache_t *cache, const char *path);
+
+/**
+ * @brief true se la variante encoding di path è in cache. A differenza di
+ *        file_cache_get() non prende riferimenti e non conta hit o miss.
+ */
+bool file_cache_contains(file_cache_t *cache, const char *path, file_cache_encoding_t encoding);
+
+/**
+ * @brief Esclude dall'evizione le varianti di path presenti in cache: restano
+ *        finché il file non cambia (la nuova versione inserita con
+ *        file_cache_commit() eredita il blocco, un'invalidazione lo perde).
+ * @return true se almeno una variante è stata bloccata.
+ */
+bool file_cache_pin(file_cache_t *cache, const char *path);
+
+/**
+ * @brief Contatore che cresce a ogni invalidazione (evento inotify, sweep,
+ *        svuotamento): chi conserva informazioni ricavate dai file della
+ *        document root, come la cache dei file aperti, sa quando ricontrollarle.
+ */
+unsigned long file_cache_generation(const file_cache_t *cache);
+
+/**
+ * @brief Rimuove tutte le voci dalla cache.
+ */
+void file_cache_clear(file_cache_t *cache);
+
+/**
+ * @brief Controlla con stat() tutte le voci e rimuove quelle il cui file
+ *        (o file sorgente) è cambiato (mtime o dimensione) o non esiste più. Pensata per un thread
+ *        in background: le stat avvengono fuori dal lock.
+ * @return numero di voci rimosse.
+ */
+size_t file_cache_revalidate(file_cache_t *cache);
+
+/**
+ * @brief Legge i contatori della cache.
+ */
+void file_cache_get_stats(file_cache_t *cache, file_cache_stats_t *stats);
+
+/**
+ * @brief Rilascia la regione condivisa (nel processo corrente).
+ */
+void file_cache_destroy(file_cache_t *cache);
+
 #endif // FILE_CACHE_H
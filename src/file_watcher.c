@@ -0,0 +1,193 @@
+#include "file_watcher.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#define WATCH_MAX_DIRS 1024
+#define WATCH_PATH_LEN 512
+
+extern bool g_verbose;
+
+typedef struct {
+    file_cache_t *cache;
+    int sweep_sec;
+    int inotify_fd;                          // -1 se inotify non disponibile
+    int watch_count;
+    int wds[WATCH_MAX_DIRS];                 // watch descriptor...
+    char dirs[WATCH_MAX_DIRS][WATCH_PATH_LEN]; // ...e directory corrispondente
+} file_watcher_t;
+
+static file_watcher_t g_watcher;
+
+#ifdef __linux__
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | \
+                    IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_ONLYDIR)
+
+/**
+ * @brief Aggiunge un watch su dir e, ricorsivamente, sulle sottodirectory.
+ */
+static void watch_tree(file_watcher_t *w, const char *dir) {
+    if (w->watch_count >= WATCH_MAX_DIRS) {
+        fprintf(stderr, "[watcher] Troppe directory, %s non osservata\n", dir);
+        return;
+    }
+    int wd = inotify_add_watch(w->inotify_fd, dir, WATCH_MASK);
+    if (wd < 0) {
+        perror("inotify_add_watch");
+        return;
+    }
+    w->wds[w->watch_count] = wd;
+    snprintf(w->dirs[w->watch_count], WATCH_PATH_LEN, "%s", dir);
+    w->watch_count++;
+
+    DIR *d = opendir(dir);
+    if (!d) {
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+            continue;
+        }
+        char child[WATCH_PATH_LEN];
+        struct stat st;
+        snprintf(child, sizeof(child), "%s/%s", dir, de->d_name);
+        if (stat(child, &st) == 0 && S_ISDIR(st.st_mode)) {
+            watch_tree(w, child);
+        }
+    }
+    closedir(d);
+}
+
+static const char *dir_of_watch(file_watcher_t *w, int wd) {
+    for (int i = 0; i < w->watch_count; i++) {
+        if (w->wds[i] == wd) {
+            return w->dirs[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Legge gli eventi inotify disponibili e invalida le voci interessate.
+ */
+static void handle_inotify_events(file_watcher_t *w) {
+    char buf[8192] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+
+    while ((len = read(w->inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                // Eventi persi: non sappiamo cosa è cambiato, svuotiamo tutto
+                file_cache_clear(w->cache);
+                if (g_verbose) {
+                    printf("[watcher] Coda inotify piena, cache svuotata\n");
+                }
+                continue;
+            }
+
+            const char *dir = dir_of_watch(w, ev->wd);
+            if (!dir || ev->len == 0) {
+                continue;
+            }
+            char path[WATCH_PATH_LEN];
+            snprintf(path, sizeof(path), "%s/%s", dir, ev->name);
+
+            if ((ev->mask & IN_CREATE) && (ev->mask & IN_ISDIR)) {
+                watch_tree(w, path); // nuova sottodirectory
+            } else if (file_cache_invalidate(w->cache, path) && g_verbose) {
+                printf("[watcher] %s cambiato, rimosso dalla cache\n", path);
+            }
+        }
+    }
+}
+
+#endif // __linux__
+
+/**
+ * @brief Thread del watcher: attende eventi inotify e, allo scadere
+ *        dell'intervallo, esegue il controllo con stat() di tutte le voci.
+ */
+static void *file_watcher_thread(void *arg) {
+    file_watcher_t *w = (file_watcher_t *)arg;
+    time_t last_sweep = time(NULL);
+
+    while (1) {
+        int timeout_ms = w->sweep_sec > 0 ? w->sweep_sec * 1000 : -1;
+
+#ifdef __linux__
+        if (w->inotify_fd >= 0) {
+            struct pollfd pfd = { .fd = w->inotify_fd, .events = POLLIN, .revents = 0 };
+            if (poll(&pfd, 1, timeout_ms) > 0) {
+                handle_inotify_events(w);
+            }
+        } else
+#endif
+        {
+            if (timeout_ms < 0) {
+                break; // nessun meccanismo attivo
+            }
+            usleep((useconds_t)timeout_ms * 1000);
+        }
+
+        time_t now = time(NULL);
+        if (w->sweep_sec > 0 && now - last_sweep >= w->sweep_sec) {
+            size_t removed = file_cache_revalidate(w->cache);
+            if (removed > 0 && g_verbose) {
+                printf("[watcher] Controllo periodico: %zu voci non aggiornate rimosse\n", removed);
+            }
+            last_sweep = now;
+        }
+    }
+    return NULL;
+}
+
+int file_watcher_start(file_cache_t *cache, const char *docroot, int sweep_sec) {
+    file_watcher_t *w = &g_watcher;
+    w->cache = cache;
+    w->sweep_sec = sweep_sec;
+    w->inotify_fd = -1;
+    w->watch_count = 0;
+
+#ifdef __linux__
+    w->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->inotify_fd < 0) {
+        perror("inotify_init1");
+    } else {
+        watch_tree(w, docroot);
+        if (w->watch_count == 0) {
+            close(w->inotify_fd);
+            w->inotify_fd = -1;
+        }
+    }
+#else
+    (void)docroot;
+#endif
+
+    if (w->inotify_fd < 0 && sweep_sec <= 0) {
+        fprintf(stderr, "[watcher] inotify non disponibile e controllo periodico disabilitato\n");
+        return -1;
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, file_watcher_thread, w) != 0) {
+        perror("pthread_create watcher");
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include "file_cache.h"
+
+#define FILE_WATCHER_DEFAULT_SWEEP_SEC 30 // controllo con stat() di tutte le voci
+
+/**
+ * @brief Avvia un thread in background che tiene la cache allineata ai file
+ *        della document root:
+ *        - con inotify (Linux) invalida le voci dei file modificati, rinominati
+ *          o cancellati pochi millisecondi dopo l'evento;
+ *        - ogni sweep_sec secondi (e dove inotify non è disponibile) controlla
+ *          tutte le voci con stat() e rimuove quelle non più aggiornate.
+ *        Il percorso di risposta in caso di hit non fa quindi nessuna syscall.
+ *
+ * @param cache cache condivisa da mantenere aggiornata.
+ * @param docroot directory da osservare (ricorsivamente).
+ * @param sweep_sec intervallo del controllo periodico (<= 0 per disabilitarlo).
+ * @return 0 se ok, -1 in caso di errore.
+ */
+int file_watcher_start(file_cache_t *cache, const char *docroot, int sweep_sec);
+
+#endif // FILE_WATCHER_H
@@ -0,0 +1,67 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+/**
+ * Bucket log-lineari (stile HDR) per le latenze in ns, condivisi da metrics.c
+ * e dal generatore di carico: i primi 2^SUB_BUCKET_BITS valori sono esatti,
+ * poi ogni potenza di 2 è divisa in 2^SUB_BUCKET_BITS intervalli uguali.
+ */
+
+#define HISTOGRAM_SUB_BUCKET_BITS 4   // 16 intervalli per potenza di 2 (errore <= 6.25%)
+#define HISTOGRAM_MAX_EXPONENT 40     // fino a 2^40 ns (~18 minuti), oltre nell'ultimo bucket
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_EXPONENT - HISTOGRAM_SUB_BUCKET_BITS + 1) << HISTOGRAM_SUB_BUCKET_BITS)
+
+/**
+ * @brief Bucket del valore v.
+ */
+static inline int histogram_bucket(uint64_t v) {
+    const int sub = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+    if (v < (uint64_t)sub) {
+        return (int)v;
+    }
+    if (v >> HISTOGRAM_MAX_EXPONENT) {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+    return ((shift + 1) << HISTOGRAM_SUB_BUCKET_BITS) + (int)((v >> shift) - (uint64_t)sub);
+}
+
+/**
+ * @brief Valore più alto rappresentato dal bucket idx.
+ */
+static inline uint64_t histogram_bucket_upper(int idx) {
+    const int sub = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+    int group = idx >> HISTOGRAM_SUB_BUCKET_BITS;
+    uint64_t pos = (uint64_t)(idx & (sub - 1));
+    if (group == 0) {
+        return pos;
+    }
+    return (((uint64_t)sub + pos + 1) << (group - 1)) - 1;
+}
+
+/**
+ * @brief Quantile q (0..1) di un istogramma con total campioni.
+ * @return limite superiore del bucket che contiene il quantile, 0 se vuoto.
+ */
+static inline uint64_t histogram_percentile(const unsigned long *counts, unsigned long total, double q) {
+    if (total == 0) {
+        return 0;
+    }
+    unsigned long rank = (unsigned long)(q * (double)total + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    unsigned long seen = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        seen += counts[b];
+        if (seen >= rank) {
+            return histogram_bucket_upper(b);
+        }
+    }
+    return histogram_bucket_upper(HISTOGRAM_BUCKETS - 1);
+}
+
+#endif // HISTOGRAM_H
@@ -1,11 +1,9 @@
-#ifdef __APPLE__
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <sys/uio.h>
-#endif
 #include "http_response.h"
 #include "file_cache.h"
+#include "open_file_cache.h"
+#include "bundle.h"
 #include "performance_log.h"
+#include "metrics.h"
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -14,23 +12,133 @@
 #include <time.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <strings.h>
+#include <errno.h>
+#include <dirent.h>
+#include <zlib.h>
 
-
-
+#define RESPONSE_HEADER_MAX 1024
+#define CACHE_CONTROL_MAX_AGE 60 // secondi per cui un client può riusare un file senza rivalidarlo
+#define MAX_RANGES 16            // oltre questo numero di intervalli l'header Range viene ignorato
+#define LOCAL_PATH_MAX 512       // path locale (DOCUMENT_ROOT + path della richiesta)
+#define METRICS_BODY_INITIAL (16 * 1024) // primo tentativo per la risposta di /metrics (cresce con i worker)
+#define GZIP_MIN_SIZE 256        // sotto questa dimensione la compressione non ripaga gli header
+#define GZIP_LEVEL_REQUEST 1     // compressione al primo uso, dentro un thread del pool
+#define GZIP_LEVEL_OFFLINE 9     // pre-riscaldamento e bundle: prima di servire, conviene il massimo
 
 extern file_cache_t g_file_cache;   // definita altrove
-extern bool g_enable_zerocopy;      // definito in main.c
+extern open_file_cache_t g_open_files; // definita in main.c, una per worker
+extern bundle_t g_bundle;            // definito in main.c (file == NULL senza --bundle)
 extern bool g_verbose;              // definito in main.c
 
-static void send_data(int client_fd, const char *data) {
-    size_t len = strlen(data);
-    write(client_fd, data, len);
+/**
+ * @brief Blocco header di una risposta, costruito in un unico buffer e poi
+ *        accodato nella coda di uscita della connessione insieme al body.
+ */
+typedef struct {
+    char data[RESPONSE_HEADER_MAX];
+    size_t len;
+} response_header_t;
 
-    // log
-    if (g_verbose) {
-        printf("[response] Inviati %zu bytes a fd=%d\n", len, client_fd);
+/**
+ * @brief Inizia il blocco header con la status line.
+ */
+static void header_init(response_header_t *h, const char *status) {
+    h->len = (size_t)snprintf(h->data, sizeof(h->data), "HTTP/1.1 %s\r\n", status);
+}
+
+/**
+ * @brief Aggiunge una riga di header (formato printf, senza "\r\n" finale).
+ *        Le righe che non entrano nel buffer vengono scartate.
+ */
+static void header_add(response_header_t *h, const char *fmt, ...) {
+    // Riserviamo sempre 2 byte per la riga vuota finale
+    size_t room = sizeof(h->data) - h->len;
+    if (room <= 4) {
+        return;
     }
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(h->data + h->len, room - 2, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n + 4 > room) {
+        h->data[h->len] = '\0';
+        return;
+    }
+    h->len += (size_t)n;
+    memcpy(h->data + h->len, "\r\n", 2);
+    h->len += 2;
+}
 
+/**
+ * @brief Formatta t come data HTTP (IMF-fixdate, ad es. "Sun, 06 Nov 1994 08:49:37 GMT").
+ */
+static size_t format_http_date(time_t t, char *buf, size_t size) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    return strftime(buf, size, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+#define CONNECTION_CLOSE_LINE "Connection: close\r\n"
+
+// true mentre si genera l'ultima risposta di una connessione (per thread)
+static __thread bool t_connection_close;
+
+/**
+ * @brief Riga "Date" seguita dalla riga vuota che chiude gli header. La stringa
+ *        viene ricalcolata al più una volta al secondo (per thread, quindi
+ *        senza sincronizzazione) e condivisa da tutte le risposte; è preceduta
+ *        da "Connection: close", che si salta se la connessione resta aperta.
+ *        Così anche gli header precalcolati in cache possono annunciare la chiusura.
+ */
+static const char *date_line(size_t *len, bool close) {
+    static __thread time_t cached_sec = -1;
+    static __thread char line[64];
+    static __thread size_t line_len;
+
+    time_t now = time(NULL);
+    if (now != cached_sec) {
+        char date[40];
+        format_http_date(now, date, sizeof(date));
+        line_len = (size_t)snprintf(line, sizeof(line), CONNECTION_CLOSE_LINE "Date: %s\r\n\r\n", date);
+        cached_sec = now;
+    }
+    size_t skip = close ? 0 : sizeof(CONNECTION_CLOSE_LINE) - 1;
+    *len = line_len - skip;
+    return line + skip;
+}
+
+/**
+ * @brief Accoda la riga Date e la riga vuota finale.
+ */
+static void queue_date_line(output_queue_t *out) {
+    size_t len;
+    const char *line = date_line(&len, t_connection_close);
+    output_queue_append(out, line, len);
+}
+
+/**
+ * @brief Accoda il blocco header della risposta, chiuso dalla riga Date.
+ */
+static void queue_header(output_queue_t *out, const response_header_t *h) {
+    output_queue_append(out, h->data, h->len);
+    queue_date_line(out);
+}
+
+/**
+ * @brief Risposta testuale completa (usata per gli errori), sempre con
+ *        Content-Length così da non rompere il keep-alive.
+ */
+static void queue_simple_response(output_queue_t *out, const char *status, const char *text) {
+    response_header_t h;
+    size_t len = strlen(text);
+    header_init(&h, status);
+    header_add(&h, "Content-Type: text/plain");
+    header_add(&h, "Content-Length: %zu", len);
+    queue_header(out, &h);
+    output_queue_append(out, text, len);
 }
 
 static const char *get_mime_type(const char *path) {
@@ -44,126 +152,1178 @@ static const char *get_mime_type(const char *path) {
     return "text/plain";
 }
 
-static void zero_copy_sendfile(int out_fd, int in_fd, size_t file_size) {
-#ifdef __APPLE__
-    // macOS sendfile
-    off_t len = file_size;
-    // macOS signature: sendfile(in_fd, out_fd, offset, len, hdtr, flags)
-    // ma invertito: int sendfile(int fd, int s, off_t offset, off_t *len, struct sf_hdtr *hdtr, int flags);
-    off_t offset = 0;
-    sendfile(in_fd, out_fd, offset, &len, NULL, 0);
-#else
-    // Linux sendfile
-    off_t offset = 0;
-    ssize_t sent = sendfile(out_fd, in_fd, &offset, file_size);
-    (void)sent; // ignoriamo il valore di ritorno per semplicità
-#endif
+/**
+ * @brief ETag forte di un file, da inode, mtime e dimensione: cambia a ogni
+ *        modifica o sostituzione del file senza dover leggere il contenuto.
+ */
+static void format_etag(char *buf, size_t size, unsigned long long ino, time_t mtime, size_t file_size) {
+    snprintf(buf, size, "\"%llx-%llx-%zx\"", ino, (unsigned long long)mtime, file_size);
+}
+
+/**
+ * @brief Converte una data HTTP in formato IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT").
+ * @return true se la data è valida.
+ */
+static bool parse_http_date(const char *s, size_t len, time_t *out) {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    // Saltiamo il giorno della settimana
+    const char *comma = memchr(s, ',', len);
+    if (!comma) {
+        return false;
+    }
+    len -= (size_t)(comma + 1 - s);
+    s = comma + 1;
+    if (len < 25) {
+        return false; // " 06 Nov 1994 08:49:37 GMT"
+    }
+
+    char buf[26];
+    memcpy(buf, s, 25);
+    buf[25] = '\0';
+    int day, year, hour, min, sec;
+    char month[4];
+    if (sscanf(buf, " %2d %3s %4d %2d:%2d:%2d GMT", &day, month, &year, &hour, &min, &sec) != 6) {
+        return false;
+    }
+    const char *m = strstr(months, month);
+    if (!m || (m - months) % 3 != 0) {
+        return false;
+    }
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_mday = day;
+    tm.tm_mon = (int)((m - months) / 3);
+    tm.tm_year = year - 1900;
+    tm.tm_hour = hour;
+    tm.tm_min = min;
+    tm.tm_sec = sec;
+    *out = timegm(&tm);
+    return *out != (time_t)-1;
+}
+
+/**
+ * @brief Verifica se etag compare nella lista di If-None-Match (confronto debole,
+ *        come previsto per GET: il prefisso W/ viene ignorato).
+ */
+static bool etag_matches(const char *list, size_t len, const char *etag) {
+    size_t etag_len = strlen(etag);
+    size_t i = 0;
+    while (i < len) {
+        while (i < len && (list[i] == ' ' || list[i] == '\t' || list[i] == ',')) {
+            i++;
+        }
+        size_t start = i;
+        while (i < len && list[i] != ',') {
+            i++;
+        }
+        size_t end = i;
+        while (end > start && (list[end - 1] == ' ' || list[end - 1] == '\t')) {
+            end--;
+        }
+        if (end - start == 1 && list[start] == '*') {
+            return true;
+        }
+        if (end - start > 2 && list[start] == 'W' && list[start + 1] == '/') {
+            start += 2;
+        }
+        if (end - start == etag_len && memcmp(list + start, etag, etag_len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Valuta le precondizioni di una GET condizionale: If-None-Match ha la
+ *        precedenza, If-Modified-Since vale solo se il primo manca.
+ * @return true se il client ha già la versione attuale (risposta 304).
+ */
+static bool is_not_modified(const http_request_parser_t *parser, const char *etag, time_t mtime) {
+    size_t len;
+    const char *value = get_header_value(parser, "If-None-Match", &len);
+    if (value) {
+        return etag_matches(value, len, etag);
+    }
+    value = get_header_value(parser, "If-Modified-Since", &len);
+    time_t since;
+    if (value && parse_http_date(value, len, &since)) {
+        return mtime <= since;
+    }
+    return false;
+}
+
+/**
+ * @brief Risposta 304 senza body, con i validatori della versione attuale.
+ */
+static void queue_not_modified(output_queue_t *out, const char *etag, time_t mtime, bool vary) {
+    char date[40];
+    format_http_date(mtime, date, sizeof(date));
+
+    response_header_t h;
+    header_init(&h, "304 Not Modified");
+    header_add(&h, "Last-Modified: %s", date);
+    header_add(&h, "ETag: %s", etag);
+    header_add(&h, "Cache-Control: public, max-age=%d", CACHE_CONTROL_MAX_AGE);
+    if (vary) {
+        header_add(&h, "Vary: Accept-Encoding");
+    }
+    queue_header(out, &h);
+}
+
+/**
+ * @brief Valore di Content-Encoding per una variante.
+ */
+static const char *encoding_name(file_cache_encoding_t encoding) {
+    switch (encoding) {
+    case FILE_CACHE_GZIP: return "gzip";
+    case FILE_CACHE_BR:   return "br";
+    default:              return "identity";
+    }
+}
+
+/**
+ * @brief Costruisce gli header di un file (o di una sua variante compressa)
+ *        servito con 200, senza Date: è il blocco che viene salvato una volta
+ *        sola nella voce della cache. vary indica che il path ha più varianti.
+ */
+static void build_file_header(response_header_t *h, const char *path, size_t size, time_t mtime,
+                              const char *etag, file_cache_encoding_t encoding, bool vary) {
+    char date[40];
+    format_http_date(mtime, date, sizeof(date));
+
+    header_init(h, "200 OK");
+    header_add(h, "Content-Type: %s", get_mime_type(path));
+    if (encoding != FILE_CACHE_IDENTITY) {
+        header_add(h, "Content-Encoding: %s", encoding_name(encoding));
+    }
+    header_add(h, "Content-Length: %zu", size);
+    header_add(h, "Last-Modified: %s", date);
+    header_add(h, "ETag: %s", etag);
+    header_add(h, "Cache-Control: public, max-age=%d", CACHE_CONTROL_MAX_AGE);
+    header_add(h, "Accept-Ranges: bytes");
+    if (vary) {
+        header_add(h, "Vary: Accept-Encoding");
+    }
+}
+
+/**
+ * @brief Intervallo di byte richiesto con Range, già limitato alla dimensione del file.
+ */
+typedef struct {
+    size_t start;
+    size_t len;
+} byte_range_t;
+
+/**
+ * @brief Legge un numero decimale da s[*i], avanzando l'indice.
+ * @return true se c'era almeno una cifra e nessun overflow.
+ */
+static bool parse_range_number(const char *s, size_t len, size_t *i, size_t *out) {
+    size_t start = *i;
+    size_t value = 0;
+    while (*i < len && s[*i] >= '0' && s[*i] <= '9') {
+        size_t digit = (size_t)(s[*i] - '0');
+        if (value > (SIZE_MAX - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+        (*i)++;
+    }
+    *out = value;
+    return *i > start;
+}
+
+/**
+ * @brief If-Range: l'header Range vale solo se il validatore corrisponde alla
+ *        versione attuale (ETag con confronto forte, oppure data uguale a Last-Modified).
+ */
+static bool if_range_matches(const http_request_parser_t *parser, const char *etag, time_t mtime) {
+    size_t len;
+    const char *value = get_header_value(parser, "If-Range", &len);
+    if (!value) {
+        return true;
+    }
+    if (len > 0 && value[0] == '"') {
+        return len == strlen(etag) && memcmp(value, etag, len) == 0;
+    }
+    time_t date;
+    return parse_http_date(value, len, &date) && date == mtime;
+}
+
+/**
+ * @brief Interpreta l'header Range ("bytes=0-99,200-,-50") per un file di size byte.
+ * @return numero di intervalli soddisfacibili in ranges, 0 se la richiesta va servita
+ *         per intero (Range assente, malformato, troppi intervalli o If-Range non
+ *         valido), -1 se nessun intervallo è soddisfacibile (416).
+ */
+static int parse_ranges(const http_request_parser_t *parser, const char *etag, time_t mtime,
+                        size_t size, byte_range_t *ranges) {
+    size_t len;
+    const char *value = get_header_value(parser, "Range", &len);
+    if (!value || len < 6 || strncasecmp(value, "bytes=", 6) != 0) {
+        return 0;
+    }
+    if (!if_range_matches(parser, etag, mtime)) {
+        return 0;
+    }
+
+    int count = 0;
+    int specs = 0;
+    size_t i = 6;
+    while (i < len) {
+        while (i < len && (value[i] == ' ' || value[i] == '\t' || value[i] == ',')) {
+            i++;
+        }
+        if (i == len) {
+            break;
+        }
+        if (++specs > MAX_RANGES) {
+            return 0;
+        }
+
+        size_t first, last;
+        if (value[i] == '-') {
+            // Suffisso: gli ultimi "last" byte
+            i++;
+            if (!parse_range_number(value, len, &i, &last)) {
+                return 0;
+            }
+            if (last > 0 && size > 0) {
+                size_t n = last < size ? last : size;
+                ranges[count].start = size - n;
+                ranges[count].len = n;
+                count++;
+            }
+        } else {
+            if (!parse_range_number(value, len, &i, &first) || i == len || value[i] != '-') {
+                return 0;
+            }
+            i++;
+            if (parse_range_number(value, len, &i, &last)) {
+                if (last < first) {
+                    return 0;
+                }
+            } else {
+                last = SIZE_MAX; // "first-": fino alla fine
+            }
+            if (first < size) {
+                if (last >= size) {
+                    last = size - 1;
+                }
+                ranges[count].start = first;
+                ranges[count].len = last - first + 1;
+                count++;
+            }
+        }
+
+        while (i < len && (value[i] == ' ' || value[i] == '\t')) {
+            i++;
+        }
+        if (i < len && value[i] != ',') {
+            return 0;
+        }
+    }
+    if (specs == 0) {
+        return 0;
+    }
+    return count > 0 ? count : -1;
+}
+
+/**
+ * @brief Da dove arrivano i byte di una risposta con Range: una voce della
+ *        cache, oppure un file aperto a partire da offset (0, o la posizione
+ *        del contenuto nel bundle).
+ */
+typedef struct {
+    file_cache_entry_t *entry;
+    open_file_t *file;
+    off_t offset;
+} body_source_t;
+
+/**
+ * @brief Accoda len byte del contenuto da start, dalla voce della cache (se
+ *        presente) oppure dal file. Il chiamante conserva il proprio riferimento.
+ */
+static void queue_slice(output_queue_t *out, const body_source_t *src, size_t start, size_t len) {
+    if (src->entry) {
+        file_cache_retain(src->entry);
+        output_queue_append_cache(out, src->entry, src->entry->content + start, len);
+    } else {
+        open_file_retain(src->file);
+        output_queue_append_file(out, src->file, src->offset + (off_t)start, len);
+    }
+}
+
+/**
+ * @brief Intestazione della parte i-esima di una risposta multipart/byteranges.
+ * @return lunghezza scritta in buf.
+ */
+static size_t format_range_part(char *buf, size_t size, const char *boundary, const char *mime,
+                                const byte_range_t *range, size_t file_size) {
+    int n = snprintf(buf, size, "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %zu-%zu/%zu\r\n\r\n",
+                     boundary, mime, range->start, range->start + range->len - 1, file_size);
+    return n < 0 ? 0 : (size_t)n;
 }
 
 /**
- * @brief Serve un file statico con supporto caching e zero-copy
+ * @brief Risposta 206 multipart/byteranges: ogni intervallo è preceduto dalla
+ *        propria intestazione; le intestazioni vanno nel buffer della coda, i
+ *        dati restano nella cache o nel file.
  */
-static void serve_file(int client_fd, const char *path) {
-    char local_path[512];
+static void queue_multipart_ranges(output_queue_t *out, response_header_t *h, const char *mime,
+                                   size_t size, const byte_range_t *ranges, int count,
+                                   const body_source_t *src) {
+    // Boundary diverso per ogni risposta, per non confonderlo con il contenuto
+    static __thread unsigned long boundary_seq;
+    char boundary[48];
+    snprintf(boundary, sizeof(boundary), "byteranges-%lx-%lx", (unsigned long)time(NULL), ++boundary_seq);
+
+    // Calcoliamo prima la lunghezza totale: intestazioni delle parti + dati + chiusura
+    char part[256];
+    size_t total = (size_t)snprintf(part, sizeof(part), "\r\n--%s--\r\n", boundary);
+    for (int i = 0; i < count; i++) {
+        total += format_range_part(part, sizeof(part), boundary, mime, &ranges[i], size) + ranges[i].len;
+    }
+    header_add(h, "Content-Type: multipart/byteranges; boundary=%s", boundary);
+    header_add(h, "Content-Length: %zu", total);
+    queue_header(out, h);
+
+    for (int i = 0; i < count; i++) {
+        size_t n = format_range_part(part, sizeof(part), boundary, mime, &ranges[i], size);
+        output_queue_append(out, part, n);
+        queue_slice(out, src, ranges[i].start, ranges[i].len);
+    }
+    int n = snprintf(part, sizeof(part), "\r\n--%s--\r\n", boundary);
+    output_queue_append(out, part, (size_t)n);
+}
+
+/**
+ * @brief Risposta a una richiesta Range: 416 se count < 0, altrimenti 206 con
+ *        un solo intervallo o multipart/byteranges. I dati arrivano da src
+ *        (voce della cache o file) a partire dagli offset richiesti, quindi si
+ *        invia solo quello che serve; encoding è la codifica del contenuto.
+ * @return status HTTP della risposta (206 o 416).
+ */
+static int queue_range_response(output_queue_t *out, const char *path, const char *etag, time_t mtime,
+                                 size_t size, const byte_range_t *ranges, int count,
+                                 const body_source_t *src, file_cache_encoding_t encoding, bool vary) {
+    response_header_t h;
+    if (count < 0) {
+        header_init(&h, "416 Range Not Satisfiable");
+        header_add(&h, "Content-Range: bytes */%zu", size);
+        header_add(&h, "Content-Length: 0");
+        queue_header(out, &h);
+        return 416;
+    }
+
+    char date[40];
+    format_http_date(mtime, date, sizeof(date));
+    const char *mime = get_mime_type(path);
+
+    header_init(&h, "206 Partial Content");
+    header_add(&h, "Last-Modified: %s", date);
+    header_add(&h, "ETag: %s", etag);
+    header_add(&h, "Cache-Control: public, max-age=%d", CACHE_CONTROL_MAX_AGE);
+    if (encoding != FILE_CACHE_IDENTITY) {
+        header_add(&h, "Content-Encoding: %s", encoding_name(encoding));
+    }
+    if (vary) {
+        header_add(&h, "Vary: Accept-Encoding");
+    }
+    if (count > 1) {
+        queue_multipart_ranges(out, &h, mime, size, ranges, count, src);
+        return 206;
+    }
+    header_add(&h, "Content-Type: %s", mime);
+    header_add(&h, "Content-Length: %zu", ranges[0].len);
+    header_add(&h, "Content-Range: bytes %zu-%zu/%zu",
+               ranges[0].start, ranges[0].start + ranges[0].len - 1, size);
+    queue_header(out, &h);
+    queue_slice(out, src, ranges[0].start, ranges[0].len);
+    return 206;
+}
+
+/**
+ * @brief ETag di una voce della cache: quello calcolato all'inserimento oppure,
+ *        per le voci inserite senza (file_cache_put), uno ricavato da mtime e dimensione.
+ */
+static const char *entry_etag(const file_cache_entry_t *entry, char *buf, size_t size) {
+    if (entry->etag[0] != '\0') {
+        return entry->etag;
+    }
+    format_etag(buf, size, 0, entry->last_modified, entry->size);
+    return buf;
+}
+
+/**
+ * @brief Accoda la risposta per una voce della cache, senza copie: l'header
+ *        precalcolato e il contenuto restano nella regione condivisa fino all'invio.
+ *        Se la richiesta è condizionale e il client ha già questa versione, 304;
+ *        se chiede solo alcuni intervalli (Range), 206 con le sole porzioni richieste.
+ *        La coda prende il riferimento del chiamante alla voce.
+ * @return status HTTP della risposta.
+ */
+static int queue_cached_entry(output_queue_t *out, const http_request_parser_t *parser,
+                               file_cache_entry_t *entry, const char *path, bool vary) {
+    char etag_buf[FILE_CACHE_ETAG_MAX];
+    const char *etag = entry_etag(entry, etag_buf, sizeof(etag_buf));
+    if (is_not_modified(parser, etag, entry->last_modified)) {
+        queue_not_modified(out, etag, entry->last_modified, vary);
+        file_cache_release(&g_file_cache, entry);
+        return 304;
+    }
+
+    byte_range_t ranges[MAX_RANGES];
+    int count = parse_ranges(parser, etag, entry->last_modified, entry->size, ranges);
+    if (count != 0) {
+        body_source_t src = { entry, NULL, 0 };
+        int status = queue_range_response(out, path, etag, entry->last_modified, entry->size, ranges, count,
+                                          &src, (file_cache_encoding_t)entry->encoding, vary);
+        file_cache_release(&g_file_cache, entry);
+        return status;
+    }
+
+    if (entry->header) {
+        file_cache_retain(entry);
+        output_queue_append_cache(out, entry, entry->header, entry->header_len);
+        queue_date_line(out);
+    } else {
+        // Voce inserita senza header (file_cache_put): lo costruiamo al volo
+        response_header_t h;
+        build_file_header(&h, path, entry->size, entry->last_modified, etag,
+                          (file_cache_encoding_t)entry->encoding, vary);
+        queue_header(out, &h);
+    }
+    output_queue_append_cache(out, entry, entry->content, entry->size);
+    return 200;
+}
+
+/**
+ * @brief Legge esattamente len byte dal file (da offset 0) in buf.
+ * @return true se ok, false se il file è più corto o in caso di errore.
+ */
+static bool read_whole_file(int fd, char *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, buf + done, len - done, (off_t)done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += (size_t)n;
+    }
+    return true;
+}
+
+/**
+ * @brief true se conviene comprimere al volo i file di questo tipo (testo).
+ */
+static bool is_compressible(const char *path) {
+    const char *mime = get_mime_type(path);
+    return strncmp(mime, "text/", 5) == 0 || strcmp(mime, "application/javascript") == 0;
+}
+
+/**
+ * @brief Varianti codificate disponibili per un file, calcolate una sola volta
+ *        quando la sua versione identità entra in cache: fratelli precompressi
+ *        (path.gz, path.br) oppure gzip generato con zlib per i file di testo.
+ * @return maschera di bit (1 << file_cache_encoding_t).
+ */
+static uint8_t probe_variants(const char *path, size_t size) {
+    char sibling[LOCAL_PATH_MAX + 4];
+    struct stat st;
+    uint8_t mask = 0;
+
+    snprintf(sibling, sizeof(sibling), "%s.gz", path);
+    if ((stat(sibling, &st) == 0 && S_ISREG(st.st_mode)) ||
+        (is_compressible(path) && size >= GZIP_MIN_SIZE)) {
+        mask |= 1u << FILE_CACHE_GZIP;
+    }
+    snprintf(sibling, sizeof(sibling), "%s.br", path);
+    if (stat(sibling, &st) == 0 && S_ISREG(st.st_mode)) {
+        mask |= 1u << FILE_CACHE_BR;
+    }
+    return mask;
+}
+
+/**
+ * @brief Legge un q-value ("1", "0.8", "0.125") in millesimi.
+ */
+static int parse_qvalue(const char *s, size_t len) {
+    size_t i = 0;
+    if (i == len || (s[i] != '0' && s[i] != '1')) {
+        return -1;
+    }
+    int q = (s[i++] - '0') * 1000;
+    if (i < len && s[i] == '.') {
+        i++;
+        for (int scale = 100; scale > 0 && i < len && s[i] >= '0' && s[i] <= '9'; scale /= 10) {
+            q += (s[i++] - '0') * scale;
+        }
+    }
+    return q > 1000 ? 1000 : q;
+}
+
+/**
+ * @brief Sceglie la codifica della risposta tra quelle disponibili (mask) in
+ *        base ai q-value di Accept-Encoding. A parità di peso preferisce br, poi
+ *        gzip, poi identità; identità resta accettabile salvo "identity;q=0"
+ *        (o "*;q=0" senza identity).
+ */
+static file_cache_encoding_t choose_encoding(const http_request_parser_t *parser, uint8_t mask) {
+    size_t len;
+    const char *value = get_header_value(parser, "Accept-Encoding", &len);
+    if (!value) {
+        return FILE_CACHE_IDENTITY;
+    }
+
+    int q[FILE_CACHE_ENCODINGS] = { -1, -1, -1 };
+    int q_star = -1;
+    size_t i = 0;
+    while (i < len) {
+        while (i < len && (value[i] == ' ' || value[i] == '\t' || value[i] == ',')) {
+            i++;
+        }
+        size_t start = i;
+        while (i < len && value[i] != ',' && value[i] != ';' && value[i] != ' ' && value[i] != '\t') {
+            i++;
+        }
+        size_t name_len = i - start;
+        if (name_len == 0) {
+            break;
+        }
+
+        // Parametri: ci interessa solo q
+        int weight = 1000;
+        while (i < len && value[i] != ',') {
+            if ((value[i] == 'q' || value[i] == 'Q') && i + 1 < len && value[i + 1] == '=' &&
+                (value[i - 1] == ';' || value[i - 1] == ' ' || value[i - 1] == '\t')) {
+                size_t vstart = i + 2;
+                size_t vend = vstart;
+                while (vend < len && value[vend] != ',' && value[vend] != ';' && value[vend] != ' ') {
+                    vend++;
+                }
+                weight = parse_qvalue(value + vstart, vend - vstart);
+                i = vend;
+                continue;
+            }
+            i++;
+        }
+        if (weight < 0) {
+            continue; // q-value malformato: ignoriamo la voce
+        }
+
+        const char *name = value + start;
+        if ((name_len == 4 && strncasecmp(name, "gzip", 4) == 0) ||
+            (name_len == 6 && strncasecmp(name, "x-gzip", 6) == 0)) {
+            q[FILE_CACHE_GZIP] = weight;
+        } else if (name_len == 2 && strncasecmp(name, "br", 2) == 0) {
+            q[FILE_CACHE_BR] = weight;
+        } else if (name_len == 8 && strncasecmp(name, "identity", 8) == 0) {
+            q[FILE_CACHE_IDENTITY] = weight;
+        } else if (name_len == 1 && name[0] == '*') {
+            q_star = weight;
+        }
+    }
+
+    file_cache_encoding_t best = FILE_CACHE_IDENTITY;
+    int best_q = q[FILE_CACHE_IDENTITY] >= 0 ? q[FILE_CACHE_IDENTITY] : (q_star >= 0 ? q_star : 1000);
+    static const file_cache_encoding_t preference[] = { FILE_CACHE_BR, FILE_CACHE_GZIP };
+    for (size_t k = 0; k < sizeof(preference) / sizeof(preference[0]); k++) {
+        file_cache_encoding_t enc = preference[k];
+        int weight = q[enc] >= 0 ? q[enc] : (q_star >= 0 ? q_star : 0);
+        if (!(mask & (1u << enc)) || weight <= 0) {
+            continue;
+        }
+        if (weight > best_q || (best == FILE_CACHE_IDENTITY && weight == best_q)) {
+            best = enc;
+            best_q = weight;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Comprime data in formato gzip con zlib al livello indicato
+ *        (GZIP_LEVEL_REQUEST o GZIP_LEVEL_OFFLINE).
+ * @return buffer allocato con malloc() (lunghezza in out_len), oppure NULL.
+ */
+static char *gzip_compress(const char *data, size_t len, int level, size_t *out_len) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // windowBits 15 + 16: intestazione e trailer gzip invece di zlib
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+    size_t bound = deflateBound(&zs, (uLong)len);
+    char *buf = (char *)malloc(bound);
+    if (!buf) {
+        deflateEnd(&zs);
+        return NULL;
+    }
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = (uInt)len;
+    zs.next_out = (Bytef *)buf;
+    zs.avail_out = (uInt)bound;
+    int rc = deflate(&zs, Z_FINISH);
+    *out_len = zs.total_out;
+    deflateEnd(&zs);
+    if (rc != Z_STREAM_END) {
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+/**
+ * @brief Completa e pubblica una variante preparata con file_cache_reserve().
+ * @return la voce (con il riferimento del chiamante) oppure NULL.
+ */
+static file_cache_entry_t *publish_variant(file_cache_entry_t *variant, const char *path,
+                                           const char *etag, time_t mtime) {
+    response_header_t h;
+    snprintf(variant->etag, sizeof(variant->etag), "%s", etag);
+    build_file_header(&h, path, variant->size, mtime, variant->etag,
+                      (file_cache_encoding_t)variant->encoding, true);
+    file_cache_set_header(&g_file_cache, variant, h.data, h.len);
+    file_cache_commit(&g_file_cache, variant, mtime);
+    return variant;
+}
+
+/**
+ * @brief Crea la variante encoding di un file già in cache (identity): dal
+ *        fratello precompresso se esiste, altrimenti comprimendo il contenuto
+ *        (solo gzip, al livello level). Succede solo al primo uso; se la
+ *        variante non può esistere (niente fratello, oppure gzip non riduce
+ *        il file) la togliamo da quelle disponibili, così non ci si riprova a
+ *        ogni richiesta. Se manca solo lo spazio in cache si riproverà.
+ * @return la variante con un riferimento, oppure NULL.
+ */
+static file_cache_entry_t *create_variant(file_cache_entry_t *identity, const char *path,
+                                          file_cache_encoding_t encoding, int level) {
+    char sibling[LOCAL_PATH_MAX + 4];
+    snprintf(sibling, sizeof(sibling), "%s.%s", path, encoding == FILE_CACHE_GZIP ? "gz" : "br");
+    file_cache_entry_t *variant = NULL;
+    bool unavailable = false;
+
+    int fd = open(sibling, O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        variant = file_cache_reserve(&g_file_cache, path, encoding, (size_t)st.st_size);
+        if (variant && read_whole_file(fd, variant->content, variant->size) &&
+            file_cache_set_source(&g_file_cache, variant, sibling, (size_t)st.st_size)) {
+            char etag[FILE_CACHE_ETAG_MAX];
+            format_etag(etag, sizeof(etag), (unsigned long long)st.st_ino, st.st_mtime, (size_t)st.st_size);
+            variant = publish_variant(variant, path, etag, st.st_mtime);
+        } else {
+            file_cache_release(&g_file_cache, variant);
+            variant = NULL;
+        }
+    } else if (encoding == FILE_CACHE_GZIP) {
+        size_t zlen;
+        char *zdata = gzip_compress(identity->content, identity->size, level, &zlen);
+        unavailable = zdata && zlen >= identity->size;
+        if (zdata && zlen < identity->size) {
+            variant = file_cache_reserve(&g_file_cache, path, encoding, zlen);
+            if (variant) {
+                memcpy(variant->content, zdata, zlen);
+                // Deriva da path stesso: basta confrontare la dimensione dell'originale
+                variant->source_size = identity->size;
+
+                // ETag distinto da quello dell'identità: "...-gz"
+                char etag_buf[FILE_CACHE_ETAG_MAX];
+                const char *base = entry_etag(identity, etag_buf, sizeof(etag_buf));
+                char etag[FILE_CACHE_ETAG_MAX + 4];
+                snprintf(etag, sizeof(etag), "%.*s-gz\"", (int)strlen(base) - 1, base);
+                variant = publish_variant(variant, path, etag, identity->last_modified);
+            }
+        }
+        free(zdata);
+    } else {
+        unavailable = true; // il fratello precompresso non c'è più
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    if (unavailable) {
+        atomic_fetch_and(&identity->variants, (unsigned char)~(1u << encoding));
+    }
+    return variant;
+}
+
+/**
+ * @brief Serve una voce identità della cache, scegliendo se possibile la
+ *        variante compressa accettata dal client. La variante viene creata
+ *        al primo uso e poi servita dalla cache come un hit qualsiasi.
+ *        La crea un solo thread alla volta (di qualunque worker): chi trova
+ *        il bit FILE_CACHE_VARIANT_BUILDING già preso serve l'identità invece
+ *        di comprimere di nuovo lo stesso file. La coda prende il riferimento
+ *        del chiamante alla voce.
+ * @return status HTTP della risposta.
+ */
+static int serve_cached(output_queue_t *out, const http_request_parser_t *parser,
+                         file_cache_entry_t *entry, const char *path) {
+    uint8_t variants = atomic_load_explicit(&entry->variants, memory_order_relaxed) & FILE_CACHE_VARIANTS_MASK;
+    if (variants != 0) {
+        file_cache_encoding_t encoding = choose_encoding(parser, variants);
+        if (encoding != FILE_CACHE_IDENTITY) {
+            file_cache_entry_t *variant = file_cache_get(&g_file_cache, path, encoding);
+            unsigned char building = (unsigned char)FILE_CACHE_VARIANT_BUILDING(encoding);
+            if (!variant && !(atomic_fetch_or(&entry->variants, building) & building)) {
+                // Nel frattempo potrebbe averla pubblicata chi aveva il bit
+                variant = file_cache_get(&g_file_cache, path, encoding);
+                if (!variant) {
+                    variant = create_variant(entry, path, encoding, GZIP_LEVEL_REQUEST);
+                }
+                atomic_fetch_and(&entry->variants, (unsigned char)~building);
+            }
+            if (variant) {
+                file_cache_release(&g_file_cache, entry);
+                entry = variant;
+            }
+        }
+    }
+    return queue_cached_entry(out, parser, entry, path, variants != 0);
+}
+
+/**
+ * @brief Legge il file nella voce preparata con file_cache_reserve() e la
+ *        pubblica con l'header precalcolato h e le varianti disponibili.
+ * @return true se la voce è ora in cache (il riferimento resta al chiamante).
+ */
+static bool fill_entry(file_cache_entry_t *entry, int fd, const response_header_t *h,
+                       const char *etag, time_t mtime, uint8_t variants) {
+    if (!read_whole_file(fd, entry->content, entry->size)) {
+        return false;
+    }
+    snprintf(entry->etag, sizeof(entry->etag), "%s", etag);
+    atomic_store_explicit(&entry->variants, variants, memory_order_relaxed);
+    file_cache_set_header(&g_file_cache, entry, h->data, h->len);
+    return file_cache_commit(&g_file_cache, entry, mtime);
+}
+
+/**
+ * @brief Accoda la risposta per un file statico, servito dalla cache (zero-copy
+ *        dal memfd se abilitato) oppure, se non memorizzabile, direttamente dal file.
+ * @param size dimensione del file (0 se non trovato).
+ * @return status HTTP della risposta.
+ */
+static int queue_file_response(output_queue_t *out, const http_request_parser_t *parser,
+                               const char *local_path, size_t *size) {
+    // Controllo in cache
+    file_cache_entry_t *cached = file_cache_get(&g_file_cache, local_path, FILE_CACHE_IDENTITY);
+    if (cached) {
+        if (g_verbose) {
+            printf("[response] Cache hit per %s\n", local_path);
+        }
+        *size = cached->size;
+        return serve_cached(out, parser, cached, local_path);
+    }
+
+    // Se non in cache, il file aperto (o il "non trovato") arriva dalla cache
+    // dei file aperti del worker: nessuna open()/fstat() se già noto
+    open_file_t *file = open_file_get(&g_open_files, local_path, file_cache_generation(&g_file_cache));
+    if (!file || file->fd < 0) {
+        // 404
+        open_file_release(file);
+        queue_simple_response(out, "404 Not Found", "File not found.\r\n");
+        return 404;
+    }
+    *size = file->size;
+
+    char etag[FILE_CACHE_ETAG_MAX];
+    format_etag(etag, sizeof(etag), (unsigned long long)file->ino, file->mtime, file->size);
+
+    // Vary dipende solo dalle varianti sul disco, non dal posto in cache
+    uint8_t variants = probe_variants(local_path, file->size);
+    if (is_not_modified(parser, etag, file->mtime)) {
+        // Il client ha già il file: niente lettura né spazio in cache (e
+        // quindi nessuna evizione per una risposta senza corpo)
+        queue_not_modified(out, etag, file->mtime, variants != 0);
+        open_file_release(file);
+        return 304;
+    }
+
+    // Proviamo a leggere il file direttamente in una voce della cache (unica
+    // lettura da disco), insieme all'header precalcolato e alle varianti
+    // disponibili, poi lo serviamo da lì come un hit
+    file_cache_entry_t *entry = file_cache_reserve(&g_file_cache, local_path, FILE_CACHE_IDENTITY, file->size);
+
+    response_header_t h;
+    build_file_header(&h, local_path, file->size, file->mtime, etag, FILE_CACHE_IDENTITY, variants != 0);
+
+    if (entry && fill_entry(entry, file->fd, &h, etag, file->mtime, variants)) {
+        open_file_release(file);
+        return serve_cached(out, parser, entry, local_path);
+    }
+
+    // File non memorizzabile: lo inviamo dal file (sendfile se abilitato zero-copy),
+    // sempre senza compressione
+    file_cache_release(&g_file_cache, entry);
+    byte_range_t ranges[MAX_RANGES];
+    int count = parse_ranges(parser, etag, file->mtime, file->size, ranges);
+    if (count != 0) {
+        body_source_t src = { NULL, file, 0 };
+        int status = queue_range_response(out, local_path, etag, file->mtime, file->size, ranges, count,
+                                          &src, FILE_CACHE_IDENTITY, false);
+        open_file_release(file);
+        return status;
+    }
+    queue_header(out, &h);
+    output_queue_append_file(out, file, 0, file->size);
+    return 200;
+}
+
+/**
+ * @brief Accoda la risposta per path dal bundle (--bundle): un lookup nella
+ *        hash perfetta, header precalcolato e contenuto inviato dalla mappa o
+ *        con sendfile() dal file del bundle. Nessuna syscall sul filesystem.
+ * @param size dimensione del file (0 se non trovato).
+ * @return status HTTP della risposta.
+ */
+static int queue_bundle_response(output_queue_t *out, const http_request_parser_t *parser,
+                                 const char *path, size_t *size) {
+    const char *key = strcmp(path, "/") == 0 ? "/index.html" : path;
+    const bundle_entry_t *e = bundle_find(&g_bundle, key, strlen(key));
+    if (!e) {
+        queue_simple_response(out, "404 Not Found", "File not found.\r\n");
+        return 404;
+    }
+    *size = e->data[FILE_CACHE_IDENTITY].len;
+
+    file_cache_encoding_t encoding = e->variants ? choose_encoding(parser, (uint8_t)e->variants) : FILE_CACHE_IDENTITY;
+    const bundle_variant_t *v = &e->data[encoding];
+    time_t mtime = (time_t)e->mtime;
+    bool vary = e->variants != 0;
+    if (is_not_modified(parser, v->etag, mtime)) {
+        queue_not_modified(out, v->etag, mtime, vary);
+        return 304;
+    }
+
+    byte_range_t ranges[MAX_RANGES];
+    int count = parse_ranges(parser, v->etag, mtime, v->len, ranges);
+    if (count != 0) {
+        body_source_t src = { NULL, g_bundle.file, (off_t)v->offset };
+        return queue_range_response(out, key, v->etag, mtime, v->len, ranges, count, &src, encoding, vary);
+    }
+
+    output_queue_append(out, bundle_data(&g_bundle, v->header), v->header_len);
+    queue_date_line(out);
+    open_file_retain(g_bundle.file);
+    output_queue_append_file(out, g_bundle.file, (off_t)v->offset, v->len);
+    return 200;
+}
+
+/**
+ * @brief Riduce in place il path della richiesta alla forma canonica: niente
+ *        "//", niente segmenti "." e ".." risolti senza salire oltre la radice
+ *        (solo testo, nessuna syscall). Così gli alias dello stesso file
+ *        ("/a//b", "/a/./b", "/x/../a/b") usano le stesse voci delle cache.
+ *        I path che non iniziano con '/' restano come sono.
+ */
+static void normalize_path(char *path) {
+    if (path[0] != '/') {
+        return;
+    }
+    size_t in_len = strlen(path);
+    bool trailing = in_len > 1 && path[in_len - 1] == '/';
+    char *out = path;
+    const char *p = path;
+    while (*p) {
+        while (*p == '/') {
+            p++;
+        }
+        const char *seg = p;
+        while (*p && *p != '/') {
+            p++;
+        }
+        size_t len = (size_t)(p - seg);
+        if (len == 0 || (len == 1 && seg[0] == '.')) {
+            continue;
+        }
+        if (len == 2 && seg[0] == '.' && seg[1] == '.') {
+            while (out > path && *--out != '/') {
+            }
+            continue;
+        }
+        *out++ = '/';
+        memmove(out, seg, len); // out non supera mai seg
+        out += len;
+    }
+    if (out == path || trailing) {
+        *out++ = '/';
+    }
+    *out = '\0';
+}
+
+/**
+ * @brief Serve un file statico e registra la risposta nel log delle performance.
+ */
+static void serve_file(output_queue_t *out, const http_request_parser_t *parser, char *path) {
+    char local_path[LOCAL_PATH_MAX];
+    normalize_path(path);
     if (strcmp(path, "/") == 0) {
-        snprintf(local_path, sizeof(local_path), "docs/index.html");
+        snprintf(local_path, sizeof(local_path), DOCUMENT_ROOT "/index.html");
     } else {
-        snprintf(local_path, sizeof(local_path), "docs%s", path);
+        snprintf(local_path, sizeof(local_path), DOCUMENT_ROOT "%s", path);
     }
 
     // Inizia la misura del tempo
     struct timespec start_time, end_time;
     clock_gettime(CLOCK_MONOTONIC, &start_time);
 
-    // Controllo in cache
-    file_cache_entry_t *cached = file_cache_get(&g_file_cache, local_path);
-    if (cached) {
-        // Inviamo l’header
-        send_data(client_fd, "HTTP/1.1 200 OK\r\n");
-        char ctype[128];
-        snprintf(ctype, sizeof(ctype), "Content-Type: %s\r\n", get_mime_type(local_path));
-        send_data(client_fd, ctype);
-
-        char clength[128];
-        snprintf(clength, sizeof(clength), "Content-Length: %zu\r\n", cached->size);
-        send_data(client_fd, clength);
-
-        send_data(client_fd, "\r\n"); // fine header
-
-        // Inviamo il contenuto (per semplicità qui con write, zero-copy da memoria non è banale)
-        write(client_fd, cached->content, cached->size);
-
-        // Log performance
-        clock_gettime(CLOCK_MONOTONIC, &end_time);
-        double elapsed = (end_time.tv_sec - start_time.tv_sec)
-                         + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
-        performance_log_record(local_path, cached->size, elapsed);
-        return;
+    size_t size = 0;
+    size_t queued = output_queue_bytes(out);
+    int status = g_bundle.file ? queue_bundle_response(out, parser, path, &size)
+                               : queue_file_response(out, parser, local_path, &size);
+
+    // Log performance (solo un record nel ring del thread) e istogrammi
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    uint64_t elapsed_ns = (uint64_t)(end_time.tv_sec - start_time.tv_sec) * 1000000000ull
+                          + (uint64_t)end_time.tv_nsec - (uint64_t)start_time.tv_nsec;
+    performance_log_record(local_path, size, status, elapsed_ns);
+    metrics_record(status, output_queue_bytes(out) - queued, size, elapsed_ns);
+}
+
+size_t http_preload_file(const char *local_path, bool pin) {
+    int fd = open(local_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return 0;
+    }
+    size_t size = (size_t)st.st_size;
+    file_cache_entry_t *entry = file_cache_reserve(&g_file_cache, local_path, FILE_CACHE_IDENTITY, size);
+    if (!entry) {
+        close(fd);
+        return 0;
+    }
+
+    // Stessa voce che produrrebbe il primo miss: ETag, header e varianti
+    char etag[FILE_CACHE_ETAG_MAX];
+    format_etag(etag, sizeof(etag), (unsigned long long)st.st_ino, st.st_mtime, size);
+    uint8_t variants = probe_variants(local_path, size);
+    response_header_t h;
+    build_file_header(&h, local_path, size, st.st_mtime, etag, FILE_CACHE_IDENTITY, variants != 0);
+    bool loaded = fill_entry(entry, fd, &h, etag, st.st_mtime, variants);
+    close(fd);
+
+    size_t bytes = 0;
+    if (loaded) {
+        // Anche le varianti compresse, così nessun worker comprime al primo accesso
+        bytes = size;
+        for (int enc = FILE_CACHE_IDENTITY + 1; enc < FILE_CACHE_ENCODINGS; enc++) {
+            if (variants & (1u << enc)) {
+                file_cache_entry_t *variant = create_variant(entry, local_path, (file_cache_encoding_t)enc,
+                                                             GZIP_LEVEL_OFFLINE);
+                if (variant) {
+                    bytes += variant->size;
+                    file_cache_release(&g_file_cache, variant);
+                }
+            }
+        }
+        if (pin) {
+            file_cache_pin(&g_file_cache, local_path);
+        }
     }
+    file_cache_release(&g_file_cache, entry);
+    return bytes;
+}
 
-    // Se non in cache, apriamo il file
-    int fd = open(local_path, O_RDONLY);
+/**
+ * @brief Legge tutto il file path in memoria.
+ * @return contenuto (da liberare con free()), oppure NULL se non è un file regolare leggibile.
+ */
+static char *load_file(const char *path, struct stat *st) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
     if (fd < 0) {
-        // 404
-        send_data(client_fd, "HTTP/1.1 404 Not Found\r\n");
-        send_data(client_fd, "Content-Type: text/plain\r\n\r\n");
-        send_data(client_fd, "File not found.\r\n");
-        return;
+        return NULL;
+    }
+    char *data = NULL;
+    if (fstat(fd, st) == 0 && S_ISREG(st->st_mode)) {
+        data = (char *)malloc((size_t)st->st_size + 1);
+        if (data && !read_whole_file(fd, data, (size_t)st->st_size)) {
+            free(data);
+            data = NULL;
+        }
     }
+    close(fd);
+    return data;
+}
 
-    // Stat per dimensione e last-modified
+/**
+ * @brief Aggiunge al bundle il file local_path, servito come url, con le
+ *        stesse varianti e gli stessi header che avrebbe in cache.
+ * @return 0 se ok, -1 in caso di errore.
+ */
+static int pack_file(bundle_writer_t *w, const char *local_path, const char *url) {
     struct stat st;
-    fstat(fd, &st);
+    char *content = load_file(local_path, &st);
+    if (!content) {
+        fprintf(stderr, "[pack] Impossibile leggere %s\n", local_path);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
 
-    send_data(client_fd, "HTTP/1.1 200 OK\r\n");
-    char content_type_header[128];
-    snprintf(content_type_header, sizeof(content_type_header),
-             "Content-Type: %s\r\n", get_mime_type(local_path));
-    send_data(client_fd, content_type_header);
+    char *data[FILE_CACHE_ENCODINGS] = { content, NULL, NULL };
+    size_t len[FILE_CACHE_ENCODINGS] = { size, 0, 0 };
+    char etag[FILE_CACHE_ENCODINGS][FILE_CACHE_ETAG_MAX + 4];
+    format_etag(etag[FILE_CACHE_IDENTITY], FILE_CACHE_ETAG_MAX, (unsigned long long)st.st_ino, st.st_mtime, size);
 
-    char content_length_header[128];
-    snprintf(content_length_header, sizeof(content_length_header),
-         "Content-Length: %lld\r\n", (long long)st.st_size);
-    send_data(client_fd, content_length_header);
+    // Fratelli precompressi, altrimenti gzip generato per i file di testo
+    uint8_t mask = probe_variants(local_path, size);
+    for (int enc = FILE_CACHE_IDENTITY + 1; enc < FILE_CACHE_ENCODINGS; enc++) {
+        if (!(mask & (1u << enc))) {
+            continue;
+        }
+        char sibling[LOCAL_PATH_MAX + 4];
+        struct stat sst;
+        snprintf(sibling, sizeof(sibling), "%s.%s", local_path, enc == FILE_CACHE_GZIP ? "gz" : "br");
+        data[enc] = load_file(sibling, &sst);
+        if (data[enc]) {
+            len[enc] = (size_t)sst.st_size;
+            format_etag(etag[enc], FILE_CACHE_ETAG_MAX, (unsigned long long)sst.st_ino, sst.st_mtime, len[enc]);
+        } else if (enc == FILE_CACHE_GZIP) {
+            data[enc] = gzip_compress(content, size, GZIP_LEVEL_OFFLINE, &len[enc]);
+            if (data[enc] && len[enc] >= size) {
+                free(data[enc]);
+                data[enc] = NULL;
+            }
+            snprintf(etag[enc], sizeof(etag[enc]), "%.*s-gz\"", (int)strlen(etag[0]) - 1, etag[0]);
+        }
+        if (!data[enc]) {
+            mask &= (uint8_t)~(1u << enc);
+        }
+    }
 
-    send_data(client_fd, "\r\n"); // fine header
+    response_header_t h[FILE_CACHE_ENCODINGS];
+    bundle_source_t variants[FILE_CACHE_ENCODINGS];
+    memset(variants, 0, sizeof(variants));
+    for (int enc = 0; enc < FILE_CACHE_ENCODINGS; enc++) {
+        if (!data[enc]) {
+            continue;
+        }
+        build_file_header(&h[enc], local_path, len[enc], st.st_mtime, etag[enc],
+                          (file_cache_encoding_t)enc, mask != 0);
+        variants[enc].data = data[enc];
+        variants[enc].len = len[enc];
+        variants[enc].header = h[enc].data;
+        variants[enc].header_len = h[enc].len;
+        variants[enc].etag = etag[enc];
+    }
+    int rc = bundle_writer_add(w, url, st.st_mtime, variants);
+    for (int enc = 0; enc < FILE_CACHE_ENCODINGS; enc++) {
+        free(data[enc]);
+    }
+    return rc;
+}
 
-    // Se abilitato zero-copy, usiamo sendfile
-    if (g_enable_zerocopy) {
-        zero_copy_sendfile(client_fd, fd, st.st_size);
-    } else {
-        // Fall-back a lettura e write manuale
-        char file_buffer[4096];
-        ssize_t bytes_read;
-        while ((bytes_read = read(fd, file_buffer, sizeof(file_buffer))) > 0) {
-            write(client_fd, file_buffer, bytes_read);
+/**
+ * @brief Aggiunge al bundle i file di dir (ricorsivamente); url_base è il
+ *        prefisso URL corrispondente a dir.
+ * @return 0 se ok, -1 al primo errore.
+ */
+static int pack_tree(bundle_writer_t *w, const char *dir, const char *url_base) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        fprintf(stderr, "[pack] Impossibile aprire %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    int rc = 0;
+    struct dirent *de;
+    while (rc == 0 && (de = readdir(d)) != NULL) {
+        size_t name_len = strlen(de->d_name);
+        if (de->d_name[0] == '.') {
+            continue; // ".", ".." e file nascosti
+        }
+        char local_path[LOCAL_PATH_MAX];
+        char url[LOCAL_PATH_MAX];
+        struct stat st;
+        snprintf(local_path, sizeof(local_path), "%s/%s", dir, de->d_name);
+        snprintf(url, sizeof(url), "%s/%s", url_base, de->d_name);
+        if (stat(local_path, &st) < 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            rc = pack_tree(w, local_path, url);
+        } else if (S_ISREG(st.st_mode) &&
+                   !(name_len > 3 && (strcmp(de->d_name + name_len - 3, ".gz") == 0 ||
+                                      strcmp(de->d_name + name_len - 3, ".br") == 0))) {
+            // I fratelli precompressi entrano come varianti dell'originale
+            rc = pack_file(w, local_path, url);
         }
     }
+    closedir(d);
+    return rc;
+}
 
-    // Memorizziamo in cache (attenzione alla memoria su file di grandi dimensioni!)
-    lseek(fd, 0, SEEK_SET);
-    char *content_buf = (char*)malloc(st.st_size);
-    if (content_buf) {
-        read(fd, content_buf, st.st_size);
-        file_cache_put(&g_file_cache, local_path, content_buf, st.st_size, st.st_mtime);
-        free(content_buf);
+long http_pack_docroot(const char *docroot, const char *out_path) {
+    bundle_writer_t *w = bundle_writer_create(out_path);
+    if (!w) {
+        return -1;
+    }
+    if (pack_tree(w, docroot, "") < 0) {
+        bundle_writer_abort(w);
+        return -1;
     }
+    return bundle_writer_finish(w);
+}
 
-    close(fd);
+/**
+ * @brief Risponde su METRICS_PATH con le metriche aggregate di tutti i worker.
+ */
+static void serve_metrics(output_queue_t *out) {
+    // La dimensione dipende dal numero di worker: se il buffer non basta si
+    // riprova con quella richiesta (più un margine, i contatori crescono)
+    char *body = NULL;
+    size_t size = METRICS_BODY_INITIAL;
+    size_t len;
+    while (1) {
+        char *tmp = (char *)realloc(body, size);
+        if (!tmp) {
+            free(body);
+            queue_simple_response(out, "500 Internal Server Error", "Internal Server Error\r\n");
+            return;
+        }
+        body = tmp;
+        len = metrics_format(body, size);
+        if (len < size) {
+            break;
+        }
+        size = len + len / 8 + 1;
+    }
 
-    // Log performance
-    clock_gettime(CLOCK_MONOTONIC, &end_time);
-    double elapsed = (end_time.tv_sec - start_time.tv_sec)
-                     + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
-    performance_log_record(local_path, st.st_size, elapsed);
+    response_header_t h;
+    header_init(&h, "200 OK");
+    header_add(&h, "Content-Type: text/plain; version=0.0.4");
+    header_add(&h, "Content-Length: %zu", len);
+    header_add(&h, "Cache-Control: no-store");
+    queue_header(out, &h);
+    output_queue_append(out, body, len);
+    free(body);
 }
 
-void handle_http_request(int client_fd, http_request_parser_t *parser) {
-    if (strcmp(parser->method, "GET") == 0) {
-        serve_file(client_fd, parser->path);
+void handle_http_request(output_queue_t *out, http_request_parser_t *parser, bool last) {
+    t_connection_close = last;
+    if (http_span_equals(parser, parser->method, "GET")) {
+        char path[MAX_PATH_LEN];
+        if (!http_span_copy(parser, parser->path, path, sizeof(path))) {
+            queue_simple_response(out, "414 URI Too Long", "URI Too Long\r\n");
+            return;
+        }
+        if (strcmp(path, METRICS_PATH) == 0) {
+            serve_metrics(out);
+            return;
+        }
+        serve_file(out, parser, path);
     } else {
-        send_data(client_fd, "HTTP/1.1 405 Method Not Allowed\r\n");
-        send_data(client_fd, "Content-Type: text/plain\r\n\r\n");
-        send_data(client_fd, "Method Not Allowed\r\n");
+        queue_simple_response(out, "405 Method Not Allowed", "Method Not Allowed\r\n");
     }
 }
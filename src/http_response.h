@@ -2,14 +2,38 @@
 #define HTTP_RESPONSE_H
 
 #include "request_parser.h"
+#include "output_queue.h"
+
+#define DOCUMENT_ROOT "docs"   // directory da cui vengono serviti i file
 
 /**
- * @brief Elabora la richiesta HTTP e invia una risposta al client_fd.
+ * @brief Elabora la richiesta HTTP e accoda la risposta in out. L'invio avviene
+ *        con output_queue_flush(), così le risposte di più richieste in pipeline
+ *        partono insieme.
  *
- * @param client_fd file descriptor del client.
+ * @param out coda di uscita della connessione.
  * @param parser puntatore alla struttura con i campi del request parser.
+ * @param last true se la connessione verrà chiusa dopo questa risposta
+ *        (aggiunge "Connection: close").
+ */
+void handle_http_request(output_queue_t *out, http_request_parser_t *parser, bool last);
+
+/**
+ * @brief Carica il file local_path nella cache condivisa come farebbe il
+ *        primo miss (header precalcolato, ETag, varianti compresse comprese).
+ *        Pensata per il master prima del fork (vedi cache_warmup.h).
+ * @param pin true per escludere il file (e le varianti) dall'evizione.
+ * @return byte inseriti in cache, 0 se il file non c'è o non entra nel budget.
+ */
+size_t http_preload_file(const char *local_path, bool pin);
+
+/**
+ * @brief Impacchetta la document root docroot nel bundle out_path (vedi
+ *        bundle.h), da servire poi con --bundle: contenuti, varianti
+ *        compresse e header precalcolati uguali a quelli della cache.
+ * @return numero di file nel bundle, -1 in caso di errore.
  */
-void handle_http_request(int client_fd, http_request_parser_t *parser);
+long http_pack_docroot(const char *docroot, const char *out_path);
 
 #endif // HTTP_RESPONSE_H
 
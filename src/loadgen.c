@@ -0,0 +1,578 @@
+/**
+ * Generatore di carico HTTP basato su epoll (un thread, connessioni non bloccanti).
+ *
+ * - closed loop (default): ogni connessione tiene sempre "depth" richieste in
+ *   volo e ne invia una nuova appena arriva una risposta;
+ * - open loop (-r): le richieste partono a ritmo costante indipendentemente
+ *   dalle risposte; la latenza è misurata dall'istante previsto di invio, così
+ *   il tempo passato in coda quando il server rallenta non viene nascosto
+ *   (coordinated omission). In closed loop la stessa correzione è applicata
+ *   a posteriori all'istogramma, con intervallo atteso pari alla latenza media.
+ *
+ * Uso: loadgen [-h host] [-p porta] [-c connessioni] [-d secondi] [-r req/s]
+ *              [-P profondità pipeline] [-K] [-m mix] [-s seed] [-l etichetta] [-o file.csv]
+ *   -K       nessun keep-alive: una connessione nuova per ogni richiesta
+ *   -m mix   percorsi con peso, ad es. "1k.html:4,10k.html:3,1M.html:1"
+ *   -o file  aggiunge una riga CSV con i risultati (header se il file è vuoto)
+ */
+#define _GNU_SOURCE // memmem
+#include "histogram.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define LOADGEN_MAX_CONNS 4096
+#define LOADGEN_MAX_DEPTH 64
+#define LOADGEN_MAX_PATHS 16
+#define LOADGEN_REQUEST_MAX 256
+#define LOADGEN_IN_BUF (64 * 1024)
+
+typedef struct {
+    char path[128];
+    int weight;
+} mix_entry_t;
+
+/**
+ * @brief Stato di una connessione: richieste da inviare, istanti di partenza
+ *        delle richieste in volo (FIFO, le risposte arrivano in ordine) e
+ *        parsing incrementale della risposta corrente.
+ */
+typedef struct {
+    int fd;
+    bool connected;
+    bool want_write;        // EPOLLOUT registrato
+    char out[LOADGEN_MAX_DEPTH * LOADGEN_REQUEST_MAX];
+    size_t out_len;
+    size_t out_sent;
+    uint64_t start_ns[LOADGEN_MAX_DEPTH];
+    int head;
+    int inflight;
+    char in[LOADGEN_IN_BUF];
+    size_t in_len;
+    bool in_body;
+    size_t body_left;
+    int status;
+    bool server_close;      // l'ultima risposta annuncia "Connection: close"
+} lg_conn_t;
+
+typedef struct {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    const char *host;
+    int connections;
+    int duration;
+    double rate;            // 0 = closed loop
+    int depth;
+    bool keepalive;
+    mix_entry_t mix[LOADGEN_MAX_PATHS];
+    int mix_count;
+    int mix_total;
+    uint64_t seed;
+    const char *label;
+    const char *output;
+} lg_config_t;
+
+typedef struct {
+    unsigned long hist[HISTOGRAM_BUCKETS];
+    unsigned long requests;
+    unsigned long errors;       // status >= 400
+    unsigned long socket_errors;
+    unsigned long long bytes;
+    uint64_t latency_sum_ns;
+    uint64_t latency_max_ns;
+} lg_stats_t;
+
+static lg_config_t g_cfg;
+static lg_stats_t g_stats;
+static lg_conn_t *g_conns;
+static int g_epfd;
+static bool g_measuring = true;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief PRNG xorshift64*: stessa sequenza di percorsi a parità di seed.
+ */
+static uint64_t next_random(void) {
+    g_cfg.seed ^= g_cfg.seed >> 12;
+    g_cfg.seed ^= g_cfg.seed << 25;
+    g_cfg.seed ^= g_cfg.seed >> 27;
+    return g_cfg.seed * 2685821657736338717ull;
+}
+
+static const char *pick_path(void) {
+    int r = (int)(next_random() % (uint64_t)g_cfg.mix_total);
+    for (int i = 0; i < g_cfg.mix_count; i++) {
+        r -= g_cfg.mix[i].weight;
+        if (r < 0) {
+            return g_cfg.mix[i].path;
+        }
+    }
+    return g_cfg.mix[0].path;
+}
+
+static int parse_mix(const char *spec) {
+    char copy[1024];
+    snprintf(copy, sizeof(copy), "%s", spec);
+    g_cfg.mix_count = 0;
+    g_cfg.mix_total = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(copy, ",", &save); tok && g_cfg.mix_count < LOADGEN_MAX_PATHS;
+         tok = strtok_r(NULL, ",", &save)) {
+        mix_entry_t *e = &g_cfg.mix[g_cfg.mix_count];
+        char *colon = strchr(tok, ':');
+        e->weight = colon ? atoi(colon + 1) : 1;
+        if (colon) {
+            *colon = '\0';
+        }
+        snprintf(e->path, sizeof(e->path), "%s%s", tok[0] == '/' ? "" : "/", tok);
+        if (e->weight > 0) {
+            g_cfg.mix_total += e->weight;
+            g_cfg.mix_count++;
+        }
+    }
+    return g_cfg.mix_count > 0 ? 0 : -1;
+}
+
+static void update_events(lg_conn_t *c) {
+    bool want = !c->connected || c->out_sent < c->out_len;
+    if (want == c->want_write) {
+        return;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | (want ? EPOLLOUT : 0);
+    ev.data.ptr = c;
+    epoll_ctl(g_epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->want_write = want;
+}
+
+static int open_connection(lg_conn_t *c) {
+    c->fd = socket(g_cfg.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c->fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(c->fd, (struct sockaddr *)&g_cfg.addr, g_cfg.addr_len) < 0 && errno != EINPROGRESS) {
+        perror("connect");
+        close(c->fd);
+        c->fd = -1;
+        return -1;
+    }
+    c->connected = false;
+    c->want_write = true;
+    c->out_len = c->out_sent = 0;
+    c->head = c->inflight = 0;
+    c->in_len = 0;
+    c->in_body = false;
+    c->server_close = false;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLOUT;
+    ev.data.ptr = c;
+    return epoll_ctl(g_epfd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+/**
+ * @brief Chiude la connessione (le richieste in volo contano come errori se
+ *        la chiusura non era prevista) e ne apre subito un'altra.
+ */
+static void reconnect(lg_conn_t *c, bool failed) {
+    if (failed && g_measuring) {
+        g_stats.socket_errors += (unsigned long)(c->inflight > 0 ? c->inflight : 1);
+    }
+    close(c->fd);
+    c->fd = -1;
+    open_connection(c);
+}
+
+static void flush_out(lg_conn_t *c) {
+    while (c->out_sent < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_sent, c->out_len - c->out_sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            reconnect(c, true);
+            return;
+        }
+        c->out_sent += (size_t)n;
+    }
+    if (c->out_sent == c->out_len) {
+        c->out_len = c->out_sent = 0;
+    }
+    update_events(c);
+}
+
+/**
+ * @brief true se la connessione può accettare un'altra richiesta.
+ */
+static bool can_send(const lg_conn_t *c) {
+    if (c->fd < 0 || !c->connected) {
+        return false;
+    }
+    return g_cfg.keepalive ? c->inflight < g_cfg.depth : c->inflight == 0;
+}
+
+/**
+ * @brief Accoda una richiesta sulla connessione; start_ns è l'istante da cui
+ *        misurarne la latenza.
+ * @return false se il buffer di uscita è pieno.
+ */
+static bool queue_request(lg_conn_t *c, uint64_t start_ns) {
+    if (c->out_len + LOADGEN_REQUEST_MAX > sizeof(c->out)) {
+        return false;
+    }
+    int n = snprintf(c->out + c->out_len, LOADGEN_REQUEST_MAX, "GET %s HTTP/1.1\r\nHost: %s\r\n%s\r\n",
+                     pick_path(), g_cfg.host, g_cfg.keepalive ? "" : "Connection: close\r\n");
+    c->out_len += (size_t)n;
+    c->start_ns[(c->head + c->inflight) % LOADGEN_MAX_DEPTH] = start_ns;
+    c->inflight++;
+    return true;
+}
+
+static void fill_closed_loop(lg_conn_t *c) {
+    if (g_cfg.rate > 0 || !g_measuring) {
+        return;
+    }
+    uint64_t now = now_ns();
+    while (can_send(c) && queue_request(c, now)) {
+    }
+    flush_out(c);
+}
+
+static void complete_response(lg_conn_t *c) {
+    uint64_t latency = now_ns() - c->start_ns[c->head];
+    c->head = (c->head + 1) % LOADGEN_MAX_DEPTH;
+    c->inflight--;
+    if (g_measuring) {
+        g_stats.requests++;
+        g_stats.hist[histogram_bucket(latency)]++;
+        g_stats.latency_sum_ns += latency;
+        if (latency > g_stats.latency_max_ns) {
+            g_stats.latency_max_ns = latency;
+        }
+        if (c->status >= 400 || c->status < 100) {
+            g_stats.errors++;
+        }
+    }
+    // Chiusura annunciata dal server (es. limite di richieste per connessione):
+    // le richieste in pipeline dopo questa non sono errori, non verranno servite
+    if (!g_cfg.keepalive || c->server_close) {
+        reconnect(c, false);
+        return;
+    }
+    fill_closed_loop(c);
+}
+
+/**
+ * @brief Legge dal socket e consuma le risposte complete (header + Content-Length byte).
+ */
+static void handle_read(lg_conn_t *c) {
+    while (c->fd >= 0) {
+        ssize_t n = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            reconnect(c, c->inflight > 0);
+            return;
+        }
+        if (n < 0) {
+            return;
+        }
+        if (g_measuring) {
+            g_stats.bytes += (unsigned long long)n;
+        }
+        c->in_len += (size_t)n;
+
+        size_t pos = 0;
+        while (pos < c->in_len) {
+            if (!c->in_body) {
+                char *start = c->in + pos;
+                char *end = memmem(start, c->in_len - pos, "\r\n\r\n", 4);
+                if (!end) {
+                    break;
+                }
+                c->status = (c->in_len - pos > 12) ? atoi(start + 9) : 0;
+                c->body_left = 0;
+                for (char *line = start; line && line < end; ) {
+                    line = memchr(line, '\n', (size_t)(end - line));
+                    if (!line) {
+                        break;
+                    }
+                    line++;
+                    if (strncasecmp(line, "Content-Length:", 15) == 0) {
+                        c->body_left = strtoul(line + 15, NULL, 10);
+                    } else if (strncasecmp(line, "Connection: close", 17) == 0) {
+                        c->server_close = true;
+                    }
+                }
+                pos = (size_t)(end - c->in) + 4;
+                c->in_body = true;
+            }
+            size_t take = c->in_len - pos < c->body_left ? c->in_len - pos : c->body_left;
+            pos += take;
+            c->body_left -= take;
+            if (c->body_left > 0) {
+                break;
+            }
+            c->in_body = false;
+            if (c->inflight > 0) {
+                complete_response(c);
+                if (c->fd < 0 || c->in_len == 0) {
+                    return; // riconnessa: il buffer è stato azzerato
+                }
+            }
+        }
+        if (pos > 0) {
+            memmove(c->in, c->in + pos, c->in_len - pos);
+            c->in_len -= pos;
+        }
+        if (c->in_len == sizeof(c->in)) {
+            reconnect(c, true); // header più grande del buffer
+            return;
+        }
+    }
+}
+
+static void handle_event(lg_conn_t *c, uint32_t events) {
+    if (!c->connected && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            if (g_measuring) {
+                g_stats.socket_errors++;
+            }
+            close(c->fd);
+            c->fd = -1;
+            return; // ritentata dal ciclo principale
+        }
+        c->connected = true;
+        fill_closed_loop(c);
+        update_events(c);
+    }
+    if (c->fd >= 0 && (events & EPOLLOUT)) {
+        flush_out(c);
+    }
+    if (c->fd >= 0 && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        handle_read(c);
+    }
+}
+
+/**
+ * @brief Copia dell'istogramma corretta per la coordinated omission (come
+ *        HdrHistogram): ogni campione v > interval aggiunge i campioni che
+ *        sarebbero stati misurati a v - interval, v - 2*interval, ...
+ */
+static void correct_histogram(const unsigned long *in, unsigned long *out, uint64_t interval,
+                              unsigned long *total) {
+    memcpy(out, in, sizeof(unsigned long) * HISTOGRAM_BUCKETS);
+    *total = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        *total += in[b];
+    }
+    if (interval == 0) {
+        return;
+    }
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        if (in[b] == 0) {
+            continue;
+        }
+        uint64_t v = histogram_bucket_upper(b);
+        for (uint64_t missing = v > interval ? v - interval : 0; missing >= interval; missing -= interval) {
+            out[histogram_bucket(missing)] += in[b];
+            *total += in[b];
+        }
+    }
+}
+
+static void write_csv(double elapsed, const unsigned long *hist, unsigned long total) {
+    FILE *f = fopen(g_cfg.output, "a");
+    if (!f) {
+        perror("fopen output");
+        return;
+    }
+    struct stat st;
+    if (fstat(fileno(f), &st) == 0 && st.st_size == 0) {
+        fprintf(f, "label,mode,connections,depth,keepalive,rate,duration_s,requests,errors,"
+                   "rps,mb_s,p50_us,p90_us,p99_us,p999_us,max_us\n");
+    }
+    fprintf(f, "%s,%s,%d,%d,%d,%.0f,%.2f,%lu,%lu,%.0f,%.2f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+            g_cfg.label, g_cfg.rate > 0 ? "open" : "closed", g_cfg.connections, g_cfg.depth,
+            g_cfg.keepalive ? 1 : 0, g_cfg.rate, elapsed, g_stats.requests,
+            g_stats.errors + g_stats.socket_errors, g_stats.requests / elapsed,
+            g_stats.bytes / elapsed / (1024.0 * 1024.0),
+            histogram_percentile(hist, total, 0.5) / 1e3, histogram_percentile(hist, total, 0.9) / 1e3,
+            histogram_percentile(hist, total, 0.99) / 1e3, histogram_percentile(hist, total, 0.999) / 1e3,
+            g_stats.latency_max_ns / 1e3);
+    fclose(f);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Uso: %s [-h host] [-p porta] [-c connessioni] [-d secondi] [-r req/s] "
+                    "[-P profondità] [-K] [-m mix] [-s seed] [-l etichetta] [-o file.csv]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    const char *port = "8080";
+    const char *mix = "1k.html:1,2k.html:1,5k.html:1,10k.html:1,100k.html:1,200k.html:1,500k.html:1,1M.html:1";
+    g_cfg.host = "127.0.0.1";
+    g_cfg.connections = 16;
+    g_cfg.duration = 5;
+    g_cfg.depth = 1;
+    g_cfg.keepalive = true;
+    g_cfg.seed = 1;
+    g_cfg.label = "run";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:c:d:r:P:Km:s:l:o:")) != -1) {
+        switch (opt) {
+            case 'h': g_cfg.host = optarg; break;
+            case 'p': port = optarg; break;
+            case 'c': g_cfg.connections = atoi(optarg); break;
+            case 'd': g_cfg.duration = atoi(optarg); break;
+            case 'r': g_cfg.rate = atof(optarg); break;
+            case 'P': g_cfg.depth = atoi(optarg); break;
+            case 'K': g_cfg.keepalive = false; break;
+            case 'm': mix = optarg; break;
+            case 's': g_cfg.seed = strtoull(optarg, NULL, 10) | 1; break;
+            case 'l': g_cfg.label = optarg; break;
+            case 'o': g_cfg.output = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (g_cfg.connections < 1 || g_cfg.connections > LOADGEN_MAX_CONNS || g_cfg.duration < 1 ||
+        g_cfg.depth < 1 || g_cfg.depth > LOADGEN_MAX_DEPTH || parse_mix(mix) < 0) {
+        usage(argv[0]);
+    }
+    if (!g_cfg.keepalive) {
+        g_cfg.depth = 1;
+    }
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(g_cfg.host, port, &hints, &res) != 0 || !res) {
+        fprintf(stderr, "Host non valido: %s\n", g_cfg.host);
+        return EXIT_FAILURE;
+    }
+    memcpy(&g_cfg.addr, res->ai_addr, res->ai_addrlen);
+    g_cfg.addr_len = res->ai_addrlen;
+    freeaddrinfo(res);
+
+    g_epfd = epoll_create1(EPOLL_CLOEXEC);
+    g_conns = (lg_conn_t *)calloc((size_t)g_cfg.connections, sizeof(lg_conn_t));
+    if (g_epfd < 0 || !g_conns) {
+        perror("init");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < g_cfg.connections; i++) {
+        g_conns[i].fd = -1;
+        open_connection(&g_conns[i]);
+    }
+
+    struct epoll_event events[256];
+    uint64_t start = now_ns();
+    uint64_t end = start + (uint64_t)g_cfg.duration * 1000000000ull;
+    uint64_t interval = g_cfg.rate > 0 ? (uint64_t)(1e9 / g_cfg.rate) : 0;
+    uint64_t issued = 0; // open loop: richieste già assegnate a una connessione
+    int next_conn = 0;
+
+    for (uint64_t now = start; now < end; now = now_ns()) {
+        int timeout = 100;
+        if (interval > 0) {
+            uint64_t due = start + issued * interval;
+            timeout = due > now ? (int)((due - now) / 1000000) : 0;
+        }
+        int n = epoll_wait(g_epfd, events, 256, timeout);
+        for (int i = 0; i < n; i++) {
+            handle_event((lg_conn_t *)events[i].data.ptr, events[i].events);
+        }
+
+        // Connessioni fallite: nuovo tentativo
+        for (int i = 0; i < g_cfg.connections; i++) {
+            if (g_conns[i].fd < 0) {
+                open_connection(&g_conns[i]);
+            }
+        }
+
+        if (interval > 0) {
+            // Open loop: ogni richiesta scaduta va alla prima connessione libera;
+            // se non ce ne sono aspetta, e l'attesa finisce nella sua latenza
+            now = now_ns();
+            uint64_t scheduled = (now - start) / interval + 1;
+            for (int tries = 0; issued < scheduled && tries < g_cfg.connections; ) {
+                lg_conn_t *c = &g_conns[next_conn];
+                if (can_send(c) && queue_request(c, start + issued * interval)) {
+                    issued++;
+                    flush_out(c);
+                    tries = 0;
+                } else {
+                    next_conn = (next_conn + 1) % g_cfg.connections;
+                    tries++;
+                }
+            }
+        }
+    }
+    g_measuring = false;
+    double elapsed = (double)(now_ns() - start) / 1e9;
+
+    // In closed loop l'intervallo atteso tra due richieste di una connessione
+    // è la latenza media; in open loop la misura è già corretta
+    uint64_t expected = 0;
+    if (g_cfg.rate <= 0 && g_stats.requests > 0) {
+        expected = g_stats.latency_sum_ns / g_stats.requests;
+    }
+    unsigned long *corrected = (unsigned long *)malloc(sizeof(unsigned long) * HISTOGRAM_BUCKETS);
+    unsigned long total = 0;
+    if (!corrected) {
+        return EXIT_FAILURE;
+    }
+    correct_histogram(g_stats.hist, corrected, expected, &total);
+
+    printf("%s: %lu richieste in %.2f s (%.0f req/s, %.2f MB/s), %lu errori HTTP, %lu errori socket\n",
+           g_cfg.label, g_stats.requests, elapsed, g_stats.requests / elapsed,
+           g_stats.bytes / elapsed / (1024.0 * 1024.0), g_stats.errors, g_stats.socket_errors);
+    printf("  latenza (us)  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           histogram_percentile(corrected, total, 0.5) / 1e3, histogram_percentile(corrected, total, 0.9) / 1e3,
+           histogram_percentile(corrected, total, 0.99) / 1e3, histogram_percentile(corrected, total, 0.999) / 1e3,
+           g_stats.latency_max_ns / 1e3);
+    if (expected > 0) {
+        printf("  senza correzione: p99 %.1f us, p99.9 %.1f us\n",
+               histogram_percentile(g_stats.hist, g_stats.requests, 0.99) / 1e3,
+               histogram_percentile(g_stats.hist, g_stats.requests, 0.999) / 1e3);
+    }
+    if (g_cfg.output) {
+        write_csv(elapsed, corrected, total);
+    }
+
+    for (int i = 0; i < g_cfg.connections; i++) {
+        if (g_conns[i].fd >= 0) {
+            close(g_conns[i].fd);
+        }
+    }
+    free(corrected);
+    free(g_conns);
+    close(g_epfd);
+    return EXIT_SUCCESS;
+}
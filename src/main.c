@@ -2,24 +2,473 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
 #include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 
 #include "server.h"
 #include "worker_process.h"
+#include "event_loop.h"
 #include "thread_pool.h"
 #include "file_cache.h"
+#include "file_watcher.h"
+#include "cache_warmup.h"
+#include "open_file_cache.h"
+#include "bundle.h"
+#include "http_response.h"
+#include "request_parser.h"
 #include "performance_log.h"
+#include "metrics.h"
+#include "topology.h"
 
-#define NUM_WORKERS 2
-#define NUM_THREADS_PER_WORKER 4
+#define DEFAULT_WORKERS 2
+#define DEFAULT_THREADS 4
+#define WORKER_RESPAWN_MIN_MS 1000       // un worker morto prima di così viene ricreato dopo una pausa
+#define MASTER_UPGRADE_TIMEOUT_MS 10000  // attesa massima del nuovo master (SIGUSR2)
+#define MASTER_LISTEN_FDS_ENV "CWS_LISTEN_FDS" // socket in ascolto ereditati dal vecchio master
+#define MASTER_READY_FD_ENV "CWS_READY_FD"     // pipe su cui il nuovo master si dichiara pronto
 
 bool g_verbose = false; // verbose mode
+unsigned g_max_requests = CONN_MAX_REQUESTS; // richieste per connessione (0 = nessun limite)
 
-file_cache_t g_file_cache;   // Cache globale
+file_cache_t g_file_cache;   // Cache globale, condivisa tra i worker
+topology_t g_topology;       // Worker, thread e CPU di ciascuno (--workers, --threads, --pin)
+open_file_cache_t g_open_files; // File aperti del worker (inizializzata dopo il fork)
+bundle_t g_bundle;           // Asset impacchettati (--bundle), mappati prima del fork
 bool g_enable_zerocopy = false; // Flag globale (attenzione ai thread, ma qui va bene per demo)
+atomic_bool g_draining = false; // Il worker sta uscendo (SIGTERM): niente più keep-alive
+
+static volatile sig_atomic_t g_report_requested = 0;
+static volatile sig_atomic_t g_reload_requested = 0;
+static volatile sig_atomic_t g_upgrade_requested = 0;
+static volatile sig_atomic_t g_stop_requested = 0;
+
+/**
+ * @brief Segnali gestiti dal master. Restano bloccati mentre lavora e li
+ *        riceve solo dentro sigsuspend() (vedi supervise()), SIGCHLD compreso.
+ */
+static void master_signals(sigset_t *set) {
+    sigemptyset(set);
+    sigaddset(set, SIGCHLD);
+    sigaddset(set, SIGUSR1);
+    sigaddset(set, SIGHUP);
+    sigaddset(set, SIGUSR2);
+    sigaddset(set, SIGTERM);
+    sigaddset(set, SIGINT);
+}
+
+static void on_master_signal(int sig) {
+    switch (sig) {
+        case SIGUSR1: g_report_requested = 1; break;
+        case SIGHUP: g_reload_requested = 1; break;
+        case SIGUSR2: g_upgrade_requested = 1; break;
+        case SIGCHLD: break; // basta interrompere sigsuspend(): i worker li raccoglie waitpid()
+        default: g_stop_requested = 1; break; // SIGTERM, SIGINT
+    }
+}
+
+/**
+ * @brief Stato del master: quanto serve per ricreare i worker, ricaricare i
+ *        contenuti e passare i socket a un nuovo binario.
+ */
+typedef struct {
+    char **argv;                  // riesecuzione con SIGUSR2
+    int workers;
+    int listen_fds[TOPOLOGY_MAX_WORKERS];
+    int listen_count;             // socket distinti: uno per worker con SO_REUSEPORT, altrimenti 1
+    bool use_reuseport;
+    unsigned open_files;
+    const char *bundle_path;
+    cache_warmup_options_t warmup;
+    int ready_fd;                 // pipe verso il vecchio master (-1 se non siamo un aggiornamento)
+
+    pid_t pids[TOPOLOGY_MAX_WORKERS]; // worker attivi, per posto (0 = posto vuoto)
+    uint64_t started_ms[TOPOLOGY_MAX_WORKERS];
+    int draining;                 // worker sostituiti che stanno finendo le proprie connessioni
+    pid_t successor;              // nuovo master avviato con SIGUSR2 (0 = nessuno)
+    bool stopping;                // si aspetta solo l'uscita dei worker
+} master_t;
+
+/**
+ * @brief Stampa le connessioni accettate da ciascun worker, per verificare
+ *        che il carico sia bilanciato, la profondità della coda dei job e i
+ *        contatori della cache condivisa e i percentili di latenza
+ *        (kill -USR1 <pid master>).
+ */
+static void report_accept_counts(const master_t *m) {
+    unsigned long total = 0;
+    for (int i = 0; i < m->workers; i++) {
+        total += atomic_load(&metrics_worker_stats(i)->accepted);
+    }
+    printf("[main] Connessioni accettate: %lu\n", total);
+    for (int i = 0; i < m->workers; i++) {
+        worker_stats_t *stats = metrics_worker_stats(i);
+        unsigned long n = atomic_load(&stats->accepted);
+        char who[24] = "uscito"; // dopo l'uscita dei worker (report finale)
+        if (m->pids[i] > 0) {
+            snprintf(who, sizeof(who), "pid %d", m->pids[i]);
+        }
+        printf("[main]   worker %d (%s): %lu (%.1f%%), %lu attive, coda job %lu (max %lu)\n", i, who, n,
+               total ? 100.0 * n / total : 0.0, atomic_load(&stats->active_connections),
+               atomic_load(&stats->queue_depth), atomic_load(&stats->queue_depth_peak));
+    }
+
+    file_cache_stats_t cs;
+    file_cache_get_stats(&g_file_cache, &cs);
+    printf("[main] Cache: %lu hit, %lu miss, %lu evizioni, %lu file, %zu/%zu KB\n",
+           cs.hits, cs.misses, cs.evictions, cs.entries, cs.bytes / 1024, cs.budget / 1024);
+    printf("[main] Latenza: p50 %.1f us, p99 %.1f us, p99.9 %.1f us\n",
+           metrics_latency_percentile(0.5) / 1e3, metrics_latency_percentile(0.99) / 1e3,
+           metrics_latency_percentile(0.999) / 1e3);
+    fflush(stdout);
+}
+
+/**
+ * @brief Legge i socket in ascolto passati dal vecchio master ("fd,fd,...").
+ * @return 0 se ok, -1 se il numero non corrisponde alla modalità (--reuseport o no).
+ */
+static int parse_inherited_sockets(master_t *m, const char *list) {
+    int count = 0;
+    const char *p = list;
+    while (*p && count < m->workers) {
+        char *end;
+        long fd = strtol(p, &end, 10);
+        if (end == p || fd < 0 || fcntl((int)fd, F_GETFD) < 0) {
+            return -1;
+        }
+        m->listen_fds[count++] = (int)fd;
+        p = *end == ',' ? end + 1 : end;
+    }
+    if (*p || count != m->listen_count) {
+        return -1;
+    }
+    for (int i = count; i < m->workers; i++) {
+        m->listen_fds[i] = m->listen_fds[0];
+    }
+    return 0;
+}
+
+/**
+ * @brief Crea il worker del posto i.
+ * @return pid del worker (nel master), -1 se il fork non riesce. Il figlio non ritorna.
+ */
+static pid_t spawn_worker(master_t *m, int i) {
+    // Segnali bloccati finché il figlio non ha i gestori del worker: un
+    // SIGTERM arrivato prima finirebbe nel gestore del master e andrebbe perso
+    sigset_t signals, old;
+    master_signals(&signals);
+    sigprocmask(SIG_BLOCK, &signals, &old);
+    fflush(stdout); // il buffer non scritto verrebbe duplicato nel figlio
+    pid_t pid = fork();
+    if (pid != 0) {
+        sigprocmask(SIG_SETMASK, &old, NULL);
+        if (pid < 0) {
+            perror("fork");
+            return -1;
+        }
+        m->pids[i] = pid;
+        m->started_ms[i] = timer_now_ms();
+        return pid;
+    }
+
+    // Codice del processo figlio (worker)
+    worker_process_init_signals();
+    sigprocmask(SIG_UNBLOCK, &signals, NULL);
+    if (m->ready_fd >= 0) {
+        close(m->ready_fd);
+    }
+
+    worker_process_t worker;
+    memset(&worker, 0, sizeof(worker));
+    worker.id = i;
+    worker.listen_fd = m->listen_fds[i];
+    worker.listen_shared = !m->use_reuseport;
+    worker.stats = metrics_worker_stats(i);
+    metrics_set_worker(i);
+
+    // I socket SO_REUSEPORT degli altri worker non ci servono
+    if (m->use_reuseport) {
+        for (int j = 0; j < m->workers; j++) {
+            if (j != i) {
+                close(m->listen_fds[j]);
+            }
+        }
+    }
+
+    // Prima di creare i thread e di allocare: li ereditano, e la memoria
+    // toccata da qui in poi viene dal nodo NUMA delle CPU del worker
+    topology_bind_worker(&g_topology, i);
+
+    // Thread che scrive il log delle performance di questo worker
+    performance_log_start();
+
+    // I file descriptor non si condividono tra processi: ogni worker ha la propria
+    if (open_file_cache_init(&g_open_files, m->open_files) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    thread_pool_t pool;
+    thread_pool_init(&pool, g_topology.threads);
+    worker.thread_pool = &pool;
+
+    run_worker_process(&worker);
+
+    thread_pool_destroy(&pool);
+    open_file_cache_destroy(&g_open_files);
+    performance_log_stop();
+    exit(EXIT_SUCCESS);
+}
+
+/**
+ * @brief Chiede a tutti i worker attivi di uscire dopo aver finito le
+ *        proprie connessioni (SIGTERM); diventano worker "in uscita".
+ */
+static void stop_workers(master_t *m) {
+    for (int i = 0; i < m->workers; i++) {
+        if (m->pids[i] > 0) {
+            kill(m->pids[i], SIGTERM);
+            m->pids[i] = 0;
+            m->draining++;
+        }
+    }
+}
+
+/**
+ * @brief SIGHUP: ricarica i contenuti (il bundle, oppure la cache riallineata
+ *        al disco e il pre-riscaldamento col manifest riletto) e sostituisce i
+ *        worker senza perdere capacità: i nuovi partono prima che i vecchi
+ *        smettano di accettare, e i vecchi finiscono le richieste in corso.
+ */
+static void reload(master_t *m) {
+    printf("[main] SIGHUP: ricarico i contenuti e riavvio i worker\n");
+    if (m->bundle_path) {
+        bundle_t next;
+        if (bundle_open(&next, m->bundle_path) < 0) {
+            fprintf(stderr, "[main] Bundle non ricaricato: restano i worker attuali\n");
+            return;
+        }
+        // I worker in uscita hanno la propria copia della mappa
+        bundle_close(&g_bundle);
+        g_bundle = next;
+    } else {
+        size_t removed = file_cache_revalidate(&g_file_cache);
+        printf("[main] Cache riallineata al disco: %zu voci rimosse\n", removed);
+        if (m->warmup.scan || m->warmup.manifest || m->warmup.lock_memory) {
+            cache_warmup(&g_file_cache, DOCUMENT_ROOT, &m->warmup);
+        }
+    }
+
+    for (int i = 0; i < m->workers; i++) {
+        pid_t old = m->pids[i];
+        if (spawn_worker(m, i) < 0) {
+            continue; // resta il vecchio
+        }
+        if (old > 0) {
+            kill(old, SIGTERM);
+            m->draining++;
+        }
+    }
+    fflush(stdout);
+}
+
+/**
+ * @brief SIGUSR2: esegue di nuovo il binario (argv[0], ad es. appena
+ *        ricompilato) passandogli i socket in ascolto, che non vengono mai
+ *        chiusi: nessuna connessione rifiutata durante l'aggiornamento. Il
+ *        nuovo master conferma su una pipe dopo aver avviato i propri worker.
+ * @return true se il nuovo master è pronto (questo deve uscire), false se
+ *         non è partito entro MASTER_UPGRADE_TIMEOUT_MS (si continua così).
+ */
+static bool upgrade(master_t *m) {
+    if (m->successor > 0) {
+        fprintf(stderr, "[main] Aggiornamento già in corso (pid %d)\n", m->successor);
+        return false;
+    }
+    int ready[2];
+    if (pipe(ready) < 0) {
+        perror("pipe");
+        return false;
+    }
+    fcntl(ready[0], F_SETFD, FD_CLOEXEC);
+
+    // Le variabili si impostano prima del fork: nel figlio solo chiamate sicure fino a exec
+    char fds[TOPOLOGY_MAX_WORKERS * 12]; // "," e fino a 10 cifre per socket, più il '\0'
+    size_t len = 0;
+    for (int i = 0; i < m->listen_count; i++) {
+        int n = snprintf(fds + len, sizeof(fds) - len, "%s%d", i ? "," : "", m->listen_fds[i]);
+        if (n < 0 || (size_t)n >= sizeof(fds) - len) {
+            fprintf(stderr, "[main] Troppi socket da passare al nuovo binario: aggiornamento annullato\n");
+            close(ready[0]);
+            close(ready[1]);
+            return false;
+        }
+        len += (size_t)n;
+    }
+    char ready_fd[16];
+    snprintf(ready_fd, sizeof(ready_fd), "%d", ready[1]);
+    setenv(MASTER_LISTEN_FDS_ENV, fds, 1);
+    setenv(MASTER_READY_FD_ENV, ready_fd, 1);
+
+    sigset_t signals;
+    master_signals(&signals);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        for (int i = 0; i < m->listen_count; i++) {
+            fcntl(m->listen_fds[i], F_SETFD, 0); // i socket devono sopravvivere a exec
+        }
+        fcntl(ready[1], F_SETFD, 0);
+        sigprocmask(SIG_UNBLOCK, &signals, NULL); // la maschera sopravvive a exec
+        execvp(m->argv[0], m->argv);
+        perror("execvp");
+        _exit(127);
+    }
+    unsetenv(MASTER_LISTEN_FDS_ENV);
+    unsetenv(MASTER_READY_FD_ENV);
+    close(ready[1]);
+    if (pid < 0) {
+        perror("fork");
+        close(ready[0]);
+        return false;
+    }
+    m->successor = pid;
+    printf("[main] SIGUSR2: avviato il nuovo binario (pid %d), attendo che sia pronto\n", pid);
+    fflush(stdout);
+
+    // EOF se il nuovo master muore (o exec fallisce) prima di dichiararsi pronto
+    struct pollfd pfd = { ready[0], POLLIN, 0 };
+    char c;
+    int rc;
+    do {
+        rc = poll(&pfd, 1, MASTER_UPGRADE_TIMEOUT_MS);
+    } while (rc < 0 && errno == EINTR);
+    bool ok = rc > 0 && read(ready[0], &c, 1) == 1;
+    close(ready[0]);
+    if (!ok) {
+        fprintf(stderr, "[main] Il nuovo binario non è partito: continuo con questo\n");
+        kill(pid, SIGTERM);
+        return false;
+    }
+    printf("[main] Nuovo master %d pronto: i worker di questo finiscono le connessioni ed escono\n", pid);
+    fflush(stdout);
+    return true;
+}
+
+/**
+ * @brief Ciclo del master: raccoglie i worker terminati e ricrea quelli morti
+ *        inaspettatamente (con una pausa se muoiono appena avviati), e gestisce
+ *        i segnali. Ritorna quando, dopo SIGTERM/SIGINT o un aggiornamento
+ *        riuscito, tutti i worker sono usciti.
+ *
+ *        I segnali del master restano bloccati per tutto il ciclo e vengono
+ *        consegnati solo dentro sigsuspend(), che li sblocca atomicamente:
+ *        uno arrivato dopo il controllo dei flag resta in attesa e interrompe
+ *        subito l'attesa successiva, invece di andare perso fino all'uscita
+ *        di un worker.
+ */
+static void supervise(master_t *m) {
+    sigset_t signals, wait_mask;
+    master_signals(&signals);
+    sigprocmask(SIG_BLOCK, &signals, &wait_mask);
+    for (int sig = 1; sig < NSIG; sig++) {
+        if (sigismember(&signals, sig) == 1) {
+            sigdelset(&wait_mask, sig);
+        }
+    }
+
+    while (1) {
+        if (g_report_requested) {
+            g_report_requested = 0;
+            report_accept_counts(m);
+        }
+        if (g_stop_requested) {
+            g_stop_requested = 0;
+            if (!m->stopping) {
+                printf("[main] Uscita: attendo che i worker finiscano le connessioni\n");
+                fflush(stdout);
+                stop_workers(m);
+                m->stopping = true;
+            }
+        }
+        if (g_reload_requested) {
+            g_reload_requested = 0;
+            if (!m->stopping) {
+                reload(m);
+            }
+        }
+        if (g_upgrade_requested) {
+            g_upgrade_requested = 0;
+            if (!m->stopping && upgrade(m)) {
+                stop_workers(m);
+                m->stopping = true;
+            }
+        }
+        if (m->stopping && m->draining == 0) {
+            break;
+        }
+        int status;
+        pid_t wpid = waitpid(-1, &status, WNOHANG);
+        if (wpid == 0) {
+            sigsuspend(&wait_mask); // ritorna dopo il gestore di un segnale (SIGCHLD compreso)
+            continue;
+        }
+        if (wpid < 0) {
+            if (errno != EINTR) {
+                break;
+            }
+            continue;
+        }
+        metrics_release(wpid); // gli slot dei suoi thread tornano liberi per chi lo sostituisce
+
+        int slot = -1;
+        for (int i = 0; i < m->workers; i++) {
+            if (m->pids[i] == wpid) {
+                slot = i;
+            }
+        }
+        if (wpid == m->successor) {
+            printf("[main] Nuovo master %d terminato con status %d\n", wpid, status);
+            m->successor = 0;
+            continue;
+        }
+        if (slot < 0) {
+            m->draining--; // worker sostituito o in uscita: non va ricreato
+            if (g_verbose) {
+                printf("[main] Worker %d uscito (status %d)\n", wpid, status);
+            }
+            continue;
+        }
+
+        printf("Worker process %d terminato con status %d: lo ricreo\n", wpid, status);
+        fflush(stdout);
+        m->pids[slot] = 0;
+        // Le connessioni del worker morto non ci sono più
+        atomic_store(&metrics_worker_stats(slot)->active_connections, 0);
+        if (timer_now_ms() - m->started_ms[slot] < WORKER_RESPAWN_MIN_MS) {
+            sleep(1); // muore appena avviato: niente raffica di fork
+        }
+        spawn_worker(m, slot);
+    }
+}
 
 int main(int argc, char *argv[]) {
     int port = DEFAULT_PORT;
+    bool use_reuseport = false;
+    bool use_incoming_cpu = false;
+    size_t cache_size = FILE_CACHE_DEFAULT_SIZE;
+    int sweep_interval = FILE_WATCHER_DEFAULT_SWEEP_SEC;
+    size_t log_max_size = PERF_LOG_DEFAULT_MAX_SIZE;
+    int log_rotate_sec = 0;
+    unsigned open_files = OPEN_FILE_CACHE_DEFAULT_MAX;
+    cache_warmup_options_t warmup = { false, CACHE_WARMUP_DEFAULT_MAX_FILE, NULL, false };
+    const char *bundle_path = NULL;
+    int workers = DEFAULT_WORKERS;   // 0 = uno per CPU utilizzabile
+    int threads = -1;                // 0 = quante sono le CPU del worker, -1 = non indicato
+    topology_pin_t pin = TOPOLOGY_PIN_NONE;
+    bool pin_given = false;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--zerocopy") == 0 || strcmp(argv[i], "-z") == 0) {
@@ -28,6 +477,89 @@ int main(int argc, char *argv[]) {
         } else if (strcmp(argv[i], "--verbose") == 0 || strcmp(argv[i], "-v") == 0) {
             // enable verbose mode
             g_verbose = true;
+        } else if (strcmp(argv[i], "--reuseport") == 0) {
+            // un socket SO_REUSEPORT per worker
+            use_reuseport = true;
+        } else if (strcmp(argv[i], "--incoming-cpu") == 0) {
+            // SO_REUSEPORT + scelta del socket in base alla CPU che riceve la connessione
+            use_reuseport = true;
+            use_incoming_cpu = true;
+        } else if (strcmp(argv[i], "--io-uring") == 0) {
+            // event loop su io_uring (solo Linux, altrimenti epoll)
+            set_event_loop_backend(EVENT_BACKEND_IO_URING);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            // numero di processi worker, "auto" = uno per CPU (cpuset e quota del cgroup)
+            const char *arg = argv[++i];
+            workers = strcmp(arg, "auto") == 0 ? 0 : atoi(arg);
+            if (workers < 0 || (workers == 0 && strcmp(arg, "auto") != 0)) {
+                fprintf(stderr, "--workers: atteso un numero o \"auto\", non \"%s\".\n", arg);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            // thread del pool per worker, "auto" = quante sono le CPU del worker
+            const char *arg = argv[++i];
+            threads = strcmp(arg, "auto") == 0 ? 0 : atoi(arg);
+            if (threads < 0 || (threads == 0 && strcmp(arg, "auto") != 0)) {
+                fprintf(stderr, "--threads: atteso un numero o \"auto\", non \"%s\".\n", arg);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--pin") == 0 && i + 1 < argc) {
+            // vincola i worker (e i loro thread) a una CPU, alla L3 (CCX) o al nodo NUMA
+            if (!topology_parse_pin(argv[++i], &pin)) {
+                fprintf(stderr, "--pin: atteso none, core, l3 o node, non \"%s\".\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            pin_given = true;
+        } else if (strcmp(argv[i], "--max-requests") == 0 && i + 1 < argc) {
+            // richieste servite su una connessione keep-alive prima di chiuderla (0 = nessun limite)
+            int n = atoi(argv[++i]);
+            g_max_requests = n > 0 ? (unsigned)n : 0;
+        } else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc) {
+            // budget in MB dei contenuti nella cache condivisa
+            long mb = atol(argv[++i]);
+            if (mb > 0) {
+                cache_size = (size_t)mb * 1024 * 1024;
+            }
+        } else if (strcmp(argv[i], "--open-files") == 0 && i + 1 < argc) {
+            // file aperti (e "non trovato") tenuti in cache da ogni worker (0 = nessuna cache)
+            int n = atoi(argv[++i]);
+            open_files = n > 0 ? (unsigned)n : 0;
+        } else if (strcmp(argv[i], "--prewarm") == 0) {
+            // carica nella cache i file della document root prima di creare i worker
+            warmup.scan = true;
+        } else if (strcmp(argv[i], "--prewarm-max-size") == 0 && i + 1 < argc) {
+            // KB oltre i quali --prewarm non carica un file
+            long kb = atol(argv[++i]);
+            warmup.scan = true;
+            warmup.max_file_size = kb > 0 ? (size_t)kb * 1024 : 0;
+        } else if (strcmp(argv[i], "--prewarm-manifest") == 0 && i + 1 < argc) {
+            // file con i path caldi (uno per riga) da caricare e bloccare in cache
+            warmup.manifest = argv[++i];
+        } else if (strcmp(argv[i], "--mlock") == 0) {
+            // blocca in RAM la memoria della cache caricata all'avvio
+            warmup.lock_memory = true;
+        } else if (strcmp(argv[i], "--bundle") == 0 && i + 1 < argc) {
+            // Serve gli asset dal bundle invece che dalla document root
+            bundle_path = argv[++i];
+        } else if (strcmp(argv[i], "--pack") == 0 && i + 2 < argc) {
+            // Impacchetta una document root in un bundle ed esce (make bundle)
+            long n = http_pack_docroot(argv[i + 1], argv[i + 2]);
+            if (n < 0) {
+                fprintf(stderr, "Impossibile creare il bundle %s.\n", argv[i + 2]);
+                exit(EXIT_FAILURE);
+            }
+            printf("[pack] %ld file in %s\n", n, argv[i + 2]);
+            exit(EXIT_SUCCESS);
+        } else if (strcmp(argv[i], "--sweep-interval") == 0 && i + 1 < argc) {
+            // secondi tra due controlli con stat() della cache (0 = solo inotify)
+            sweep_interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--log-max-size") == 0 && i + 1 < argc) {
+            // MB oltre i quali il log delle performance viene ruotato (0 = mai)
+            long mb = atol(argv[++i]);
+            log_max_size = mb > 0 ? (size_t)mb * 1024 * 1024 : 0;
+        } else if (strcmp(argv[i], "--log-rotate-sec") == 0 && i + 1 < argc) {
+            // rotazione del log delle performance ogni N secondi (0 = mai)
+            log_rotate_sec = atoi(argv[++i]);
         } else {
             int tmp = atoi(argv[i]);
             if (tmp > 0) {
@@ -36,56 +568,151 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    // Inizializza la cache
-    file_cache_init(&g_file_cache);
+    // Quanti worker e thread, e su quali CPU: con --workers auto un worker
+    // per CPU, ciascuno vincolato alla propria se non si sceglie altro
+    if (workers == 0 && !pin_given) {
+        pin = TOPOLOGY_PIN_CORE;
+    }
+    if (threads < 0) {
+        threads = workers == 0 ? 0 : DEFAULT_THREADS;
+    }
+    if (topology_init(&g_topology, workers, threads, pin) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    topology_print(&g_topology);
+
+    // Ricerca vettoriale del parser scelta una volta sola, prima di thread e fork
+    request_parser_init();
+
+    // Inizializza la cache in memoria condivisa: creata qui, prima del fork,
+    // è la stessa per tutti i worker
+    if (file_cache_init(&g_file_cache, cache_size) < 0) {
+        fprintf(stderr, "Impossibile creare la cache condivisa.\n");
+        exit(EXIT_FAILURE);
+    }
+    // Letta dai worker di tutti i nodi: le pagine vanno distribuite tra i
+    // nodi invece di finire tutte su quello del master
+    if (g_topology.pin != TOPOLOGY_PIN_NONE && g_topology.node_count > 1) {
+        shm_arena_interleave(g_file_cache.arena, g_topology.node_mask);
+    }
+
+    // Bundle mappato una volta sola: i worker ereditano la mappa e il file
+    if (bundle_path && bundle_open(&g_bundle, bundle_path) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    // Pre-riscaldamento opzionale: i worker ereditano la cache già piena
+    if (warmup.scan || warmup.manifest || warmup.lock_memory) {
+        cache_warmup(&g_file_cache, DOCUMENT_ROOT, &warmup);
+    }
 
     // Inizializza performance log
     performance_log_init("performance.log");
+    performance_log_set_rotation(log_max_size, log_rotate_sec);
 
-    int listen_fd = create_listen_socket(port);
-    if (listen_fd < 0) {
-        fprintf(stderr, "Impossibile creare il socket in ascolto.\n");
-        exit(EXIT_FAILURE);
+    // Socket in ascolto: ereditati dal vecchio master (aggiornamento con
+    // SIGUSR2), oppure nuovi, uno condiviso o uno per worker (SO_REUSEPORT)
+    master_t master;
+    memset(&master, 0, sizeof(master));
+    master.argv = argv;
+    master.workers = g_topology.workers;
+    master.listen_count = use_reuseport ? master.workers : 1;
+    master.use_reuseport = use_reuseport;
+    master.open_files = open_files;
+    master.bundle_path = bundle_path;
+    master.warmup = warmup;
+    master.ready_fd = -1;
+    int *listen_fds = master.listen_fds;
+    const char *inherited = getenv(MASTER_LISTEN_FDS_ENV);
+    if (inherited) {
+        if (parse_inherited_sockets(&master, inherited) < 0) {
+            fprintf(stderr, "Socket ereditati non validi (%s=%s).\n", MASTER_LISTEN_FDS_ENV, inherited);
+            exit(EXIT_FAILURE);
+        }
+        printf("[main] Socket in ascolto ereditati dal vecchio master: %s\n", inherited);
+        const char *ready = getenv(MASTER_READY_FD_ENV);
+        master.ready_fd = ready ? atoi(ready) : -1;
+        unsetenv(MASTER_LISTEN_FDS_ENV);
+        unsetenv(MASTER_READY_FD_ENV);
+    } else if (use_reuseport) {
+        if (create_reuseport_sockets(port, listen_fds, master.workers,
+                                     use_incoming_cpu ? &g_topology : NULL) < 0) {
+            fprintf(stderr, "Impossibile creare i socket SO_REUSEPORT.\n");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        int listen_fd = create_listen_socket(port);
+        if (listen_fd < 0) {
+            fprintf(stderr, "Impossibile creare il socket in ascolto.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < master.workers; i++) {
+            listen_fds[i] = listen_fd;
+        }
     }
     if (g_verbose) {
         printf("[main] Server in ascolto sulla porta %d\n", port);
     }
 
+    // Contatori per-worker in memoria condivisa
+    // e istogrammi delle latenze per thread (aggregati da /metrics e dal report)
+    if (metrics_init(master.workers, g_topology.threads) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    // SIGUSR1 => report, SIGHUP => ricarica, SIGUSR2 => nuovo binario,
+    // SIGTERM/SIGINT => uscita graduale, SIGCHLD => un worker è uscito.
+    // Installati prima di creare i worker e sempre bloccati fuori da
+    // sigsuspend() in supervise(): un segnale durante l'avvio resta in attesa
+    // invece di uccidere il master. Anche il thread del watcher nasce con i
+    // segnali bloccati, così arrivano sempre al thread che li aspetta.
+    sigset_t signals;
+    master_signals(&signals);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_master_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGUSR2, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sa.sa_flags = SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+
     // Creiamo i processi worker
-    for (int i = 0; i < NUM_WORKERS; i++) {
-        pid_t pid = fork();
-        if (pid < 0) {
-            perror("fork");
+    for (int i = 0; i < master.workers; i++) {
+        if (spawn_worker(&master, i) < 0) {
             exit(EXIT_FAILURE);
         }
+    }
 
-        if (pid == 0) {
-            // Codice del processo figlio (worker)
-            worker_process_t worker;
-            worker.listen_fd = listen_fd;
-
-            thread_pool_t pool;
-            thread_pool_init(&pool, NUM_THREADS_PER_WORKER);
-            worker.thread_pool = &pool;
-
-            run_worker_process(&worker);
-
-            thread_pool_destroy(&pool);
-            exit(EXIT_SUCCESS);
-        }
+    // Il master tiene la cache allineata ai file su disco (dopo il fork:
+    // il thread del watcher resta solo nel master). Il bundle è immutabile:
+    // si aggiorna rigenerandolo e ricaricandolo con SIGHUP.
+    if (!bundle_path && file_watcher_start(&g_file_cache, DOCUMENT_ROOT, sweep_interval) < 0) {
+        fprintf(stderr, "Watcher della document root non avviato: la cache non verrà invalidata.\n");
     }
 
-    // Processo master: attende i worker
-    while (1) {
-        int status;
-        pid_t wpid = wait(&status);
-        if (wpid < 0) {
-            break;
+    // Siamo il nuovo binario di un aggiornamento: il vecchio master può far uscire i suoi worker
+    if (master.ready_fd >= 0) {
+        if (write(master.ready_fd, "1", 1) < 0) {
+            perror("write ready");
         }
-        printf("Worker process %d terminato con status %d\n", wpid, status);
+        close(master.ready_fd);
+        master.ready_fd = -1;
     }
 
-    close(listen_fd);
+    supervise(&master);
+
+    report_accept_counts(&master);
+
+    for (int i = 0; i < master.listen_count; i++) {
+        close(listen_fds[i]);
+    }
+    metrics_destroy();
+    file_cache_destroy(&g_file_cache);
 
     // Chiudiamo log
     performance_log_close();
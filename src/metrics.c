@@ -0,0 +1,304 @@
+#include "metrics.h"
+#include "file_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+extern file_cache_t g_file_cache;   // definita altrove
+
+/**
+ * @brief Parte della regione condivisa di un worker; i suoi slot dei thread
+ *        seguono, g_slots per worker, dopo quelli di tutti i worker.
+ */
+typedef struct {
+    worker_stats_t stats;
+} metrics_worker_t;
+
+/**
+ * @brief Somma dei contatori di tutti i thread di tutti i worker.
+ */
+typedef struct {
+    unsigned long requests;
+    unsigned long bytes;
+    unsigned long status[METRICS_STATUS_CODES];
+    unsigned long latency_sum_ns[METRICS_SIZE_CLASSES];
+    unsigned long latency[METRICS_SIZE_CLASSES][METRICS_BUCKETS];
+} metrics_snapshot_t;
+
+static const int g_status_codes[METRICS_STATUS_CODES - 1] = { 200, 206, 304, 404, 405, 414, 416 };
+static const char *g_size_names[METRICS_SIZE_CLASSES] = { "4k", "64k", "1m", "large" };
+
+static metrics_worker_t *g_region = NULL;
+static metrics_thread_t *g_threads = NULL; // g_workers * g_slots, subito dopo g_region
+static size_t g_region_size = 0;
+static int g_workers = 0;
+static int g_slots = 0;                    // slot dei thread per worker
+static int g_self = -1;
+static __thread metrics_thread_t *t_metrics = NULL;
+
+int metrics_init(int workers, int threads) {
+    // Il pool più il thread del ciclo di eventi, per ogni processo che può
+    // servire lo stesso worker nello stesso momento
+    g_slots = (threads + 1) * METRICS_GENERATIONS;
+    size_t head = sizeof(metrics_worker_t) * (size_t)workers;
+    g_region_size = head + sizeof(metrics_thread_t) * (size_t)workers * (size_t)g_slots;
+    void *region = mmap(NULL, g_region_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        perror("mmap metrics");
+        return -1;
+    }
+    // MAP_ANONYMOUS: la regione parte azzerata, con tutti gli slot liberi
+    g_region = (metrics_worker_t *)region;
+    g_threads = (metrics_thread_t *)((char *)region + head);
+    g_workers = workers;
+    return 0;
+}
+
+worker_stats_t *metrics_worker_stats(int worker) {
+    return &g_region[worker].stats;
+}
+
+void metrics_set_worker(int worker) {
+    g_self = worker;
+}
+
+void metrics_release(pid_t pid) {
+    if (!g_threads || pid <= 0) {
+        return;
+    }
+    for (int i = 0; i < g_workers * g_slots; i++) {
+        int owner = (int)pid;
+        atomic_compare_exchange_strong_explicit(&g_threads[i].owner, &owner, 0,
+                                                memory_order_release, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Slot del thread chiamante, preso al primo uso tra quelli liberi del
+ *        worker. Se non ce ne sono (più processi in uscita del previsto) i
+ *        thread condividono l'ultimo: i contatori sono comunque incrementati
+ *        in modo atomico.
+ */
+static metrics_thread_t *thread_metrics(void) {
+    if (!t_metrics && g_self >= 0) {
+        metrics_thread_t *slots = &g_threads[(size_t)g_self * (size_t)g_slots];
+        int pid = (int)getpid();
+        for (int i = 0; i < g_slots && !t_metrics; i++) {
+            int owner = 0;
+            if (atomic_compare_exchange_strong_explicit(&slots[i].owner, &owner, pid,
+                                                        memory_order_acquire, memory_order_relaxed)) {
+                t_metrics = &slots[i];
+            }
+        }
+        if (!t_metrics) {
+            t_metrics = &slots[g_slots - 1];
+        }
+    }
+    return t_metrics;
+}
+
+static int size_class(size_t size) {
+    if (size <= 4 * 1024) {
+        return METRICS_SIZE_4K;
+    }
+    if (size <= 64 * 1024) {
+        return METRICS_SIZE_64K;
+    }
+    if (size <= 1024 * 1024) {
+        return METRICS_SIZE_1M;
+    }
+    return METRICS_SIZE_LARGE;
+}
+
+static int status_index(int status) {
+    for (int i = 0; i < METRICS_STATUS_CODES - 1; i++) {
+        if (g_status_codes[i] == status) {
+            return i;
+        }
+    }
+    return METRICS_STATUS_CODES - 1;
+}
+
+void metrics_record(int status, size_t bytes, size_t file_size, uint64_t latency_ns) {
+    metrics_thread_t *m = thread_metrics();
+    if (!m) {
+        return;
+    }
+    int cls = size_class(file_size);
+    atomic_fetch_add_explicit(&m->requests, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->bytes, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->status[status_index(status)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->latency_sum_ns[cls], latency_ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->latency[cls][histogram_bucket(latency_ns)], 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Somma i contatori di tutti i thread (lettura senza lock: i valori
+ *        possono essere di pochi campioni indietro, mai incoerenti tra loro
+ *        oltre questo).
+ */
+static void take_snapshot(metrics_snapshot_t *s) {
+    memset(s, 0, sizeof(*s));
+    // Anche gli slot liberi: conservano i conteggi dei processi già usciti
+    for (int w = 0; w < g_workers; w++) {
+        for (int t = 0; t < g_slots; t++) {
+            metrics_thread_t *m = &g_threads[(size_t)w * (size_t)g_slots + (size_t)t];
+            s->requests += atomic_load_explicit(&m->requests, memory_order_relaxed);
+            s->bytes += atomic_load_explicit(&m->bytes, memory_order_relaxed);
+            for (int i = 0; i < METRICS_STATUS_CODES; i++) {
+                s->status[i] += atomic_load_explicit(&m->status[i], memory_order_relaxed);
+            }
+            for (int c = 0; c < METRICS_SIZE_CLASSES; c++) {
+                s->latency_sum_ns[c] += atomic_load_explicit(&m->latency_sum_ns[c], memory_order_relaxed);
+                for (int b = 0; b < METRICS_BUCKETS; b++) {
+                    s->latency[c][b] += atomic_load_explicit(&m->latency[c][b], memory_order_relaxed);
+                }
+            }
+        }
+    }
+}
+
+static unsigned long histogram_count(const unsigned long *counts) {
+    unsigned long total = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        total += counts[b];
+    }
+    return total;
+}
+
+uint64_t metrics_latency_percentile(double q) {
+    if (!g_region) {
+        return 0;
+    }
+    metrics_snapshot_t *s = (metrics_snapshot_t *)malloc(sizeof(metrics_snapshot_t));
+    if (!s) {
+        return 0;
+    }
+    take_snapshot(s);
+    unsigned long merged[METRICS_BUCKETS] = { 0 };
+    for (int c = 0; c < METRICS_SIZE_CLASSES; c++) {
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            merged[b] += s->latency[c][b];
+        }
+    }
+    uint64_t value = histogram_percentile(merged, histogram_count(merged), q);
+    free(s);
+    return value;
+}
+
+/**
+ * @brief Accoda testo formattato in buf, senza mai superarne la dimensione.
+ */
+static void append(char *buf, size_t size, size_t *len, const char *fmt, ...) {
+    // Come snprintf: len conta anche i byte che non ci stanno, così il
+    // chiamante sa quanto spazio serve (e non usa mai un output troncato)
+    va_list ap;
+    va_start(ap, fmt);
+    int n = *len < size ? vsnprintf(buf + *len, size - *len, fmt, ap) : vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        *len += (size_t)n;
+    }
+}
+
+size_t metrics_format(char *buf, size_t size) {
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    size_t len = 0;
+    if (!g_region || size == 0) {
+        return 0;
+    }
+    metrics_snapshot_t *s = (metrics_snapshot_t *)malloc(sizeof(metrics_snapshot_t));
+    if (!s) {
+        return 0;
+    }
+    take_snapshot(s);
+
+    append(buf, size, &len, "# HELP http_requests_total Richieste di file servite.\n"
+                            "# TYPE http_requests_total counter\n"
+                            "http_requests_total %lu\n", s->requests);
+    append(buf, size, &len, "# HELP http_response_bytes_total Byte delle risposte (header compresi).\n"
+                            "# TYPE http_response_bytes_total counter\n"
+                            "http_response_bytes_total %lu\n", s->bytes);
+    append(buf, size, &len, "# HELP http_responses_total Risposte per status HTTP.\n"
+                            "# TYPE http_responses_total counter\n");
+    for (int i = 0; i < METRICS_STATUS_CODES; i++) {
+        if (i < METRICS_STATUS_CODES - 1) {
+            append(buf, size, &len, "http_responses_total{code=\"%d\"} %lu\n", g_status_codes[i], s->status[i]);
+        } else {
+            append(buf, size, &len, "http_responses_total{code=\"other\"} %lu\n", s->status[i]);
+        }
+    }
+
+    append(buf, size, &len, "# HELP http_request_duration_seconds Latenza per classe di dimensione del file.\n"
+                            "# TYPE http_request_duration_seconds summary\n");
+    for (int c = 0; c < METRICS_SIZE_CLASSES; c++) {
+        unsigned long count = histogram_count(s->latency[c]);
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+            if (count == 0) {
+                // Nessun campione: per Prometheus il quantile non è definito
+                append(buf, size, &len, "http_request_duration_seconds{size=\"%s\",quantile=\"%g\"} NaN\n",
+                       g_size_names[c], quantiles[q]);
+                continue;
+            }
+            append(buf, size, &len, "http_request_duration_seconds{size=\"%s\",quantile=\"%g\"} %.9f\n",
+                   g_size_names[c], quantiles[q], (double)histogram_percentile(s->latency[c], count, quantiles[q]) / 1e9);
+        }
+        append(buf, size, &len, "http_request_duration_seconds_sum{size=\"%s\"} %.9f\n",
+               g_size_names[c], (double)s->latency_sum_ns[c] / 1e9);
+        append(buf, size, &len, "http_request_duration_seconds_count{size=\"%s\"} %lu\n", g_size_names[c], count);
+    }
+
+    file_cache_stats_t cs;
+    file_cache_get_stats(&g_file_cache, &cs);
+    append(buf, size, &len, "# TYPE file_cache_hits_total counter\nfile_cache_hits_total %lu\n", cs.hits);
+    append(buf, size, &len, "# TYPE file_cache_misses_total counter\nfile_cache_misses_total %lu\n", cs.misses);
+    append(buf, size, &len, "# TYPE file_cache_evictions_total counter\nfile_cache_evictions_total %lu\n",
+           cs.evictions);
+    append(buf, size, &len, "# TYPE file_cache_entries gauge\nfile_cache_entries %lu\n", cs.entries);
+    append(buf, size, &len, "# TYPE file_cache_bytes gauge\nfile_cache_bytes %zu\n", cs.bytes);
+
+    append(buf, size, &len, "# TYPE connections_accepted_total counter\n");
+    for (int w = 0; w < g_workers; w++) {
+        append(buf, size, &len, "connections_accepted_total{worker=\"%d\"} %lu\n", w,
+               atomic_load_explicit(&g_region[w].stats.accepted, memory_order_relaxed));
+    }
+    append(buf, size, &len, "# TYPE connections_active gauge\n");
+    for (int w = 0; w < g_workers; w++) {
+        append(buf, size, &len, "connections_active{worker=\"%d\"} %lu\n", w,
+               atomic_load_explicit(&g_region[w].stats.active_connections, memory_order_relaxed));
+    }
+    append(buf, size, &len, "# TYPE connections_timed_out_total counter\n");
+    for (int w = 0; w < g_workers; w++) {
+        append(buf, size, &len, "connections_timed_out_total{worker=\"%d\"} %lu\n", w,
+               atomic_load_explicit(&g_region[w].stats.timeouts, memory_order_relaxed));
+    }
+    append(buf, size, &len, "# TYPE connections_evicted_total counter\n");
+    for (int w = 0; w < g_workers; w++) {
+        append(buf, size, &len, "connections_evicted_total{worker=\"%d\"} %lu\n", w,
+               atomic_load_explicit(&g_region[w].stats.evictions, memory_order_relaxed));
+    }
+    append(buf, size, &len, "# TYPE thread_pool_queue_depth gauge\n");
+    for (int w = 0; w < g_workers; w++) {
+        append(buf, size, &len, "thread_pool_queue_depth{worker=\"%d\"} %lu\n", w,
+               atomic_load_explicit(&g_region[w].stats.queue_depth, memory_order_relaxed));
+    }
+    append(buf, size, &len, "# TYPE thread_pool_queue_depth_peak gauge\n");
+    for (int w = 0; w < g_workers; w++) {
+        append(buf, size, &len, "thread_pool_queue_depth_peak{worker=\"%d\"} %lu\n", w,
+               atomic_load_explicit(&g_region[w].stats.queue_depth_peak, memory_order_relaxed));
+    }
+
+    free(s);
+    return len;
+}
+
+void metrics_destroy(void) {
+    if (g_region) {
+        munmap(g_region, g_region_size);
+        g_region = NULL;
+        g_threads = NULL;
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include "histogram.h"
+
+#define METRICS_PATH "/metrics"     // percorso interno servito in formato Prometheus
+#define METRICS_GENERATIONS 2       // processi per worker che possono convivere (SIGHUP: uscente e nuovo)
+#define METRICS_BUCKETS HISTOGRAM_BUCKETS
+
+/**
+ * @brief Classi di dimensione del file servito, ognuna con il proprio istogramma.
+ */
+typedef enum {
+    METRICS_SIZE_4K,    // fino a 4 KB
+    METRICS_SIZE_64K,   // fino a 64 KB
+    METRICS_SIZE_1M,    // fino a 1 MB
+    METRICS_SIZE_LARGE, // oltre
+    METRICS_SIZE_CLASSES
+} metrics_size_class_t;
+
+#define METRICS_STATUS_CODES 8 // 200, 206, 304, 404, 405, 414, 416, altri
+
+/**
+ * @brief Contatori per-worker, allocati dal master in memoria condivisa
+ *        (un elemento per worker) così da poterli riportare da un unico punto.
+ */
+typedef struct {
+    atomic_ulong accepted;   // connessioni accettate dal worker
+    atomic_ulong active_connections; // connessioni aperte in questo momento
+    atomic_ulong timeouts;   // connessioni chiuse per scadenza (keep-alive, header, body)
+    atomic_ulong evictions;  // connessioni inattive chiuse per liberare fd
+    atomic_ulong queue_depth;      // job in coda nel thread pool (ultimo valore)
+    atomic_ulong queue_depth_peak; // massimo osservato
+} worker_stats_t;
+
+/**
+ * @brief Contatori e istogrammi delle latenze (vedi histogram.h) di un
+ *        thread: ogni thread scrive solo nei propri, senza contesa. Lo slot
+ *        appartiene al processo owner finché il master non lo raccoglie; i
+ *        contatori restano e il thread che lo riprende continua a sommarvi.
+ */
+typedef struct {
+    atomic_int owner;        // pid del processo che usa lo slot, 0 se libero
+    atomic_ulong requests;
+    atomic_ulong bytes;
+    atomic_ulong status[METRICS_STATUS_CODES];
+    atomic_ulong latency_sum_ns[METRICS_SIZE_CLASSES];
+    atomic_ulong latency[METRICS_SIZE_CLASSES][METRICS_BUCKETS];
+} metrics_thread_t;
+
+/**
+ * @brief Crea la regione condivisa per workers worker da threads thread
+ *        ciascuno. Va chiamata nel master prima del fork.
+ * @return 0 se ok, -1 in caso di errore.
+ */
+int metrics_init(int workers, int threads);
+
+/**
+ * @brief Contatori del worker nella regione condivisa.
+ */
+worker_stats_t *metrics_worker_stats(int worker);
+
+/**
+ * @brief Indica a quale worker appartiene il processo corrente (dopo il fork).
+ */
+void metrics_set_worker(int worker);
+
+/**
+ * @brief Libera gli slot dei thread del processo pid, appena raccolto dal
+ *        master, così che il worker che lo sostituisce possa riusarli.
+ */
+void metrics_release(pid_t pid);
+
+/**
+ * @brief Registra una risposta del thread corrente: status, byte inviati,
+ *        dimensione del file (classe dell'istogramma) e latenza.
+ */
+void metrics_record(int status, size_t bytes, size_t file_size, uint64_t latency_ns);
+
+/**
+ * @brief Latenza (ns) al quantile q (0..1) aggregata su tutti i worker e le
+ *        classi di dimensione; 0 se non ci sono campioni.
+ */
+uint64_t metrics_latency_percentile(double q);
+
+/**
+ * @brief Formatta tutte le metriche aggregate (formato testo di Prometheus),
+ *        comprese quelle della cache condivisa.
+ * @return lunghezza dell'output completo, come snprintf: se è >= size il
+ *         buffer non basta e il contenuto di buf va scartato.
+ */
+size_t metrics_format(char *buf, size_t size);
+
+/**
+ * @brief Libera la regione condivisa.
+ */
+void metrics_destroy(void);
+
+#endif // METRICS_H
@@ -0,0 +1,349 @@
+#include "open_file_cache.h"
+#include "timer_wheel.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/**
+ * @brief Hash FNV-1a a 64 bit del path.
+ */
+static uint64_t hash_path(const char *path) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+int open_file_cache_init(open_file_cache_t *cache, unsigned max) {
+    memset(cache, 0, sizeof(*cache));
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->max = max;
+    atomic_init(&cache->hits, 0);
+    atomic_init(&cache->misses, 0);
+    if (max == 0) {
+        return 0;
+    }
+
+    // Almeno due bucket per voce: catene corte senza ridimensionare mai
+    uint32_t buckets = 16;
+    while (buckets < 2 * max) {
+        buckets *= 2;
+    }
+    cache->buckets = (open_file_t **)calloc(buckets, sizeof(open_file_t *));
+    if (!cache->buckets) {
+        return -1;
+    }
+    cache->bucket_mask = buckets - 1;
+    return 0;
+}
+
+static void free_file(open_file_t *file) {
+    if (file->map && file->size > 0) {
+        munmap((void *)file->map, file->size);
+    }
+    if (file->fd >= 0) {
+        close(file->fd);
+    }
+    free(file->path);
+    free(file);
+}
+
+void open_file_retain(open_file_t *file) {
+    atomic_fetch_add_explicit(&file->refcount, 1, memory_order_relaxed);
+}
+
+void open_file_release(open_file_t *file) {
+    if (file && atomic_fetch_sub_explicit(&file->refcount, 1, memory_order_acq_rel) == 1) {
+        free_file(file);
+    }
+}
+
+/**
+ * @brief Cerca path nell'indice (lock preso).
+ */
+static open_file_t *find_locked(open_file_cache_t *cache, const char *path, uint64_t h) {
+    for (open_file_t *f = cache->buckets[h & cache->bucket_mask]; f; f = f->hash_next) {
+        if (f->hash == h && strcmp(f->path, path) == 0) {
+            return f;
+        }
+    }
+    return NULL;
+}
+
+static void lru_unlink(open_file_cache_t *cache, open_file_t *file) {
+    if (file->lru_prev) {
+        file->lru_prev->lru_next = file->lru_next;
+    } else {
+        cache->lru_head = file->lru_next;
+    }
+    if (file->lru_next) {
+        file->lru_next->lru_prev = file->lru_prev;
+    } else {
+        cache->lru_tail = file->lru_prev;
+    }
+    file->lru_prev = NULL;
+    file->lru_next = NULL;
+}
+
+static void lru_push_front(open_file_cache_t *cache, open_file_t *file) {
+    file->lru_prev = NULL;
+    file->lru_next = cache->lru_head;
+    if (cache->lru_head) {
+        cache->lru_head->lru_prev = file;
+    } else {
+        cache->lru_tail = file;
+    }
+    cache->lru_head = file;
+}
+
+/**
+ * @brief Toglie una voce dall'indice (lock preso) e rilascia il riferimento
+ *        dell'indice: se nessuno la sta servendo il file viene chiuso subito.
+ */
+static void unlink_file(open_file_cache_t *cache, open_file_t *file) {
+    open_file_t **link = &cache->buckets[file->hash & cache->bucket_mask];
+    while (*link != file) {
+        link = &(*link)->hash_next;
+    }
+    *link = file->hash_next;
+    file->hash_next = NULL;
+    lru_unlink(cache, file);
+    file->linked = false;
+    cache->count--;
+    open_file_release(file);
+}
+
+/**
+ * @brief Inserisce una voce appena creata (lock preso), sostituendo quella
+ *        con lo stesso path e chiudendo le meno usate oltre il limite.
+ */
+static void insert_locked(open_file_cache_t *cache, open_file_t *file) {
+    open_file_t *old = find_locked(cache, file->path, file->hash);
+    if (old) {
+        unlink_file(cache, old);
+    }
+    while (cache->count >= cache->max && cache->lru_tail) {
+        unlink_file(cache, cache->lru_tail);
+    }
+    open_file_t **bucket = &cache->buckets[file->hash & cache->bucket_mask];
+    file->hash_next = *bucket;
+    *bucket = file;
+    lru_push_front(cache, file);
+    file->linked = true;
+    cache->count++;
+    open_file_retain(file); // riferimento dell'indice
+}
+
+/**
+ * @brief Chiude (lock preso) le voci meno usate ormai scadute, al massimo
+ *        qualche voce per chiamata: un file cancellato o non più richiesto
+ *        non resta aperto (con il suo spazio su disco) fino all'evizione LRU.
+ */
+static void expire_inactive(open_file_cache_t *cache, uint64_t now) {
+    for (int i = 0; i < 4 && cache->lru_tail && cache->lru_tail->expires_ms <= now; i++) {
+        unlink_file(cache, cache->lru_tail);
+    }
+}
+
+/**
+ * @brief Chiude i file in cache che nessuno sta servendo, per liberare fd
+ *        quando il processo ha esaurito i descrittori.
+ * @return true se almeno un file è stato chiuso.
+ */
+static bool close_idle_files(open_file_cache_t *cache) {
+    bool closed = false;
+    pthread_mutex_lock(&cache->lock);
+    open_file_t *file = cache->lru_tail;
+    while (file) {
+        open_file_t *prev = file->lru_prev;
+        if (file->fd >= 0 && atomic_load_explicit(&file->refcount, memory_order_relaxed) == 1) {
+            unlink_file(cache, file);
+            closed = true;
+        }
+        file = prev;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return closed;
+}
+
+/**
+ * @brief true se l'esito negativo di open() dipende solo dal path e si può
+ *        quindi ricordare (non ad es. EMFILE o EINTR).
+ */
+static bool is_cacheable_error(int error) {
+    return error == ENOENT || error == ENOTDIR || error == EACCES || error == EISDIR ||
+           error == ENAMETOOLONG || error == ELOOP;
+}
+
+/**
+ * @brief Suggerisce al kernel una lettura sequenziale e chiede in anticipo
+ *        l'inizio del file, così il primo sendfile()/pread() trova già le pagine.
+ */
+static size_t advise_readahead(int fd, size_t size) {
+    size_t len = size < OPEN_FILE_READAHEAD_MAX ? size : OPEN_FILE_READAHEAD_MAX;
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if (len > 0) {
+        posix_fadvise(fd, 0, (off_t)len, POSIX_FADV_WILLNEED);
+    }
+    return len;
+#elif defined(F_RDAHEAD)
+    fcntl(fd, F_RDAHEAD, 1);
+    return len;
+#else
+    (void)fd;
+    (void)len;
+    return 0;
+#endif
+}
+
+/**
+ * @brief Apre path e crea la voce corrispondente (negativa se l'open fallisce
+ *        o il path non è un file regolare), con un riferimento per il chiamante.
+ * @param cacheable impostato a false se l'esito non va ricordato.
+ */
+static open_file_t *open_new(open_file_cache_t *cache, const char *path, uint64_t h,
+                             uint64_t now, unsigned long generation, bool *cacheable) {
+    open_file_t *file = (open_file_t *)calloc(1, sizeof(*file));
+    if (!file) {
+        return NULL;
+    }
+    file->path = strdup(path);
+    if (!file->path) {
+        free(file);
+        return NULL;
+    }
+    file->hash = h;
+    file->generation = generation;
+    atomic_init(&file->refcount, 1);
+
+    file->fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (file->fd < 0 && (errno == EMFILE || errno == ENFILE) && close_idle_files(cache)) {
+        file->fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    }
+    struct stat st;
+    if (file->fd >= 0 && fstat(file->fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        file->size = (size_t)st.st_size;
+        file->mtime = st.st_mtime;
+        file->ino = st.st_ino;
+        file->dev = st.st_dev;
+        file->readahead = advise_readahead(file->fd, file->size);
+        file->expires_ms = now + OPEN_FILE_VALID_MS;
+        *cacheable = true;
+        return file;
+    }
+
+    // Voce negativa: directory, file speciali o open() fallita
+    file->error = file->fd >= 0 ? EISDIR : errno;
+    if (file->fd >= 0) {
+        close(file->fd);
+        file->fd = -1;
+    }
+    file->expires_ms = now + OPEN_FILE_NEGATIVE_TTL_MS;
+    *cacheable = is_cacheable_error(file->error);
+    return file;
+}
+
+/**
+ * @brief true se il file su disco è ancora quello aperto nella voce (stessi
+ *        inode, dimensione e data di modifica).
+ */
+static bool still_same(const open_file_t *file) {
+    struct stat st;
+    return stat(file->path, &st) == 0 && st.st_ino == file->ino && st.st_dev == file->dev &&
+           (size_t)st.st_size == file->size && st.st_mtime == file->mtime;
+}
+
+open_file_t *open_file_get(open_file_cache_t *cache, const char *path, unsigned long generation) {
+    uint64_t now = timer_now_ms();
+    uint64_t h = hash_path(path);
+    bool cacheable = false;
+
+    if (cache->max == 0) {
+        return open_new(cache, path, h, now, generation, &cacheable);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    expire_inactive(cache, now);
+    open_file_t *file = find_locked(cache, path, h);
+    if (file) {
+        open_file_retain(file);
+        if (now < file->expires_ms && file->generation == generation) {
+            lru_unlink(cache, file);
+            lru_push_front(cache, file);
+            pthread_mutex_unlock(&cache->lock);
+            atomic_fetch_add_explicit(&cache->hits, 1, memory_order_relaxed);
+            return file;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    atomic_fetch_add_explicit(&cache->misses, 1, memory_order_relaxed);
+
+    // Voce scaduta: se il file non è cambiato basta una stat() per tenerla
+    if (file && file->fd >= 0 && still_same(file)) {
+        pthread_mutex_lock(&cache->lock);
+        if (file->linked) {
+            file->expires_ms = now + OPEN_FILE_VALID_MS;
+            file->generation = generation;
+            lru_unlink(cache, file);
+            lru_push_front(cache, file);
+        }
+        pthread_mutex_unlock(&cache->lock);
+        return file;
+    }
+    open_file_release(file);
+
+    file = open_new(cache, path, h, now, generation, &cacheable);
+    if (file && cacheable) {
+        pthread_mutex_lock(&cache->lock);
+        insert_locked(cache, file);
+        pthread_mutex_unlock(&cache->lock);
+    }
+    return file;
+}
+
+open_file_t *open_file_map(const char *path) {
+    open_file_t *file = (open_file_t *)calloc(1, sizeof(*file));
+    if (!file) {
+        return NULL;
+    }
+    atomic_init(&file->refcount, 1);
+    file->fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (file->fd < 0 || fstat(file->fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        int saved = file->fd >= 0 ? EINVAL : errno;
+        open_file_release(file);
+        errno = saved;
+        return NULL;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, file->fd, 0);
+    if (map == MAP_FAILED) {
+        int saved = errno;
+        open_file_release(file);
+        errno = saved;
+        return NULL;
+    }
+    file->map = (const char *)map;
+    file->size = (size_t)st.st_size;
+    file->mtime = st.st_mtime;
+    file->ino = st.st_ino;
+    file->dev = st.st_dev;
+    return file;
+}
+
+void open_file_cache_destroy(open_file_cache_t *cache) {
+    pthread_mutex_lock(&cache->lock);
+    while (cache->lru_tail) {
+        unlink_file(cache, cache->lru_tail);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    free(cache->buckets);
+    cache->buckets = NULL;
+    pthread_mutex_destroy(&cache->lock);
+}
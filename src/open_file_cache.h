@@ -0,0 +1,114 @@
+#ifndef OPEN_FILE_CACHE_H
+#define OPEN_FILE_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+
+#define OPEN_FILE_CACHE_DEFAULT_MAX 256     // voci (file aperti e "non trovato") per worker
+#define OPEN_FILE_VALID_MS 10000            // dopo quanto una voce viene ricontrollata con stat()
+#define OPEN_FILE_NEGATIVE_TTL_MS 1000      // durata di un "non trovato"
+#define OPEN_FILE_READAHEAD_MAX (1024 * 1024) // byte chiesti in anticipo al kernel alla prima apertura
+
+/**
+ * @brief Voce della cache dei file aperti: il file descriptor con i metadati
+ *        letti all'apertura, oppure (fd < 0) l'esito negativo dell'open().
+ *        I campi pubblici non cambiano dopo l'inserimento; la voce resta valida
+ *        finché il chiamante non la rilascia con open_file_release(), anche se
+ *        nel frattempo viene sostituita o esce dalla cache (l'fd si chiude
+ *        con l'ultimo riferimento).
+ */
+typedef struct open_file {
+    int fd;                 // -1 per le voci negative
+    int error;              // errno dell'apertura fallita (voci negative)
+    size_t size;
+    time_t mtime;
+    ino_t ino;
+    dev_t dev;
+    size_t readahead;       // byte già chiesti al kernel con posix_fadvise()
+    const char *map;        // contenuto mappato in sola lettura (solo open_file_map()), o NULL
+
+    // Campi interni
+    char *path;
+    uint64_t hash;
+    uint64_t expires_ms;    // oltre questo istante va rivalidata
+    unsigned long generation; // generazione della file cache alla validazione
+    atomic_uint refcount;   // uno dell'indice (se linked) più uno per lettore
+    bool linked;
+    struct open_file *hash_next;
+    struct open_file *lru_prev; // verso le voci usate più di recente
+    struct open_file *lru_next;
+} open_file_t;
+
+/**
+ * @brief Cache dei file aperti di un processo worker (i file descriptor non
+ *        si condividono tra processi), usata da tutti i thread del pool.
+ *
+ *        - Un hit non fa nessuna syscall: niente open()/fstat()/close() per i
+ *          file serviti con sendfile() e per le risposte 304.
+ *        - Anche i "non trovato" restano in cache per OPEN_FILE_NEGATIVE_TTL_MS,
+ *          così una raffica di 404 sullo stesso path costa un solo open().
+ *        - Le voci vengono ricontrollate con una stat() dopo OPEN_FILE_VALID_MS
+ *          oppure appena cambia la generazione della file cache (cioè il
+ *          watcher ha visto modificare qualcosa nella document root).
+ *        - Al massimo max voci: oltre, si chiude la meno usata di recente (LRU);
+ *          le voci scadute in fondo alla lista vengono chiuse anche prima.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    open_file_t **buckets;
+    uint32_t bucket_mask;
+    open_file_t *lru_head;  // usata più di recente
+    open_file_t *lru_tail;
+    unsigned count;
+    unsigned max;           // 0 = cache disabilitata (ogni richiesta apre il file)
+
+    atomic_ulong hits;
+    atomic_ulong misses;
+} open_file_cache_t;
+
+/**
+ * @brief Inizializza una cache di al massimo max voci (0 per disabilitarla).
+ * @return 0 se ok, -1 in caso di errore.
+ */
+int open_file_cache_init(open_file_cache_t *cache, unsigned max);
+
+/**
+ * @brief Restituisce il file path, dalla cache se ancora valido per la
+ *        generazione indicata (vedi file_cache_generation()), altrimenti
+ *        aprendolo. I path che non sono file regolari danno una voce negativa.
+ *        Il path è la chiave così com'è: il chiamante lo riduce prima alla
+ *        forma canonica; un link simbolico resta una voce distinta dal file
+ *        a cui punta (risolverlo costerebbe una syscall a ogni hit).
+ * @return la voce con un riferimento da rilasciare con open_file_release(),
+ *         oppure NULL se manca la memoria.
+ */
+open_file_t *open_file_get(open_file_cache_t *cache, const char *path, unsigned long generation);
+
+/**
+ * @brief Apre path e lo mappa in memoria in sola lettura, fuori dalla cache
+ *        (ad es. il bundle degli asset): i segmenti in uscita ne inviano i
+ *        byte direttamente dalla mappa, oppure con sendfile() dal file.
+ * @return la voce con un riferimento, oppure NULL (errno impostato).
+ */
+open_file_t *open_file_map(const char *path);
+
+/**
+ * @brief Aggiunge un riferimento a una voce di cui il chiamante ne possiede già uno.
+ */
+void open_file_retain(open_file_t *file);
+
+/**
+ * @brief Rilascia un riferimento (NULL ammesso); l'ultimo chiude il file.
+ */
+void open_file_release(open_file_t *file);
+
+/**
+ * @brief Chiude tutti i file in cache e libera la memoria.
+ */
+void open_file_cache_destroy(open_file_cache_t *cache);
+
+#endif // OPEN_FILE_CACHE_H
@@ -0,0 +1,429 @@
+#include "output_queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#ifndef __APPLE__
+#include <sys/sendfile.h>
+#endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/sockios.h> // SIOCOUTQ
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // macOS: niente flag, il SIGPIPE va gestito con SO_NOSIGPIPE
+#endif
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
+
+#define OUTPUT_INITIAL_BUFFER 1024
+#define OUTPUT_INITIAL_SEGMENTS 8
+#define OUTPUT_INITIAL_PINS 4
+#define OUTPUT_READ_CHUNK (16 * 1024) // blocco di lettura quando sendfile non è abilitato
+
+extern file_cache_t g_file_cache;   // definita altrove
+extern bool g_enable_zerocopy;      // definito in main.c
+extern bool g_verbose;              // definito in main.c
+
+void output_queue_init(output_queue_t *q) {
+    memset(q, 0, sizeof(*q));
+}
+
+/**
+ * @brief Rilascia le risorse di un segmento (riferimento alla cache o file).
+ */
+static void release_segment(output_segment_t *seg) {
+    if (seg->type == OUT_SEG_CACHE) {
+        file_cache_release(&g_file_cache, seg->entry);
+    } else if (seg->type == OUT_SEG_FILE) {
+        open_file_release(seg->file);
+    }
+}
+
+/**
+ * @brief Rilascia le risorse dei segmenti non inviati e svuota la coda.
+ */
+static void output_queue_reset(output_queue_t *q) {
+    for (int i = q->seg_head; i < q->seg_count; i++) {
+        release_segment(&q->segs[i]);
+    }
+    q->seg_head = 0;
+    q->seg_count = 0;
+    q->buf_len = 0;
+    q->bytes = 0;
+}
+
+void output_queue_free(output_queue_t *q) {
+    output_queue_reset(q);
+    for (int i = 0; i < q->pin_count; i++) {
+        file_cache_release(&g_file_cache, q->pins[i].entry);
+    }
+    free(q->buf);
+    free(q->segs);
+    free(q->pins);
+    memset(q, 0, sizeof(*q));
+}
+
+/**
+ * @brief Trattiene la voce di un segmento inviato con sendfile() finché il
+ *        client non ha confermato i byte fino alla posizione corrente. Dove non
+ *        si può sapere (niente SIOCOUTQ) la voce viene rilasciata subito.
+ */
+static void pin_entry(output_queue_t *q, file_cache_entry_t *entry) {
+#ifdef SIOCOUTQ
+    if (q->pin_count == q->pin_cap) {
+        int new_cap = q->pin_cap ? q->pin_cap * 2 : OUTPUT_INITIAL_PINS;
+        output_pin_t *tmp = (output_pin_t *)realloc(q->pins, (size_t)new_cap * sizeof(*tmp));
+        if (!tmp) {
+            file_cache_release(&g_file_cache, entry);
+            return;
+        }
+        q->pins = tmp;
+        q->pin_cap = new_cap;
+    }
+    q->pins[q->pin_count].entry = entry;
+    q->pins[q->pin_count].end = q->sent;
+    q->pin_count++;
+#else
+    (void)q;
+    file_cache_release(&g_file_cache, entry);
+#endif
+}
+
+/**
+ * @brief Rilascia le voci trattenute i cui byte sono già stati confermati:
+ *        SIOCOUTQ dà i byte ancora nella coda di invio del socket.
+ */
+static void release_acked_pins(output_queue_t *q, int client_fd) {
+#ifdef SIOCOUTQ
+    int unacked;
+    if (q->pin_count == 0 || ioctl(client_fd, SIOCOUTQ, &unacked) < 0) {
+        return;
+    }
+    unsigned long long acked = q->sent - (unsigned long long)unacked;
+    q->acked = acked;
+    int done = 0;
+    while (done < q->pin_count && q->pins[done].end <= acked) {
+        file_cache_release(&g_file_cache, q->pins[done].entry);
+        done++;
+    }
+    q->pin_count -= done;
+    memmove(q->pins, q->pins + done, (size_t)q->pin_count * sizeof(*q->pins));
+#else
+    (void)q;
+    (void)client_fd;
+#endif
+}
+
+bool output_queue_pinned(const output_queue_t *q) {
+    return q->pin_count > 0;
+}
+
+/**
+ * @brief Riserva un nuovo segmento in coda.
+ * @return il segmento, oppure NULL se memoria esaurita.
+ */
+static output_segment_t *push_segment(output_queue_t *q) {
+    if (q->seg_count == q->seg_cap) {
+        int new_cap = q->seg_cap ? q->seg_cap * 2 : OUTPUT_INITIAL_SEGMENTS;
+        output_segment_t *tmp = (output_segment_t *)realloc(q->segs, (size_t)new_cap * sizeof(*tmp));
+        if (!tmp) {
+            return NULL;
+        }
+        q->segs = tmp;
+        q->seg_cap = new_cap;
+    }
+    output_segment_t *seg = &q->segs[q->seg_count++];
+    memset(seg, 0, sizeof(*seg));
+    return seg;
+}
+
+int output_queue_append(output_queue_t *q, const void *data, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    if (q->buf_cap - q->buf_len < len) {
+        size_t new_cap = q->buf_cap ? q->buf_cap : OUTPUT_INITIAL_BUFFER;
+        while (new_cap - q->buf_len < len) {
+            new_cap *= 2;
+        }
+        char *tmp = (char *)realloc(q->buf, new_cap);
+        if (!tmp) {
+            return -1;
+        }
+        q->buf = tmp;
+        q->buf_cap = new_cap;
+    }
+
+    // Byte contigui al segmento precedente: lo allunghiamo invece di aggiungerne uno
+    output_segment_t *last = q->seg_count > 0 ? &q->segs[q->seg_count - 1] : NULL;
+    if (!last || last->type != OUT_SEG_BUFFER || (size_t)last->offset + last->len != q->buf_len) {
+        last = push_segment(q);
+        if (!last) {
+            return -1;
+        }
+        last->type = OUT_SEG_BUFFER;
+        last->offset = (off_t)q->buf_len;
+    }
+    memcpy(q->buf + q->buf_len, data, len);
+    q->buf_len += len;
+    last->len += len;
+    q->bytes += len;
+    return 0;
+}
+
+int output_queue_append_cache(output_queue_t *q, file_cache_entry_t *entry, const char *data, size_t len) {
+    output_segment_t *seg = push_segment(q);
+    if (!seg) {
+        file_cache_release(&g_file_cache, entry);
+        return -1;
+    }
+    seg->type = OUT_SEG_CACHE;
+    seg->entry = entry;
+    seg->data = data;
+    seg->len = len;
+    q->bytes += len;
+    return 0;
+}
+
+int output_queue_append_file(output_queue_t *q, open_file_t *file, off_t offset, size_t len) {
+    output_segment_t *seg = push_segment(q);
+    if (!seg) {
+        open_file_release(file);
+        return -1;
+    }
+    seg->type = OUT_SEG_FILE;
+    seg->file = file;
+    seg->offset = offset;
+    seg->len = len;
+    q->bytes += len;
+    return 0;
+}
+
+bool output_queue_full(const output_queue_t *q) {
+    return q->seg_count - q->seg_head >= OUTPUT_QUEUE_MAX_SEGMENTS || q->bytes >= OUTPUT_QUEUE_MAX_BYTES;
+}
+
+size_t output_queue_bytes(const output_queue_t *q) {
+    return q->bytes;
+}
+
+/**
+ * @brief Segna come inviati n byte dalla testa della coda: i segmenti completati
+ *        vengono rilasciati, quello a metà avanza di offset.
+ */
+static void consume(output_queue_t *q, size_t n) {
+    q->bytes -= n;
+    q->sent += n;
+    while (q->seg_head < q->seg_count) {
+        output_segment_t *seg = &q->segs[q->seg_head];
+        if (n < seg->len) {
+            if (seg->type == OUT_SEG_CACHE) {
+                seg->data += n;
+            } else {
+                seg->offset += (off_t)n;
+            }
+            seg->len -= n;
+            return;
+        }
+        n -= seg->len;
+        if (seg->type == OUT_SEG_CACHE && seg->spliced) {
+            pin_entry(q, seg->entry);
+        } else {
+            release_segment(seg);
+        }
+        q->seg_head++;
+    }
+}
+
+/**
+ * @brief Sposta all'inizio i segmenti ancora da inviare e, se la parte già
+ *        inviata del buffer è più della metà, anche i loro byte: una coda
+ *        che non si svuota mai del tutto (client lento in pipeline) non cresce.
+ */
+static void compact(output_queue_t *q) {
+    if (q->seg_head > 0) {
+        q->seg_count -= q->seg_head;
+        memmove(q->segs, q->segs + q->seg_head, (size_t)q->seg_count * sizeof(*q->segs));
+        q->seg_head = 0;
+    }
+
+    size_t sent = q->buf_len;
+    for (int i = 0; i < q->seg_count; i++) {
+        if (q->segs[i].type == OUT_SEG_BUFFER) {
+            sent = (size_t)q->segs[i].offset; // gli offset crescono lungo la coda
+            break;
+        }
+    }
+    if (sent > 0 && sent >= q->buf_len / 2) {
+        q->buf_len -= sent;
+        memmove(q->buf, q->buf + sent, q->buf_len);
+        for (int i = 0; i < q->seg_count; i++) {
+            if (q->segs[i].type == OUT_SEG_BUFFER) {
+                q->segs[i].offset -= (off_t)sent;
+            }
+        }
+    }
+}
+
+/**
+ * @brief true se il segmento parte con sendfile() invece che con sendmsg().
+ */
+static bool uses_sendfile(const output_segment_t *seg, int cache_fd) {
+    if (!g_enable_zerocopy) {
+        return false;
+    }
+    if (seg->type == OUT_SEG_FILE) {
+        // Un file mappato (bundle) sotto la soglia parte dalla memoria come la cache
+        return !seg->file->map || seg->len >= ZEROCOPY_MIN_SIZE;
+    }
+    // Contenuto grande della cache: sendfile() direttamente dal memfd
+    return seg->type == OUT_SEG_CACHE && cache_fd >= 0 && seg->len >= ZEROCOPY_MIN_SIZE;
+}
+
+/**
+ * @brief Invia i segmenti in memoria in iov e poi il segmento seg con sendfile().
+ *        Su Linux i segmenti partono da soli con MSG_MORE, così il kernel li
+ *        accoda al primo blocco del file (che parte alla chiamata successiva);
+ *        su macOS viaggiano nella stessa chiamata sendfile() tramite sf_hdtr.
+ *        Un segmento della cache viene marcato spliced solo quando sendfile()
+ *        ne ha davvero inviato dei byte (non per i soli segmenti in memoria).
+ * @return byte inviati (segmenti in memoria compresi), 0 se il file è più
+ *         corto del previsto, -1 con errno in caso di errore o socket pieno.
+ */
+static ssize_t send_file_segment(int out_fd, output_segment_t *seg, int cache_fd,
+                                 struct iovec *iov, int iovcnt) {
+    int in_fd = seg->type == OUT_SEG_FILE ? seg->file->fd : cache_fd;
+    off_t offset = seg->type == OUT_SEG_FILE ? seg->offset : file_cache_offset(&g_file_cache, seg->data);
+#ifdef __APPLE__
+    // macOS signature: int sendfile(int fd, int s, off_t offset, off_t *len, struct sf_hdtr *hdtr, int flags);
+    // Con socket non bloccante len restituisce i byte inviati (header compresi) anche in caso di EAGAIN
+    struct sf_hdtr hdtr = { iov, iovcnt, NULL, 0 };
+    off_t len = (off_t)seg->len;
+    int rc = sendfile(in_fd, out_fd, offset, &len, iovcnt > 0 ? &hdtr : NULL, 0);
+    if (rc < 0 && len == 0) {
+        return -1;
+    }
+    size_t header_len = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        header_len += iov[i].iov_len;
+    }
+    if (seg->type == OUT_SEG_CACHE && (size_t)len > header_len) {
+        seg->spliced = true;
+    }
+    return (ssize_t)len;
+#else
+    if (iovcnt > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        return sendmsg(out_fd, &msg, MSG_MORE | MSG_NOSIGNAL);
+    }
+    ssize_t n = sendfile(out_fd, in_fd, &offset, seg->len);
+    if (seg->type == OUT_SEG_CACHE && n > 0) {
+        seg->spliced = true;
+    }
+    return n;
+#endif
+}
+
+bool output_queue_in_flight(output_queue_t *q, int client_fd) {
+    unsigned long long before = q->acked;
+    release_acked_pins(q, client_fd);
+    return q->pin_count > 0 && q->acked > before;
+}
+
+int output_queue_flush(output_queue_t *q, int client_fd) {
+    // Un posto in più per il blocco di file letto quando sendfile non è abilitato
+    struct iovec iov[OUTPUT_QUEUE_MAX_SEGMENTS + 1];
+    char chunk[OUTPUT_READ_CHUNK];
+    int cache_fd = file_cache_fd(&g_file_cache);
+    size_t total = 0;
+
+    release_acked_pins(q, client_fd);
+
+    while (1) {
+        consume(q, 0); // scarta i segmenti vuoti in testa
+        if (q->seg_head == q->seg_count) {
+            break;
+        }
+
+        // Segmenti consecutivi in memoria, fino al primo da inviare con sendfile()
+        int iovcnt = 0;
+        output_segment_t *file_seg = NULL;
+        for (int i = q->seg_head; i < q->seg_count && iovcnt < OUTPUT_QUEUE_MAX_SEGMENTS; i++) {
+            output_segment_t *seg = &q->segs[i];
+            if (seg->len == 0) {
+                continue;
+            }
+            if (uses_sendfile(seg, cache_fd)) {
+                file_seg = seg;
+                break;
+            }
+            if (seg->type == OUT_SEG_FILE && seg->file->map) {
+                iov[iovcnt].iov_base = (void *)(seg->file->map + seg->offset);
+                iov[iovcnt].iov_len = seg->len;
+                iovcnt++;
+                continue;
+            }
+            if (seg->type == OUT_SEG_FILE) {
+                // Senza sendfile: un blocco letto con pread() parte insieme ai segmenti precedenti
+                ssize_t n;
+                do {
+                    n = pread(seg->file->fd, chunk, seg->len < sizeof(chunk) ? seg->len : sizeof(chunk), seg->offset);
+                } while (n < 0 && errno == EINTR);
+                if (n <= 0) {
+                    return -1; // errore, oppure file più corto del previsto
+                }
+                iov[iovcnt].iov_base = chunk;
+                iov[iovcnt].iov_len = (size_t)n;
+                iovcnt++;
+                break;
+            }
+            iov[iovcnt].iov_base = seg->type == OUT_SEG_BUFFER ? q->buf + seg->offset : (void *)seg->data;
+            iov[iovcnt].iov_len = seg->len;
+            iovcnt++;
+        }
+
+        ssize_t n;
+        if (file_seg) {
+            n = send_file_segment(client_fd, file_seg, cache_fd, iov, iovcnt);
+        } else {
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iovcnt;
+            n = sendmsg(client_fd, &msg, MSG_NOSIGNAL);
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Socket pieno: si riprende da qui quando torna scrivibile
+                compact(q);
+                return 0;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            return -1; // file più corto del previsto
+        }
+        consume(q, (size_t)n);
+        total += (size_t)n;
+    }
+
+    // log
+    if (g_verbose && total > 0) {
+        printf("[response] Inviati %zu bytes a fd=%d\n", total, client_fd);
+    }
+
+    output_queue_reset(q);
+    return 1;
+}
@@ -0,0 +1,138 @@
+#ifndef OUTPUT_QUEUE_H
+#define OUTPUT_QUEUE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "file_cache.h"
+#include "open_file_cache.h"
+
+#define OUTPUT_QUEUE_MAX_SEGMENTS 64    // oltre questo numero la coda viene svuotata subito
+#define OUTPUT_QUEUE_MAX_BYTES (256 * 1024) // byte in coda oltre i quali non si servono altre richieste
+#define ZEROCOPY_MIN_SIZE (16 * 1024)   // sotto questa soglia una writev() costa meno di sendfile
+
+/**
+ * @brief Tipi di segmento accodabili in uscita.
+ */
+typedef enum {
+    OUT_SEG_BUFFER, // byte copiati nel buffer della coda (header, risposte brevi)
+    OUT_SEG_CACHE,  // porzione di memoria di una voce della cache (riferimento)
+    OUT_SEG_FILE    // porzione di un file aperto (cache dei file aperti), inviata con
+                    // sendfile(), oppure dalla memoria se il file è mappato (bundle)
+} output_segment_type_t;
+
+typedef struct {
+    output_segment_type_t type;
+    off_t offset;               // BUFFER: offset in buf; FILE: offset nel file
+    size_t len;                 // byte ancora da inviare (offset/data avanzano con l'invio)
+    file_cache_entry_t *entry;  // OUT_SEG_CACHE: riferimento rilasciato dopo l'invio
+    const char *data;           // OUT_SEG_CACHE: inizio dei dati (contenuto o header della voce)
+    open_file_t *file;          // OUT_SEG_FILE: riferimento rilasciato dopo l'invio
+    bool spliced;               // OUT_SEG_CACHE: inviato (anche in parte) con sendfile() dal memfd
+} output_segment_t;
+
+/**
+ * @brief Voce della cache inviata con sendfile(): il socket ne referenzia le
+ *        pagine finché i byte non sono confermati dal client, quindi la voce
+ *        non può essere liberata (e la sua memoria riusata) prima.
+ */
+typedef struct {
+    file_cache_entry_t *entry;
+    unsigned long long end;     // posizione nello stream dopo l'ultimo byte della voce
+} output_pin_t;
+
+/**
+ * @brief Coda delle risposte di una connessione. Le risposte di più richieste
+ *        (pipelining) vengono accodate e poi inviate insieme: i segmenti in
+ *        memoria consecutivi partono con un'unica writev(), i file con sendfile().
+ *
+ *        L'invio non blocca mai: quando il socket è pieno la coda ricorda fin
+ *        dove è arrivata (segmento e offset) e riprende da lì quando il socket
+ *        torna scrivibile. Un client lento costa la memoria della coda, non un thread.
+ */
+typedef struct {
+    char *buf;
+    size_t buf_len;
+    size_t buf_cap;
+
+    output_segment_t *segs;
+    int seg_head;               // primo segmento non ancora inviato del tutto
+    int seg_count;
+    int seg_cap;
+    size_t bytes;               // byte ancora da inviare
+
+    unsigned long long sent;    // byte scritti sul socket dall'apertura
+    unsigned long long acked;   // ... di cui confermati dal client (all'ultimo controllo)
+    output_pin_t *pins;         // voci inviate con sendfile() in attesa di conferma, per end crescente
+    int pin_count;
+    int pin_cap;
+} output_queue_t;
+
+/**
+ * @brief Inizializza una coda vuota.
+ */
+void output_queue_init(output_queue_t *q);
+
+/**
+ * @brief Scarta i segmenti non inviati, rilascia le voci trattenute e libera la memoria.
+ *        Con voci ancora trattenute (output_queue_pinned()) il socket va chiuso
+ *        solo dopo che le ha confermate, oppure con un reset che scarta la sua
+ *        coda di invio: altrimenti il kernel potrebbe ancora trasmettere
+ *        pagine del memfd già riassegnate a un'altra voce.
+ */
+void output_queue_free(output_queue_t *q);
+
+/**
+ * @brief Accoda len byte copiandoli nel buffer della coda.
+ * @return 0 se ok, -1 se memoria esaurita.
+ */
+int output_queue_append(output_queue_t *q, const void *data, size_t len);
+
+/**
+ * @brief Accoda len byte da data, memoria della voce entry nella cache (il
+ *        contenuto o il blocco header), senza copiarli. La coda prende possesso
+ *        del riferimento alla voce.
+ * @return 0 se ok, -1 se memoria esaurita (il riferimento viene rilasciato).
+ */
+int output_queue_append_cache(output_queue_t *q, file_cache_entry_t *entry, const char *data, size_t len);
+
+/**
+ * @brief Accoda len byte di un file aperto, da offset. La coda prende possesso
+ *        del riferimento alla voce della cache dei file aperti.
+ * @return 0 se ok, -1 se memoria esaurita (il riferimento viene rilasciato).
+ */
+int output_queue_append_file(output_queue_t *q, open_file_t *file, off_t offset, size_t len);
+
+/**
+ * @brief true se la coda ha raggiunto OUTPUT_QUEUE_MAX_SEGMENTS segmenti o
+ *        OUTPUT_QUEUE_MAX_BYTES byte: prima di accodare altre risposte va svuotata.
+ */
+bool output_queue_full(const output_queue_t *q);
+
+/**
+ * @brief Byte accodati e non ancora inviati.
+ */
+size_t output_queue_bytes(const output_queue_t *q);
+
+/**
+ * @brief Rilascia le voci trattenute già confermate dal client.
+ * @return true se ne restano e il client ha confermato altri byte dalla
+ *         chiamata precedente: sta ancora ricevendo, chiudere ora
+ *         troncherebbe (o corromperebbe) dati inviati con sendfile().
+ */
+bool output_queue_in_flight(output_queue_t *q, int client_fd);
+
+/**
+ * @brief true se restano voci inviate con sendfile() non ancora confermate dal client.
+ */
+bool output_queue_pinned(const output_queue_t *q);
+
+/**
+ * @brief Invia quanto più possibile sul socket non bloccante, riprendendo da
+ *        dove si era fermata la chiamata precedente (anche a metà di un file).
+ * @return 1 se la coda è vuota, 0 se il socket è pieno e restano dati (da
+ *         riprovare quando torna scrivibile), -1 in caso di errore (la coda va liberata).
+ */
+int output_queue_flush(output_queue_t *q, int client_fd);
+
+#endif // OUTPUT_QUEUE_H
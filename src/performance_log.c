@@ -1,27 +1,329 @@
 #include "performance_log.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <time.h>
+#include <sys/stat.h>
+#include <sys/file.h>
 
-static FILE *g_perf_log_file = NULL;
+#define PERF_LOG_PATH_MAX 256      // nome del file di log
+#define PERF_LOG_RECORD_PATH_MAX 1024 // byte del percorso copiati per record
+#define PERF_LOG_TEXT_SIZE (PERF_LOG_RING_SIZE * 64) // area dei percorsi per ring (potenza di 2)
+#define PERF_LOG_BUFFER (64 * 1024) // testo accumulato prima di una write()
+#define PERF_LOG_LINE_MAX (PERF_LOG_RECORD_PATH_MAX + 128)
+
+/**
+ * @brief Record binario scritto dai thread del pool (32 byte).
+ */
+typedef struct {
+    uint64_t timestamp_ns; // CLOCK_REALTIME alla fine della risposta
+    uint64_t latency_ns;
+    uint64_t bytes;
+    uint32_t path_end;     // posizione in text dopo l'ultimo byte del percorso
+    uint16_t path_len;
+    uint16_t status;
+} perf_record_t;
+
+/**
+ * @brief Ring SPSC di un thread: il thread avanza head, il flusher tail.
+ *        Gli indici stanno su linee di cache diverse. I percorsi dei record
+ *        sono copiati, nello stesso ordine, nell'area text (mai spezzati sul
+ *        bordo): il flusher la libera man mano che consuma i record.
+ */
+typedef struct log_ring {
+    perf_record_t records[PERF_LOG_RING_SIZE];
+    char text[PERF_LOG_TEXT_SIZE];
+    uint32_t text_head;                 // solo il thread: dove va il prossimo percorso
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+    atomic_uint text_tail;              // fine del percorso dell'ultimo record consumato
+    atomic_ulong dropped;
+    struct log_ring *next;
+} log_ring_t;
+
+static int g_log_fd = -1;
+static char g_log_name[PERF_LOG_PATH_MAX];
+static size_t g_max_bytes = PERF_LOG_DEFAULT_MAX_SIZE;
+static int g_max_age_sec = 0;
+static time_t g_opened_at;
+
+static _Atomic(log_ring_t *) g_rings = NULL;
+static __thread log_ring_t *t_ring = NULL;
+
+static pthread_t g_flusher;
+static bool g_flusher_running = false;
+static atomic_bool g_stop = false;
 
 void performance_log_init(const char *filename) {
-    g_perf_log_file = fopen(filename, "a");
-    if (!g_perf_log_file) {
-        perror("fopen performance_log");
+    snprintf(g_log_name, sizeof(g_log_name), "%s", filename);
+    g_log_fd = open(filename, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (g_log_fd < 0) {
+        perror("open performance_log");
+        return;
     }
+    g_opened_at = time(NULL);
 }
 
-void performance_log_record(const char *path, size_t size, double time_sec) {
-    if (!g_perf_log_file) return;
+void performance_log_set_rotation(size_t max_bytes, int max_age_sec) {
+    g_max_bytes = max_bytes;
+    g_max_age_sec = max_age_sec > 0 ? max_age_sec : 0;
+}
 
-    fprintf(g_perf_log_file, "FILE: %s SIZE: %zu TIME: %.4f sec\n", path, size, time_sec);
-    fflush(g_perf_log_file);
+/**
+ * @brief Ring del thread chiamante, creato e aggiunto alla lista al primo record.
+ */
+static log_ring_t *thread_ring(void) {
+    if (t_ring) {
+        return t_ring;
+    }
+    log_ring_t *ring = (log_ring_t *)aligned_alloc(64, sizeof(log_ring_t));
+    if (!ring) {
+        return NULL;
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->next = atomic_load_explicit(&g_rings, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&g_rings, &ring->next, ring,
+                                                  memory_order_release, memory_order_relaxed)) {
+    }
+    t_ring = ring;
+    return ring;
+}
+
+void performance_log_record(const char *path, size_t size, int status, uint64_t latency_ns) {
+    if (g_log_fd < 0) {
+        return;
+    }
+    log_ring_t *ring = thread_ring();
+    if (!ring) {
+        return;
+    }
+
+    // Il percorso va contiguo in text: se non ci sta prima del bordo si riparte dall'inizio
+    size_t len = strnlen(path, PERF_LOG_RECORD_PATH_MAX);
+    uint32_t start = ring->text_head;
+    uint32_t offset = start & (PERF_LOG_TEXT_SIZE - 1);
+    if (offset + len > PERF_LOG_TEXT_SIZE) {
+        start += PERF_LOG_TEXT_SIZE - offset;
+    }
+    uint32_t end = start + (uint32_t)len;
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t text_tail = atomic_load_explicit(&ring->text_tail, memory_order_acquire);
+    if (head - tail >= PERF_LOG_RING_SIZE || end - text_tail > PERF_LOG_TEXT_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    memcpy(ring->text + (start & (PERF_LOG_TEXT_SIZE - 1)), path, len);
+    ring->text_head = end;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    perf_record_t *r = &ring->records[head & (PERF_LOG_RING_SIZE - 1)];
+    r->timestamp_ns = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+    r->latency_ns = latency_ns;
+    r->bytes = size;
+    r->path_end = end;
+    r->path_len = (uint16_t)len;
+    r->status = (uint16_t)status;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * @brief Scrive tutto il buffer (write() parziali comprese).
+ */
+static void write_all(const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(g_log_fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+/**
+ * @brief Formatta un record come riga di testo.
+ */
+static size_t format_record(char *buf, size_t size, const log_ring_t *ring, const perf_record_t *r) {
+    // La parte data-ora cambia al più una volta al secondo
+    static time_t cached_sec = -1;
+    static char stamp[32];
+    time_t sec = (time_t)(r->timestamp_ns / 1000000000ull);
+    if (sec != cached_sec) {
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+        cached_sec = sec;
+    }
+
+    const char *path = ring->text + ((r->path_end - r->path_len) & (PERF_LOG_TEXT_SIZE - 1));
+    int n = snprintf(buf, size, "[%s.%03u] FILE: %.*s STATUS: %u SIZE: %llu TIME: %.6f sec\n",
+                     stamp, (unsigned)(r->timestamp_ns / 1000000 % 1000), (int)r->path_len, path,
+                     (unsigned)r->status,
+                     (unsigned long long)r->bytes, (double)r->latency_ns / 1e9);
+    return (n < 0 || (size_t)n >= size) ? 0 : (size_t)n;
+}
+
+/**
+ * @brief Svuota tutti i ring nel file: una write() ogni PERF_LOG_BUFFER byte di testo.
+ * @return true se è stato scritto qualcosa.
+ */
+static bool flush_rings(char *buf) {
+    size_t len = 0;
+    bool wrote = false;
+
+    for (log_ring_t *ring = atomic_load_explicit(&g_rings, memory_order_acquire); ring; ring = ring->next) {
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        while (tail != head) {
+            if (PERF_LOG_BUFFER - len < PERF_LOG_LINE_MAX) {
+                write_all(buf, len);
+                wrote = true;
+                len = 0;
+            }
+            const perf_record_t *r = &ring->records[tail & (PERF_LOG_RING_SIZE - 1)];
+            len += format_record(buf + len, PERF_LOG_BUFFER - len, ring, r);
+            tail++;
+            atomic_store_explicit(&ring->text_tail, r->path_end, memory_order_release);
+            atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        }
+
+        unsigned long dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+        if (dropped > 0) {
+            int n = snprintf(buf + len, PERF_LOG_BUFFER - len, "# %lu record scartati (ring pieno)\n", dropped);
+            if (n > 0 && (size_t)n < PERF_LOG_BUFFER - len) {
+                len += (size_t)n;
+            }
+        }
+    }
+
+    if (len > 0) {
+        write_all(buf, len);
+        wrote = true;
+    }
+    return wrote;
+}
+
+static void reopen_log(void) {
+    int fd = open(g_log_name, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("open performance_log");
+        return; // continuiamo sul file precedente
+    }
+    close(g_log_fd);
+    g_log_fd = fd;
+    g_opened_at = time(NULL);
+}
+
+/**
+ * @brief Ruota il file se troppo grande o troppo vecchio. Tutti i worker scrivono
+ *        sullo stesso file: la rinomina avviene sotto flock() e solo se il nome
+ *        punta ancora al nostro file; chi trova il nome su un file diverso
+ *        (ruotato da un altro processo) si limita a riaprirlo.
+ */
+static void maybe_rotate(void) {
+    struct stat st, named;
+    if (fstat(g_log_fd, &st) < 0) {
+        return;
+    }
+    if (stat(g_log_name, &named) < 0 || named.st_ino != st.st_ino || named.st_dev != st.st_dev) {
+        reopen_log();
+        return;
+    }
+
+    time_t now = time(NULL);
+    bool too_big = g_max_bytes > 0 && (size_t)st.st_size >= g_max_bytes;
+    bool too_old = g_max_age_sec > 0 && now - g_opened_at >= g_max_age_sec;
+    if (!too_big && !too_old) {
+        return;
+    }
+
+    if (flock(g_log_fd, LOCK_EX) < 0) {
+        return;
+    }
+    if (stat(g_log_name, &named) == 0 && named.st_ino == st.st_ino && named.st_dev == st.st_dev) {
+        char stamp[32];
+        char rotated[PERF_LOG_PATH_MAX + 48];
+        struct tm tm;
+        localtime_r(&now, &tm);
+        strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+        snprintf(rotated, sizeof(rotated), "%s.%s", g_log_name, stamp);
+        for (int i = 1; access(rotated, F_OK) == 0 && i < 100; i++) {
+            snprintf(rotated, sizeof(rotated), "%s.%s-%d", g_log_name, stamp, i);
+        }
+        if (rename(g_log_name, rotated) < 0) {
+            perror("rename performance_log");
+        }
+    }
+    flock(g_log_fd, LOCK_UN);
+    reopen_log();
+}
+
+/**
+ * @brief Thread di scrittura: ogni PERF_LOG_FLUSH_MS svuota i ring e controlla la rotazione.
+ */
+static void *flusher_thread(void *arg) {
+    (void)arg;
+    char *buf = (char *)malloc(PERF_LOG_BUFFER);
+    if (!buf) {
+        return NULL;
+    }
+    struct timespec interval = { PERF_LOG_FLUSH_MS / 1000, (PERF_LOG_FLUSH_MS % 1000) * 1000000L };
+
+    while (!atomic_load_explicit(&g_stop, memory_order_acquire)) {
+        nanosleep(&interval, NULL);
+        if (flush_rings(buf) || g_max_age_sec > 0) {
+            maybe_rotate();
+        }
+    }
+    flush_rings(buf);
+    free(buf);
+    return NULL;
+}
+
+int performance_log_start(void) {
+    if (g_log_fd < 0 || g_flusher_running) {
+        return g_log_fd < 0 ? -1 : 0;
+    }
+    atomic_store(&g_stop, false);
+    if (pthread_create(&g_flusher, NULL, flusher_thread, NULL) != 0) {
+        perror("pthread_create performance_log");
+        return -1;
+    }
+    g_flusher_running = true;
+    return 0;
+}
+
+void performance_log_stop(void) {
+    if (!g_flusher_running) {
+        return;
+    }
+    atomic_store(&g_stop, true);
+    pthread_join(g_flusher, NULL);
+    g_flusher_running = false;
 }
 
 void performance_log_close() {
-    if (g_perf_log_file) {
-        fclose(g_perf_log_file);
-        g_perf_log_file = NULL;
+    performance_log_stop();
+    log_ring_t *ring = atomic_exchange(&g_rings, NULL);
+    while (ring) {
+        log_ring_t *next = ring->next;
+        free(ring);
+        ring = next;
+    }
+    if (g_log_fd >= 0) {
+        close(g_log_fd);
+        g_log_fd = -1;
     }
 }
@@ -2,17 +2,50 @@
 #define PERFORMANCE_LOG_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 
+#define PERF_LOG_RING_SIZE 4096               // record per thread (potenza di 2)
+#define PERF_LOG_FLUSH_MS 200                 // intervallo del thread di scrittura
+#define PERF_LOG_DEFAULT_MAX_SIZE (64UL << 20) // rotazione oltre questa dimensione (0 = mai)
+
+/**
+ * Log delle richieste servite, fuori dal percorso critico: ogni thread scrive
+ * record binari di dimensione fissa in un proprio ring, copiando il percorso
+ * in un'area di testo dello stesso ring (senza lock né syscall);
+ * un thread per processo worker li formatta come testo e li aggiunge al file
+ * con una sola write() ogni PERF_LOG_FLUSH_MS. Se il ring è pieno il record
+ * viene scartato e contato.
+ */
+
 /**
- * @brief Inizializza il log delle performance (ad es. apre file).
+ * @brief Apre il file di log (in append). Va chiamata nel master prima del fork.
  */
 void performance_log_init(const char *filename);
 
 /**
- * @brief Registra un’operazione di invio file con dimensione e tempo impiegato.
+ * @brief Imposta la rotazione: il file viene rinominato in "<nome>.<data-ora>"
+ *        quando supera max_bytes o è aperto da più di max_age_sec secondi
+ *        (0 disabilita il rispettivo criterio).
+ */
+void performance_log_set_rotation(size_t max_bytes, int max_age_sec);
+
+/**
+ * @brief Avvia il thread di scrittura del processo (da chiamare in ogni worker dopo il fork).
+ * @return 0 se ok, -1 in caso di errore.
+ */
+int performance_log_start(void);
+
+/**
+ * @brief Registra una risposta: percorso, byte del contenuto, status HTTP e
+ *        tempo impiegato. Non blocca e non fa syscall.
+ */
+void performance_log_record(const char *path, size_t size, int status, uint64_t latency_ns);
+
+/**
+ * @brief Ferma il thread di scrittura dopo aver scritto i record rimasti.
  */
-void performance_log_record(const char *path, size_t size, double time_sec);
+void performance_log_stop(void);
 
 /**
  * @brief Chiude il log file
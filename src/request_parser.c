@@ -1,193 +1,264 @@
 #include "request_parser.h"
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <unistd.h>
-#include <ctype.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PARSER_X86 1
+#endif
 
-#define REQUEST_BUFFER_SIZE 16384  // 16 KB di default
+enum {
+    STAGE_REQUEST_LINE,
+    STAGE_HEADERS,
+    STAGE_BODY
+};
 
-static void trim(char *str) {
-    // Rimuove spazi iniziali e finali
-    char *start = str;
-    while (isspace((unsigned char)*start)) start++;
-    if (start != str) {
-        memmove(str, start, strlen(start)+1);
-    }
-
-    char *end = str + strlen(str) - 1;
-    while (end > str && isspace((unsigned char)*end)) {
-        *end = '\0';
-        end--;
+/**
+ * @brief Ricerca di un byte: versione scalare, usata per le code e come fallback.
+ */
+static const char *find_byte_scalar(const char *p, const char *end, char c) {
+    while (p < end) {
+        if (*p == c) {
+            return p;
+        }
+        p++;
     }
+    return NULL;
 }
 
-void init_http_request_parser(http_request_parser_t *parser) {
-    memset(parser->method, 0, sizeof(parser->method));
-    memset(parser->path, 0, sizeof(parser->path));
-    memset(parser->version, 0, sizeof(parser->version));
+#ifdef PARSER_X86
 
-    parser->header_count = 0;
-    for (int i = 0; i < MAX_HEADER_COUNT; i++) {
-        memset(parser->headers[i].name, 0, sizeof(parser->headers[i].name));
-        memset(parser->headers[i].value, 0, sizeof(parser->headers[i].value));
+/**
+ * @brief Ricerca di un byte con SSE2 (16 byte per confronto).
+ */
+__attribute__((target("sse2")))
+static const char *find_byte_sse2(const char *p, const char *end, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
     }
-
-    parser->body = NULL;
-    parser->body_length = 0;
+    return find_byte_scalar(p, end, c);
 }
 
 /**
- * @brief Legge dal socket finché non trova "\r\n\r\n" (fine header).
- *        Se Content-Length > 0, legge anche il body.
+ * @brief Ricerca di un byte con AVX2 (32 byte per confronto).
  */
-void parse_http_request(int client_fd, http_request_parser_t *parser) {
-    char buffer[REQUEST_BUFFER_SIZE];
-    int bytes_read = 0;
-    int total_read = 0;
-
-    // Leggiamo dal socket in più passate, finché troviamo l'header completo
-    // oppure finché esauriamo il buffer.
-    // In un sistema reale, sarebbe necessario un approccio più robusto (cicli di recv + controlli).
-    while ((bytes_read = read(client_fd, buffer + total_read,
-                              REQUEST_BUFFER_SIZE - 1 - total_read)) > 0) {
-        total_read += bytes_read;
-        buffer[total_read] = '\0';
-
-        // Cerchiamo la sequenza "\r\n\r\n"
-        char *header_end = strstr(buffer, "\r\n\r\n");
-        if (header_end) {
-            // Abbiamo trovato la fine dell'header
-            break;
-        }
-        // Se non troviamo nulla, continuiamo a leggere (o finisce buffer).
-        if (total_read >= REQUEST_BUFFER_SIZE - 1) {
-            break;
+__attribute__((target("avx2")))
+static const char *find_byte_avx2(const char *p, const char *end, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)p);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle));
+        if (mask) {
+            return p + __builtin_ctz(mask);
         }
+        p += 32;
     }
+    return find_byte_sse2(p, end, c);
+}
 
-    // Se total_read == 0, potrebbe essere una connessione chiusa
-    if (total_read <= 0) {
-        return;
+// Implementazione scelta da request_parser_init() in base alla CPU; dopo
+// non cambia più, quindi i thread la leggono senza sincronizzazione
+static const char *(*find_byte)(const char *, const char *, char) = find_byte_scalar;
+
+void request_parser_init(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        find_byte = find_byte_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        find_byte = find_byte_sse2;
     }
+}
 
-    // A questo punto, buffer contiene almeno la request line + header (forse parziale).
-    // Troviamo la fine dell'header
-    char *header_end = strstr(buffer, "\r\n\r\n");
-    int header_len = 0;
-    if (header_end) {
-        header_len = header_end - buffer + 4; // comprensivo di \r\n\r\n
-    } else {
-        // Non abbiamo trovato la fine dell'header.
-        // Parser molto rudimentale, ci fermiamo.
-        header_len = total_read;
+#else
+#define find_byte find_byte_scalar
+
+void request_parser_init(void) {
+}
+#endif
+
+static http_span_t make_span(const char *base, const char *start, const char *end) {
+    http_span_t span;
+    span.off = (uint32_t)(start - base);
+    span.len = (uint32_t)(end - start);
+    return span;
+}
+
+static bool is_ows(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static bool span_equals_nocase(const char *p, size_t len, const char *str, size_t str_len) {
+    return len == str_len && strncasecmp(p, str, len) == 0;
+}
+
+/**
+ * @brief Analizza la request line "<METHOD> <PATH> <VERSION>".
+ * @return false se malformata.
+ */
+static bool parse_request_line(http_request_parser_t *parser, const char *line, const char *end) {
+    const char *base = parser->buf;
+
+    const char *sp1 = find_byte(line, end, ' ');
+    if (!sp1 || sp1 == line) {
+        return false;
     }
+    const char *path = sp1 + 1;
+    const char *sp2 = find_byte(path, end, ' ');
+    if (!sp2 || sp2 == path) {
+        return false;
+    }
+
+    parser->method = make_span(base, line, sp1);
+    parser->path = make_span(base, path, sp2);
+    parser->version = make_span(base, sp2 + 1, end);
+    return parser->method.len < 16 && parser->version.len > 0;
+}
 
-    // 1) Estraiamo la request line (prima riga)
-    //    <METHOD> <PATH> <VERSION>\r\n
-    char *line_start = buffer;
-    char *line_end = strstr(line_start, "\r\n");
-    if (!line_end) {
-        // Strano, non troviamo la fine della request line
-        return;
+/**
+ * @brief Analizza una riga "Name: value" e riconosce gli header che servono
+ *        al server (Content-Length, Connection) senza ulteriori ricerche.
+ * @return false se malformata.
+ */
+static bool parse_header_line(http_request_parser_t *parser, const char *line, const char *end) {
+    const char *colon = find_byte(line, end, ':');
+    if (!colon) {
+        return true; // riga senza ':' ignorata
     }
-    *line_end = '\0'; // terminazione stringa
-    // Ora line_start contiene "GET /index.html HTTP/1.1"
-
-    // Splittiamo con sscanf o simili
-    // Attenzione ai limiti di lunghezza.
-    sscanf(line_start, "%7s %1023s %15s", 
-           parser->method, parser->path, parser->version);
-
-    // 2) Processiamo gli header rimanenti
-    char *headers_start = line_end + 2; // saltiamo \r\n
-
-    // Adesso headers_start punta all'inizio del blocco header vero e proprio
-    // Dividiamo riga per riga finché non arriviamo a "\r\n\r\n"
-    int header_index = 0;
-    char *cur = headers_start;
-    while (1) {
-        char *next_line = strstr(cur, "\r\n");
-        if (!next_line) {
-            break; 
-        }
-        if (next_line == cur) {
-            // Riga vuota = fine header
-            break;
-        }
 
-        *next_line = '\0'; // terminazione di questa riga
-        // Ora "cur" contiene qualcosa tipo "Host: localhost"
-
-        // Splittiamo in "name: value"
-        char *colon_pos = strchr(cur, ':');
-        if (colon_pos && header_index < MAX_HEADER_COUNT) {
-            *colon_pos = '\0';
-            colon_pos++;
-            trim(cur);
-            trim(colon_pos);
-
-            strncpy(parser->headers[header_index].name, cur,
-                    MAX_HEADER_NAME_LEN - 1);
-            strncpy(parser->headers[header_index].value, colon_pos,
-                    MAX_HEADER_VALUE_LEN - 1);
-            header_index++;
-        }
+    const char *name_end = colon;
+    while (name_end > line && is_ows(name_end[-1])) name_end--;
+    const char *value = colon + 1;
+    while (value < end && is_ows(*value)) value++;
+    const char *value_end = end;
+    while (value_end > value && is_ows(value_end[-1])) value_end--;
 
-        cur = next_line + 2; // saltiamo \r\n
-        if (header_index >= MAX_HEADER_COUNT) {
-            break; // troppi header
+    size_t name_len = (size_t)(name_end - line);
+    size_t value_len = (size_t)(value_end - value);
+
+    if (span_equals_nocase(line, name_len, "Content-Length", 14)) {
+        unsigned long n = 0;
+        for (const char *p = value; p < value_end; p++) {
+            if (*p < '0' || *p > '9') {
+                return false;
+            }
+            n = n * 10 + (unsigned long)(*p - '0');
+            if (n > MAX_REQUEST_BODY_LEN) {
+                return false;
+            }
+        }
+        parser->body_length = (uint32_t)n;
+    } else if (span_equals_nocase(line, name_len, "Connection", 10)) {
+        if (span_equals_nocase(value, value_len, "close", 5)) {
+            parser->connection_close = true;
+        } else if (span_equals_nocase(value, value_len, "keep-alive", 10)) {
+            parser->connection_keep_alive = true;
         }
     }
-    parser->header_count = header_index;
 
-    // 3) Se c'è un body (Content-Length > 0), leggiamo
-    // Calcoliamo se abbiamo già parte del body nel buffer
-    int consumed = header_len; // i primi header_len byte erano l'header
-    int body_in_buffer = total_read - consumed;
+    if (parser->header_count < MAX_HEADER_COUNT) {
+        http_header_t *h = &parser->headers[parser->header_count++];
+        h->name = make_span(parser->buf, line, name_end);
+        h->value = make_span(parser->buf, value, value_end);
+    }
+    return true;
+}
 
-    // Cerchiamo Content-Length
-    int content_length = 0;
-    for (int i = 0; i < parser->header_count; i++) {
-        if (strcasecmp(parser->headers[i].name, "Content-Length") == 0) {
-            content_length = atoi(parser->headers[i].value);
-            break;
+void init_http_request_parser(http_request_parser_t *parser) {
+    parser->buf = NULL;
+    parser->pos = 0;
+    parser->line_start = 0;
+    parser->stage = STAGE_REQUEST_LINE;
+    parser->header_count = 0;
+    parser->connection_close = false;
+    parser->connection_keep_alive = false;
+    parser->header_len = 0;
+    parser->body_length = 0;
+}
+
+/**
+ * @brief Ogni '\n' trovato chiude una riga, analizzata subito: la riga vuota
+ *        segna la fine degli header. Se la richiesta ha un body (Content-Length
+ *        > 0) la consideriamo completa solo quando è tutto nel buffer.
+ */
+int parse_http_request(http_request_parser_t *parser, const char *buffer, size_t len) {
+    parser->buf = buffer;
+    const char *end = buffer + len;
+
+    while (parser->stage != STAGE_BODY) {
+        const char *nl = find_byte(buffer + parser->pos, end, '\n');
+        if (!nl) {
+            parser->pos = (uint32_t)len;
+            // Header ancora incompleto: se abbiamo già riempito il limite, rinunciamo
+            return len >= REQUEST_BUFFER_SIZE - 1 ? -1 : 0;
         }
-    }
 
-    if (content_length > 0) {
-        parser->body_length = content_length;
-        parser->body = (char *)malloc(content_length + 1);
-        if (!parser->body) {
-            // out of memory
-            return;
+        const char *line = buffer + parser->line_start;
+        const char *line_end = nl;
+        if (line_end > line && line_end[-1] == '\r') {
+            line_end--;
         }
-        memset(parser->body, 0, content_length + 1);
+        parser->pos = parser->line_start = (uint32_t)(nl + 1 - buffer);
 
-        // Copiamo eventuale body già letto
-        if (body_in_buffer > 0) {
-            if (body_in_buffer > content_length) {
-                body_in_buffer = content_length; 
+        if (parser->stage == STAGE_REQUEST_LINE) {
+            if (line_end == line) {
+                continue; // righe vuote prima della request line (RFC 9112 2.2)
             }
-            memcpy(parser->body, buffer + consumed, body_in_buffer);
+            if (!parse_request_line(parser, line, line_end)) {
+                return -1;
+            }
+            parser->stage = STAGE_HEADERS;
+        } else if (line_end == line) {
+            parser->header_len = parser->pos; // riga vuota = fine header
+            parser->stage = STAGE_BODY;
+        } else if (!parse_header_line(parser, line, line_end)) {
+            return -1;
         }
 
-        int remaining = content_length - body_in_buffer;
-        // Se manca ancora del body, lo leggiamo
-        while (remaining > 0) {
-            bytes_read = read(client_fd, parser->body + (content_length - remaining), remaining);
-            if (bytes_read <= 0) {
-                break; // conn chiusa o errore
-            }
-            remaining -= bytes_read;
+        if (parser->pos >= REQUEST_BUFFER_SIZE) {
+            return -1;
         }
     }
+
+    if (len - parser->header_len < parser->body_length) {
+        return 0; // body non ancora arrivato del tutto
+    }
+    return (int)(parser->header_len + parser->body_length);
 }
 
-const char* get_header_value(const http_request_parser_t *parser, const char *header_name) {
+bool http_request_headers_done(const http_request_parser_t *parser) {
+    return parser->stage == STAGE_BODY;
+}
+
+bool http_span_equals(const http_request_parser_t *parser, http_span_t span, const char *str) {
+    size_t n = strlen(str);
+    return span.len == n && memcmp(parser->buf + span.off, str, n) == 0;
+}
+
+bool http_span_copy(const http_request_parser_t *parser, http_span_t span, char *dst, size_t dst_size) {
+    if (span.len >= dst_size) {
+        return false;
+    }
+    memcpy(dst, parser->buf + span.off, span.len);
+    dst[span.len] = '\0';
+    return true;
+}
+
+const char* get_header_value(const http_request_parser_t *parser, const char *header_name, size_t *value_len) {
+    size_t name_len = strlen(header_name);
     for (int i = 0; i < parser->header_count; i++) {
-        if (strcasecmp(parser->headers[i].name, header_name) == 0) {
-            return parser->headers[i].value;
+        const http_header_t *h = &parser->headers[i];
+        if (span_equals_nocase(parser->buf + h->name.off, h->name.len, header_name, name_len)) {
+            if (value_len) {
+                *value_len = h->value.len;
+            }
+            return parser->buf + h->value.off;
         }
     }
     return NULL;
@@ -2,54 +2,119 @@
 #define REQUEST_PARSER_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
-#define MAX_METHOD_LEN 8
 #define MAX_PATH_LEN 1024
-#define MAX_VERSION_LEN 16
-#define MAX_HEADER_COUNT 50
-#define MAX_HEADER_NAME_LEN 64
-#define MAX_HEADER_VALUE_LEN 1024
+#define MAX_HEADER_COUNT 32
+#define REQUEST_BUFFER_SIZE 16384   // dimensione massima della parte header
+#define MAX_REQUEST_BODY_LEN 1048576 // 1 MB
+
+/**
+ * @brief Porzione del buffer di lettura: offset rispetto all'inizio della
+ *        richiesta e lunghezza. Nessuna copia, nessun terminatore.
+ */
+typedef struct {
+    uint32_t off;
+    uint32_t len;
+} http_span_t;
 
 typedef struct {
-    char name[MAX_HEADER_NAME_LEN];
-    char value[MAX_HEADER_VALUE_LEN];
+    http_span_t name;
+    http_span_t value;
 } http_header_t;
 
 /**
  * @brief Struttura di parsing della richiesta HTTP.
+ *
+ *        Il parser è incrementale: ricorda fin dove ha già analizzato il buffer,
+ *        quindi ogni byte viene esaminato una sola volta anche se la richiesta
+ *        arriva in più read(). I campi sono span nel buffer di lettura, validi
+ *        finché la richiesta non viene consumata.
  */
 typedef struct {
-    char method[MAX_METHOD_LEN];        // GET, POST, PUT, ecc.
-    char path[MAX_PATH_LEN];            // /index.html
-    char version[MAX_VERSION_LEN];      // HTTP/1.1, HTTP/1.0, ecc.
+    const char *buf;            // inizio della richiesta (aggiornato a ogni chiamata)
+
+    // Stato incrementale
+    uint32_t pos;               // primo byte non ancora analizzato
+    uint32_t line_start;        // inizio della riga corrente
+    uint8_t stage;              // request line, header, body, completa
+
+    // Risultato
+    http_span_t method;         // GET, POST, PUT, ecc.
+    http_span_t path;           // /index.html
+    http_span_t version;        // HTTP/1.1, HTTP/1.0, ecc.
 
     http_header_t headers[MAX_HEADER_COUNT];
-    int header_count;
+    uint16_t header_count;
 
-    char *body;                         // Puntatore a un buffer con il body (se presente)
-    int body_length;
+    bool connection_close;      // "Connection: close"
+    bool connection_keep_alive; // "Connection: keep-alive"
+
+    uint32_t header_len;        // byte della parte header (riga vuota compresa)
+    uint32_t body_length;       // da Content-Length
 } http_request_parser_t;
 
 /**
- * @brief Inizializza il parser, azzerando i campi.
+ * @brief Sceglie la ricerca vettoriale adatta alla CPU. Va chiamata una volta,
+ *        prima di creare thread e worker; senza, il parser usa quella scalare.
+ */
+void request_parser_init(void);
+
+/**
+ * @brief Inizializza il parser (azzera solo lo stato, costo costante).
  */
 void init_http_request_parser(http_request_parser_t *parser);
 
 /**
- * @brief Legge dal socket e riempie la struttura parser con:
- *        - Request line (method, path, version)
- *        - Headers (fino a MAX_HEADER_COUNT)
- *        - Body (se Content-Length > 0)
+ * @brief Continua l'analisi della richiesta che inizia in buffer, riprendendo
+ *        da dove si era fermata la chiamata precedente. Il buffer può essere
+ *        stato spostato (realloc) ma i byte già visti non devono cambiare.
+ *        Il buffer non viene modificato.
  *
- * @param client_fd fd del socket
  * @param parser puntatore alla struttura parser
+ * @param buffer inizio della richiesta nel buffer di lettura
+ * @param len numero di byte validi da buffer in poi
+ * @return numero di byte consumati dalla richiesta (header + body), 0 se la
+ *         richiesta è ancora incompleta, -1 se è malformata o troppo grande.
+ */
+int parse_http_request(http_request_parser_t *parser, const char *buffer, size_t len);
+
+/**
+ * @brief true se gli header della richiesta in corso sono completi (manca solo il body).
+ */
+bool http_request_headers_done(const http_request_parser_t *parser);
+
+/**
+ * @brief Puntatore all'inizio di uno span (non terminato da '\0').
+ */
+static inline const char *http_span_ptr(const http_request_parser_t *parser, http_span_t span) {
+    return parser->buf + span.off;
+}
+
+/**
+ * @brief Confronta uno span con una stringa (case-sensitive).
+ */
+bool http_span_equals(const http_request_parser_t *parser, http_span_t span, const char *str);
+
+/**
+ * @brief Copia uno span in dst come stringa terminata.
+ * @return false se non entra in dst_size byte.
+ */
+bool http_span_copy(const http_request_parser_t *parser, http_span_t span, char *dst, size_t dst_size);
+
+/**
+ * @brief Recupera il valore di un header (es. "Host", "User-Agent"), nome case-insensitive.
+ *        Restituisce puntatore al valore (non terminato) e ne scrive la lunghezza
+ *        in value_len, oppure NULL se non trovato.
  */
-void parse_http_request(int client_fd, http_request_parser_t *parser);
+const char* get_header_value(const http_request_parser_t *parser, const char *header_name, size_t *value_len);
 
 /**
- * @brief Recupera il valore di un header (es. "Host", "User-Agent").
- *        Restituisce puntatore alla stringa value, oppure NULL se non trovato.
+ * @brief Il body della richiesta (se presente), puntatore dentro al buffer.
  */
-const char* get_header_value(const http_request_parser_t *parser, const char *header_name);
+static inline const char *http_request_body(const http_request_parser_t *parser) {
+    return parser->body_length > 0 ? parser->buf + parser->header_len : NULL;
+}
 
 #endif // REQUEST_PARSER_H
@@ -4,14 +4,12 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <netinet/tcp.h>
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
 
-/**
- * @brief Imposta un socket in modalità non bloccante.
- *
- * @param fd file descriptor del socket.
- * @return 0 se ok, -1 se errore.
- */
-static int set_non_blocking(int fd) {
+int set_non_blocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
     if (flags == -1) {
         perror("fcntl(F_GETFL)");
@@ -26,7 +24,23 @@ static int set_non_blocking(int fd) {
     return 0;
 }
 
-int create_listen_socket(int port) {
+int set_tcp_nodelay(int fd) {
+    int one = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0) {
+        perror("setsockopt(TCP_NODELAY)");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Crea socket, bind, listen e modalità non bloccante.
+ *
+ * @param port la porta su cui mettersi in ascolto.
+ * @param reuseport se true imposta SO_REUSEPORT (più socket sulla stessa porta).
+ * @return il file descriptor del socket, oppure -1 in caso di errore.
+ */
+static int open_listen_socket(int port, bool reuseport) {
     int listen_fd;
     struct sockaddr_in server_addr;
 
@@ -45,6 +59,21 @@ int create_listen_socket(int port) {
         return -1;
     }
 
+    // Opzione per condividere la porta tra più socket (uno per worker)
+    if (reuseport) {
+#ifdef SO_REUSEPORT
+        if (setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0) {
+            perror("setsockopt(SO_REUSEPORT)");
+            close(listen_fd);
+            return -1;
+        }
+#else
+        fprintf(stderr, "SO_REUSEPORT non supportato su questa piattaforma\n");
+        close(listen_fd);
+        return -1;
+#endif
+    }
+
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
@@ -70,7 +99,84 @@ int create_listen_socket(int port) {
         return -1;
     }
 
+    return listen_fd;
+}
+
+int create_listen_socket(int port) {
+    int listen_fd = open_listen_socket(port, false);
+    if (listen_fd < 0) {
+        return -1;
+    }
+
     printf("Server in ascolto sulla porta %d\n", port);
     return listen_fd;
 }
 
+/**
+ * @brief Imposta la preferenza di CPU del socket e, sul primo socket del gruppo,
+ *        un filtro BPF classico che sceglie il socket del worker associato alla
+ *        CPU che ha ricevuto il SYN (tabella topo->cpu_worker, una coppia di
+ *        istruzioni per CPU; per le CPU fuori tabella cpu % count). Con i
+ *        worker vincolati alle CPU la connessione resta sul core che ne riceve
+ *        i pacchetti, se anche le code RX della scheda sono distribuite sugli
+ *        stessi core (RSS e affinità degli IRQ, fuori dal server).
+ */
+static int attach_incoming_cpu_policy(int fd, int index, int count, const topology_t *topo) {
+#ifdef __linux__
+    int cpu = topology_worker_cpu(topo, index);
+    if (cpu < 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu = (int)(index % (ncpu > 0 ? ncpu : 1));
+    }
+    if (setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) < 0) {
+        perror("setsockopt(SO_INCOMING_CPU)");
+        return -1;
+    }
+
+    if (index == 0) {
+        struct sock_filter *code = (struct sock_filter *)malloc(sizeof(struct sock_filter) * (2 * (size_t)topo->cpu_count + 3));
+        if (!code) {
+            return -1;
+        }
+        unsigned short len = 0;
+        code[len++] = (struct sock_filter){ BPF_LD | BPF_W | BPF_ABS, 0, 0, (unsigned int)(SKF_AD_OFF + SKF_AD_CPU) }; // A = cpu corrente
+        for (int j = 0; j < topo->cpu_count; j++) {
+            int c = topo->cpus[j];
+            code[len++] = (struct sock_filter){ BPF_JMP | BPF_JEQ | BPF_K, 0, 1, (unsigned int)c };          // A == c ?
+            code[len++] = (struct sock_filter){ BPF_RET | BPF_K, 0, 0, (unsigned int)topo->cpu_worker[c] };  // socket del worker
+        }
+        code[len++] = (struct sock_filter){ BPF_ALU | BPF_MOD | BPF_K, 0, 0, (unsigned int)count };          // A = A % count
+        code[len++] = (struct sock_filter){ BPF_RET | BPF_A, 0, 0, 0 };
+        struct sock_fprog prog = { .len = len, .filter = code };
+        int rc = setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+        free(code);
+        if (rc < 0) {
+            perror("setsockopt(SO_ATTACH_REUSEPORT_CBPF)");
+            return -1;
+        }
+    }
+    return 0;
+#else
+    (void)fd; (void)index; (void)count; (void)topo;
+    fprintf(stderr, "Steering per CPU non supportato su questa piattaforma\n");
+    return -1;
+#endif
+}
+
+int create_reuseport_sockets(int port, int *fds, int count, const topology_t *steering) {
+    for (int i = 0; i < count; i++) {
+        fds[i] = open_listen_socket(port, true);
+        if (fds[i] < 0 || (steering && attach_incoming_cpu_policy(fds[i], i, count, steering) < 0)) {
+            for (int j = 0; j <= i; j++) {
+                if (fds[j] >= 0) {
+                    close(fds[j]);
+                }
+            }
+            return -1;
+        }
+    }
+
+    printf("Server in ascolto sulla porta %d (%d socket SO_REUSEPORT%s)\n",
+           port, count, steering ? ", steering per CPU" : "");
+    return 0;
+}
@@ -5,10 +5,12 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <stdbool.h>
+#include "topology.h"
 
 #define DEFAULT_PORT 8080
 #define BACKLOG 128
 #define MAX_EVENTS 64
+#define ACCEPT_BATCH 16   // accept per risveglio con socket condiviso (EPOLLEXCLUSIVE)
 
 /**
  * @brief Crea e configura un socket in ascolto su una determinata porta.
@@ -18,5 +20,39 @@
  */
 int create_listen_socket(int port);
 
+/**
+ * @brief Crea count socket in ascolto sulla stessa porta con SO_REUSEPORT,
+ *        uno per worker: il kernel distribuisce le connessioni tra i socket
+ *        senza svegliare tutti i worker (niente "thundering herd").
+ *        I socket vanno creati prima del fork, nell'ordine dei worker.
+ *
+ * @param port la porta su cui mettersi in ascolto.
+ * @param fds array (di count elementi) in cui salvare i file descriptor.
+ * @param count numero di socket da creare.
+ * @param steering se non NULL imposta SO_INCOMING_CPU (la CPU del worker) e
+ *        un filtro BPF che assegna la connessione al socket del worker scelto
+ *        per la CPU che ha ricevuto il SYN (topology_t.cpu_worker).
+ * @return 0 se ok, -1 in caso di errore (nessun socket resta aperto).
+ */
+int create_reuseport_sockets(int port, int *fds, int count, const topology_t *steering);
+
+/**
+ * @brief Imposta un socket in modalità non bloccante.
+ *
+ * @param fd file descriptor del socket.
+ * @return 0 se ok, -1 se errore.
+ */
+int set_non_blocking(int fd);
+
+/**
+ * @brief Disabilita l'algoritmo di Nagle sul socket client: le risposte sono
+ *        già raccolte in pochi invii dalla coda di uscita, e la coda finale di
+ *        un file inviato con sendfile() non deve aspettare l'ACK ritardato del client.
+ *
+ * @param fd file descriptor del socket.
+ * @return 0 se ok, -1 se errore.
+ */
+int set_tcp_nodelay(int fd);
+
 #endif // SERVER_H
 
@@ -0,0 +1,369 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+#include "shm_arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+#define SHM_ALIGN 16
+#define SHM_MIN_BLOCK 64
+#define SHM_NUM_CLASSES 160
+
+#define SHM_BLOCK_USED 1ul       // bit in size_flags: blocco assegnato
+#define SHM_PREV_USED 2ul        // bit in size_flags: il blocco precedente è assegnato
+#define SHM_FLAGS (SHM_BLOCK_USED | SHM_PREV_USED)
+
+/**
+ * @brief Intestazione di ogni blocco (boundary tag). Un blocco libero ha nel
+ *        payload i collegamenti della sua free list (shm_free_links_t) e
+ *        ripete la dimensione nell'ultima parola, così il blocco successivo
+ *        può trovarne l'inizio e fondersi con lui.
+ */
+typedef struct {
+    size_t size_flags;           // dimensione del blocco (header compreso) | SHM_FLAGS
+    uint32_t magic;
+    uint32_t reserved;
+} shm_block_header_t;
+
+typedef struct {
+    size_t next;                 // offset del blocco libero successivo nella lista (0 = fine)
+    size_t prev;
+} shm_free_links_t;
+
+#define SHM_BLOCK_MAGIC 0x5348424bu // "SHBK"
+#define SHM_FREE_MAGIC 0x53484652u  // "SHFR"
+
+/**
+ * @brief Stato dell'allocatore, all'inizio della regione condivisa.
+ */
+struct shm_arena {
+    pthread_mutex_t lock;
+    size_t size;                        // dimensione totale della regione
+    size_t top;                         // offset della parte mai assegnata
+    size_t free_list[SHM_NUM_CLASSES];  // offset del primo blocco libero per classe (0 = vuota)
+    int fd;                             // memfd, oppure -1
+};
+
+/**
+ * @brief Dimensione minima della classe c: 64, 80, 96, 112, 128, 160, ...
+ *        La lista c contiene i blocchi liberi con class_size(c) <= size < class_size(c + 1).
+ */
+static size_t class_size(unsigned c) {
+    unsigned power = 6 + c / 4;
+    size_t base = (size_t)1 << power;
+    return base + (base / 4) * (c % 4);
+}
+
+/**
+ * @brief Più piccola classe i cui blocchi contengono tutti almeno size byte.
+ */
+static unsigned size_to_class(size_t size) {
+    if (size <= SHM_MIN_BLOCK) {
+        return 0;
+    }
+    // base = potenza di due con base < size <= 2*base; la classe è il più
+    // piccolo multiplo di base/4 (oltre base) che contiene size
+    unsigned power = 63 - (unsigned)__builtin_clzll((unsigned long long)(size - 1));
+    size_t base = (size_t)1 << power;
+    size_t quarter = base / 4;
+    unsigned k = (unsigned)((size - base + quarter - 1) / quarter);
+    return (power - 6) * 4 + k;
+}
+
+/**
+ * @brief Lista in cui va un blocco libero di size byte (la classe per difetto).
+ */
+static unsigned free_class(size_t size) {
+    unsigned c = size_to_class(size);
+    if (class_size(c) > size) {
+        c--;
+    }
+    return c < SHM_NUM_CLASSES ? c : SHM_NUM_CLASSES - 1;
+}
+
+static shm_block_header_t *block_at(shm_arena_t *arena, size_t offset) {
+    return (shm_block_header_t *)((char *)arena + offset);
+}
+
+static size_t block_size(const shm_block_header_t *hdr) {
+    return hdr->size_flags & ~SHM_FLAGS;
+}
+
+static shm_free_links_t *block_links(shm_block_header_t *hdr) {
+    return (shm_free_links_t *)(hdr + 1);
+}
+
+/**
+ * @brief Inserisce il blocco libero all'offset off nella sua lista (lock preso)
+ *        e ne scrive la dimensione in fondo.
+ */
+static void free_list_push(shm_arena_t *arena, size_t off, size_t size) {
+    shm_block_header_t *hdr = block_at(arena, off);
+    unsigned c = free_class(size);
+    hdr->size_flags = size | SHM_PREV_USED; // i vicini liberi sono già stati fusi
+    hdr->magic = SHM_FREE_MAGIC;
+    *(size_t *)((char *)hdr + size - sizeof(size_t)) = size;
+    shm_free_links_t *links = block_links(hdr);
+    links->next = arena->free_list[c];
+    links->prev = 0;
+    if (links->next != 0) {
+        block_links(block_at(arena, links->next))->prev = off;
+    }
+    arena->free_list[c] = off;
+}
+
+/**
+ * @brief Toglie il blocco libero all'offset off dalla sua lista (lock preso).
+ */
+static void free_list_remove(shm_arena_t *arena, size_t off) {
+    shm_block_header_t *hdr = block_at(arena, off);
+    shm_free_links_t *links = block_links(hdr);
+    if (links->prev != 0) {
+        block_links(block_at(arena, links->prev))->next = links->next;
+    } else {
+        arena->free_list[free_class(block_size(hdr))] = links->next;
+    }
+    if (links->next != 0) {
+        block_links(block_at(arena, links->next))->prev = links->prev;
+    }
+}
+
+/**
+ * @brief Imposta il bit SHM_PREV_USED del blocco che inizia all'offset off
+ *        (nessuno se off è la parte mai assegnata).
+ */
+static void set_prev_used(shm_arena_t *arena, size_t off, bool used) {
+    if (off >= arena->top) {
+        return;
+    }
+    shm_block_header_t *next = block_at(arena, off);
+    next->size_flags = used ? next->size_flags | SHM_PREV_USED : next->size_flags & ~SHM_PREV_USED;
+}
+
+int shm_mutex_init(pthread_mutex_t *mutex) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    int rc = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#ifdef __linux__
+    if (rc == 0) {
+        rc = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    }
+#endif
+    if (rc == 0) {
+        rc = pthread_mutex_init(mutex, &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+    return rc;
+}
+
+void shm_mutex_lock(pthread_mutex_t *mutex) {
+    int rc = pthread_mutex_lock(mutex);
+#ifdef __linux__
+    if (rc == EOWNERDEAD) {
+        // Il processo che aveva il lock è morto: le strutture protette sono
+        // comunque coerenti perché ogni sezione critica è breve e non lascia
+        // stati intermedi visibili, quindi recuperiamo il lock.
+        pthread_mutex_consistent(mutex);
+    }
+#else
+    (void)rc;
+#endif
+}
+
+shm_arena_t *shm_arena_create(const char *name, size_t size) {
+    int fd = -1;
+    void *base = MAP_FAILED;
+
+#ifdef __linux__
+    fd = memfd_create(name, MFD_CLOEXEC);
+    if (fd >= 0) {
+        if (ftruncate(fd, (off_t)size) == 0) {
+            base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (base == MAP_FAILED) {
+            perror("memfd mmap");
+            close(fd);
+            fd = -1;
+        }
+    }
+#else
+    (void)name;
+#endif
+
+    if (base == MAP_FAILED) {
+        // Fallback: mapping anonimo condiviso (niente fd, quindi niente sendfile)
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            perror("mmap shm arena");
+            return NULL;
+        }
+    }
+
+    shm_arena_t *arena = (shm_arena_t *)base;
+    memset(arena, 0, sizeof(*arena));
+    if (shm_mutex_init(&arena->lock) != 0) {
+        munmap(base, size);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+    arena->size = size;
+    arena->top = (sizeof(shm_arena_t) + SHM_ALIGN - 1) & ~(size_t)(SHM_ALIGN - 1);
+    arena->fd = fd;
+    return arena;
+}
+
+void *shm_alloc(shm_arena_t *arena, size_t size) {
+    size_t need = (size + sizeof(shm_block_header_t) + SHM_ALIGN - 1) & ~(size_t)(SHM_ALIGN - 1);
+    if (need < SHM_MIN_BLOCK) {
+        need = SHM_MIN_BLOCK;
+    }
+    unsigned c = size_to_class(need);
+    if (need < size || c >= SHM_NUM_CLASSES) {
+        return NULL;
+    }
+    shm_block_header_t *hdr = NULL;
+
+    shm_mutex_lock(&arena->lock);
+    // Prima lista non vuota dalla classe di need in su: ogni blocco che contiene è abbastanza grande
+    for (unsigned k = c; k < SHM_NUM_CLASSES && !hdr; k++) {
+        if (arena->free_list[k] == 0) {
+            continue;
+        }
+        size_t off = arena->free_list[k];
+        hdr = block_at(arena, off);
+        free_list_remove(arena, off);
+        size_t have = block_size(hdr);
+        if (have - need >= SHM_MIN_BLOCK) {
+            // Il resto torna libero (il blocco che lo segue resta con il precedente libero)
+            free_list_push(arena, off + need, have - need);
+        } else {
+            need = have;
+            set_prev_used(arena, off + have, true);
+        }
+    }
+    if (!hdr && arena->size - arena->top >= need) {
+        // Un blocco libero adiacente alla parte mai assegnata vi viene
+        // riassorbito, quindi il precedente di un blocco nuovo è sempre assegnato
+        hdr = block_at(arena, arena->top);
+        hdr->size_flags = SHM_PREV_USED;
+        arena->top += need;
+    }
+    if (hdr) {
+        hdr->size_flags = need | (hdr->size_flags & SHM_PREV_USED) | SHM_BLOCK_USED;
+        hdr->magic = SHM_BLOCK_MAGIC;
+    }
+    pthread_mutex_unlock(&arena->lock);
+
+    return hdr ? hdr + 1 : NULL;
+}
+
+void shm_free(shm_arena_t *arena, void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    shm_block_header_t *hdr = (shm_block_header_t *)ptr - 1;
+    if (hdr->magic != SHM_BLOCK_MAGIC) {
+        fprintf(stderr, "shm_free: blocco non valido\n");
+        return;
+    }
+
+    shm_mutex_lock(&arena->lock);
+    size_t off = shm_arena_offset(arena, hdr);
+    size_t size = block_size(hdr);
+    // Fusione con il blocco successivo, se libero
+    size_t next_off = off + size;
+    if (next_off < arena->top) {
+        shm_block_header_t *next = block_at(arena, next_off);
+        if (!(next->size_flags & SHM_BLOCK_USED)) {
+            free_list_remove(arena, next_off);
+            size += block_size(next);
+            next->magic = 0;
+        }
+    }
+    // ... e con il precedente, la cui dimensione è nella sua ultima parola
+    if (!(hdr->size_flags & SHM_PREV_USED)) {
+        size_t prev_size = *(size_t *)((char *)hdr - sizeof(size_t));
+        size_t prev_off = off - prev_size;
+        free_list_remove(arena, prev_off);
+        hdr->magic = 0;
+        off = prev_off;
+        size += prev_size;
+    }
+    hdr = block_at(arena, off);
+    if (off + size == arena->top) {
+        arena->top = off; // torna alla parte mai assegnata
+        hdr->magic = 0;
+    } else {
+        free_list_push(arena, off, size);
+        set_prev_used(arena, off + size, false);
+    }
+    pthread_mutex_unlock(&arena->lock);
+}
+
+size_t shm_block_size(const void *ptr) {
+    const shm_block_header_t *hdr = (const shm_block_header_t *)ptr - 1;
+    return block_size(hdr);
+}
+
+int shm_arena_fd(const shm_arena_t *arena) {
+    return arena->fd;
+}
+
+size_t shm_arena_offset(const shm_arena_t *arena, const void *ptr) {
+    return (size_t)((const char *)ptr - (const char *)arena);
+}
+
+size_t shm_arena_available(shm_arena_t *arena) {
+    shm_mutex_lock(&arena->lock);
+    size_t available = arena->size - arena->top;
+    pthread_mutex_unlock(&arena->lock);
+    return available;
+}
+
+size_t shm_arena_lock(shm_arena_t *arena) {
+    shm_mutex_lock(&arena->lock);
+    size_t top = arena->top;
+    pthread_mutex_unlock(&arena->lock);
+
+    long page = sysconf(_SC_PAGESIZE);
+    size_t len = (top + (size_t)page - 1) & ~((size_t)page - 1);
+    if (len > arena->size) {
+        len = arena->size;
+    }
+    if (mlock(arena, len) < 0) {
+        return 0;
+    }
+    return len;
+}
+
+int shm_arena_interleave(shm_arena_t *arena, unsigned long node_mask) {
+#ifdef __linux__
+    // Vale per l'oggetto memfd condiviso, quindi anche per i mapping dei worker
+    return (int)syscall(SYS_mbind, arena, arena->size, MPOL_INTERLEAVE, &node_mask, sizeof(node_mask) * 8 + 1, 0);
+#else
+    (void)arena;
+    (void)node_mask;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+void shm_arena_destroy(shm_arena_t *arena) {
+    int fd = arena->fd;
+    munmap(arena, arena->size);
+    if (fd >= 0) {
+        close(fd);
+    }
+}
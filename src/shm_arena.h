@@ -0,0 +1,96 @@
+#ifndef SHM_ARENA_H
+#define SHM_ARENA_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/**
+ * @brief Arena di memoria condivisa tra processi (memfd su Linux, mapping
+ *        anonimo condiviso altrove). Va creata nel master prima del fork():
+ *        i worker ereditano il mapping allo stesso indirizzo, quindi i puntatori
+ *        allocati nell'arena sono validi in tutti i processi.
+ *
+ *        L'allocatore usa boundary tag: i blocchi liberi adiacenti si fondono
+ *        (e tornano alla parte mai usata se la toccano), e le free list sono
+ *        per classe di dimensione (4 per ogni potenza di due). Un'allocazione
+ *        prende il primo blocco delle classi abbastanza grandi e restituisce
+ *        il resto, così lo spazio liberato serve a richieste di ogni dimensione.
+ */
+typedef struct shm_arena shm_arena_t;
+
+/**
+ * @brief Crea un'arena condivisa di size byte (le pagine sono occupate solo quando usate).
+ * @param name nome del memfd (visibile in /proc/<pid>/fd).
+ * @param size dimensione totale della regione.
+ * @return l'arena, oppure NULL in caso di errore.
+ */
+shm_arena_t *shm_arena_create(const char *name, size_t size);
+
+/**
+ * @brief Alloca size byte nell'arena (thread e process safe).
+ * @return puntatore al blocco (allineato a 16 byte), oppure NULL se l'arena è piena.
+ */
+void *shm_alloc(shm_arena_t *arena, size_t size);
+
+/**
+ * @brief Restituisce un blocco all'arena.
+ */
+void shm_free(shm_arena_t *arena, void *ptr);
+
+/**
+ * @brief Byte effettivamente occupati da un blocco (header e allineamento compresi).
+ */
+size_t shm_block_size(const void *ptr);
+
+/**
+ * @brief File descriptor del memfd che contiene l'arena, oppure -1 se l'arena
+ *        è un mapping anonimo. Un puntatore p dell'arena corrisponde all'offset
+ *        shm_arena_offset(arena, p) nel file.
+ */
+int shm_arena_fd(const shm_arena_t *arena);
+
+/**
+ * @brief Offset di un puntatore dell'arena rispetto all'inizio della regione.
+ */
+size_t shm_arena_offset(const shm_arena_t *arena, const void *ptr);
+
+/**
+ * @brief Byte in fondo alla regione mai assegnati o restituiti (esclusi i blocchi nelle free list).
+ */
+size_t shm_arena_available(shm_arena_t *arena);
+
+/**
+ * @brief Blocca in RAM (mlock) la parte della regione assegnata finora. Le
+ *        pagine sono condivise: restano residenti finché il processo che le ha
+ *        bloccate (il master) è vivo, anche per i worker che le usano.
+ * @return byte bloccati, 0 in caso di errore (errno impostato, ad es. per RLIMIT_MEMLOCK).
+ */
+size_t shm_arena_lock(shm_arena_t *arena);
+
+/**
+ * @brief Distribuisce le pagine della regione ancora da occupare a turno sui
+ *        nodi NUMA di node_mask (MPOL_INTERLEAVE): la regione è letta da
+ *        worker su nodi diversi, e così nessun nodo serve da solo tutta la cache.
+ * @return 0 se ok, -1 in caso di errore (errno impostato).
+ */
+int shm_arena_interleave(shm_arena_t *arena, unsigned long node_mask);
+
+/**
+ * @brief Rilascia il mapping (nel processo corrente).
+ */
+void shm_arena_destroy(shm_arena_t *arena);
+
+/**
+ * @brief Inizializza un mutex utilizzabile da più processi (PTHREAD_PROCESS_SHARED,
+ *        robusto dove supportato: se un worker muore col lock preso, il lock
+ *        viene recuperato invece di bloccare tutti).
+ * @return 0 se ok, altrimenti un codice di errore pthread.
+ */
+int shm_mutex_init(pthread_mutex_t *mutex);
+
+/**
+ * @brief Acquisisce un mutex creato con shm_mutex_init().
+ */
+void shm_mutex_lock(pthread_mutex_t *mutex);
+
+#endif // SHM_ARENA_H
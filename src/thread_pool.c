@@ -1,141 +1,173 @@
 #include "thread_pool.h"
-#include "request_parser.h"
-#include "http_response.h"
+#include "event_loop.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
-#include <sys/socket.h>
-#include <sys/time.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <sched.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 extern bool g_verbose;
 
 /**
- * @brief Controlla se la connessione deve restare aperta (keep-alive) o no
- *
- * Politica semplificata: 
- * - se "Connection: close" => chiude
- * - se "HTTP/1.0" senza header => chiude
- * - altrimenti (HTTP/1.1 default o "Connection: keep-alive") => keep-alive
+ * @brief Restituisce una connessione servita all'event loop e lo sveglia.
  */
-static bool should_keep_alive(const http_request_parser_t *parser) {
-    // Cerchiamo l'header "Connection"
-    const char *conn = NULL;
-    for (int i = 0; i < parser->header_count; i++) {
-        if (strcasecmp(parser->headers[i].name, "Connection") == 0) {
-            conn = parser->headers[i].value;
-            break;
-        }
-    }
-
-    // Se c'è "Connection: close" => no keep-alive
-    if (conn && strcasecmp(conn, "close") == 0) {
-        return false;
+static void thread_pool_complete(thread_pool_t *pool, connection_t *conn) {
+    pthread_mutex_lock(&pool->done_mutex);
+    bool was_empty = (pool->done_head == NULL);
+    conn->next = pool->done_head;
+    pool->done_head = conn;
+    pthread_mutex_unlock(&pool->done_mutex);
+
+    // Se la lista non era vuota l'event loop è già stato avvisato
+    if (was_empty) {
+        notify_event_loop(pool->notify_write_fd);
     }
+}
 
-    // HTTP/1.0 di default non fa keep-alive se non lo dichiari esplicitamente
-    if (strncmp(parser->version, "HTTP/1.0", 8) == 0) {
-        if (conn && strcasecmp(conn, "keep-alive") == 0) {
-            return true;
+/**
+ * @brief Prova a estrarre un job dalla coda (algoritmo di Vyukov per code MPMC limitate).
+ * @return la connessione, oppure NULL se la coda è vuota.
+ */
+static connection_t *queue_pop(thread_pool_t *pool) {
+    size_t pos = atomic_load_explicit(&pool->dequeue_pos, memory_order_relaxed);
+    while (1) {
+        job_cell_t *cell = &pool->cells[pos & pool->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            // Cella pronta: proviamo a prenotarla
+            if (atomic_compare_exchange_weak_explicit(&pool->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                connection_t *conn = cell->conn;
+                // La cella torna libera per il giro successivo del produttore
+                atomic_store_explicit(&cell->seq, pos + pool->mask + 1, memory_order_release);
+                return conn;
+            }
+        } else if (diff < 0) {
+            return NULL; // vuota
+        } else {
+            pos = atomic_load_explicit(&pool->dequeue_pos, memory_order_relaxed);
         }
-        return false;
     }
-
-    // HTTP/1.1 di default ha keep-alive, salvo "Connection: close"
-    return true;
 }
 
 /**
- * @brief Gestisce una singola connessione client in un loop:
- *        parse => handle => decide se keep-alive => parse => ...
+ * @brief Prova a inserire un job nella coda.
+ * @return true se inserito, false se la coda è piena.
  */
-static void handle_connection(int client_fd) {
-    // Impostiamo un timeout (es. 5s) per non restare bloccati per sempre
-    struct timeval tv;
-    tv.tv_sec = 5;
-    tv.tv_usec = 0;
-    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof(tv));
-
+static bool queue_push(thread_pool_t *pool, connection_t *conn) {
+    size_t pos = atomic_load_explicit(&pool->enqueue_pos, memory_order_relaxed);
     while (1) {
-        http_request_parser_t parser;
-        init_http_request_parser(&parser);
-
-        // Leggiamo e parsiamo la request
-        parse_http_request(client_fd, &parser);
-
-        // Se non abbiamo letto nulla (parser->method[0] == '\0'), 
-        // significa conn chiusa o timeout => esci
-        if (parser.method[0] == '\0') {
-            if (g_verbose) {
-                printf("[thread_pool] Nessuna request letta (fd=%d). Chiudo.\n", client_fd);
+        job_cell_t *cell = &pool->cells[pos & pool->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&pool->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->conn = conn;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                return true;
             }
-            break;
+        } else if (diff < 0) {
+            return false; // piena
+        } else {
+            pos = atomic_load_explicit(&pool->enqueue_pos, memory_order_relaxed);
         }
+    }
+}
 
-        // Genera risposta
-        handle_http_request(client_fd, &parser);
-
-        // Decide se rimanere aperti
-        if (!should_keep_alive(&parser)) {
-            if (g_verbose) {
-                printf("[thread_pool] Chiusura post-richiesta su fd=%d (no keep-alive)\n", client_fd);
-            }
-            break;
-        }
+/**
+ * @brief Addormenta il thread finché wake_seq vale ancora seq.
+ */
+static void park(thread_pool_t *pool, unsigned seq) {
+#ifdef __linux__
+    syscall(SYS_futex, &pool->wake_seq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&pool->park_mutex);
+    if (atomic_load(&pool->wake_seq) == seq) {
+        pthread_cond_wait(&pool->park_cond, &pool->park_mutex);
+    }
+    pthread_mutex_unlock(&pool->park_mutex);
+#endif
+}
 
-        // Se vogliamo restare aperti, passiamo al loop successivo per una nuova request
-        if (g_verbose) {
-            printf("[thread_pool] Resto in keep-alive su fd=%d\n", client_fd);
+/**
+ * @brief Segnala nuovi job e sveglia fino a count thread addormentati.
+ */
+static void unpark(thread_pool_t *pool, int count) {
+    atomic_fetch_add(&pool->wake_seq, 1);
+    int idle = atomic_load(&pool->idle_threads);
+    if (idle <= 0) {
+        return; // tutti svegli: troveranno i job da soli
+    }
+    if (count > idle) {
+        count = idle;
+    }
+#ifdef __linux__
+    syscall(SYS_futex, &pool->wake_seq, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&pool->park_mutex);
+    if (count >= idle) {
+        pthread_cond_broadcast(&pool->park_cond);
+    } else {
+        while (count-- > 0) {
+            pthread_cond_signal(&pool->park_cond);
         }
     }
-
-    // Chiudiamo definitivamente la connessione
-    close(client_fd);
+    pthread_mutex_unlock(&pool->park_mutex);
+#endif
 }
 
 /**
- * @brief Funzione eseguita da ogni thread del pool:
- *        - Preleva un job (un client_fd) dalla coda
- *        - Gestisce la connessione con handle_connection (che può servire più request se keep-alive)
- *        - Ritorna in attesa di un nuovo job
+ * @brief Preleva il prossimo job, addormentandosi se la coda è vuota.
+ * @return la connessione, oppure NULL se il pool è in chiusura.
  */
-static void *thread_pool_worker(void *arg) {
-    thread_pool_t *pool = (thread_pool_t *)arg;
-
-    while (1) {
-        pthread_mutex_lock(&pool->queue_mutex);
-
-        // Attende finché la coda è vuota e non è arrivato lo stop
-        while (pool->job_queue_head == NULL && !pool->stop) {
-            pthread_cond_wait(&pool->queue_cond, &pool->queue_mutex);
+static connection_t *next_job(thread_pool_t *pool) {
+    while (!atomic_load(&pool->stop)) {
+        connection_t *conn = queue_pop(pool);
+        if (conn) {
+            return conn;
         }
 
-        if (pool->stop) {
-            pthread_mutex_unlock(&pool->queue_mutex);
-            break;
+        // Ci dichiariamo inattivi e ricontrolliamo la coda prima di dormire:
+        // un job inserito dopo la lettura di seq cambia wake_seq e la futex
+        // non si addormenta
+        unsigned seq = atomic_load(&pool->wake_seq);
+        atomic_fetch_add(&pool->idle_threads, 1);
+        conn = queue_pop(pool);
+        if (!conn && !atomic_load(&pool->stop)) {
+            park(pool, seq);
         }
-
-        // Estrae il job dalla coda
-        job_t *job = pool->job_queue_head;
-        if (job) {
-            if (g_verbose) {
-                printf("[thread_pool] Inizio gestione connessione su fd=%d\n", job->client_fd);
-            }
-            pool->job_queue_head = job->next;
-            if (!pool->job_queue_head) {
-                pool->job_queue_tail = NULL;
-            }
+        atomic_fetch_sub(&pool->idle_threads, 1);
+        if (conn) {
+            return conn;
         }
-        pthread_mutex_unlock(&pool->queue_mutex);
+    }
+    return NULL;
+}
 
-        if (job) {
-            // Gestiamo (potenzialmente più richieste) finché c'è keep-alive
-            handle_connection(job->client_fd);
+/**
+ * @brief Funzione eseguita da ogni thread del pool:
+ *        - Preleva un job (una connessione pronta) dalla coda
+ *        - Serve le richieste disponibili senza bloccarsi sul socket
+ *        - Restituisce la connessione all'event loop e torna in attesa
+ */
+static void *thread_pool_worker(void *arg) {
+    thread_pool_t *pool = (thread_pool_t *)arg;
 
-            // Libera la struttura job
-            free(job);
+    connection_t *conn;
+    while ((conn = next_job(pool)) != NULL) {
+        if (g_verbose) {
+            printf("[thread_pool] Inizio gestione connessione su fd=%d\n", conn->fd);
         }
+        connection_handle(conn);
+        thread_pool_complete(pool, conn);
     }
     return NULL;
 }
@@ -143,57 +175,96 @@ static void *thread_pool_worker(void *arg) {
 void thread_pool_init(thread_pool_t *pool, int num_threads) {
     pool->thread_count = num_threads;
     pool->threads = malloc(sizeof(pthread_t) * num_threads);
-    pool->job_queue_head = NULL;
-    pool->job_queue_tail = NULL;
-    pool->stop = false;
-
-    pthread_mutex_init(&pool->queue_mutex, NULL);
-    pthread_cond_init(&pool->queue_cond, NULL);
+    pool->cells = malloc(sizeof(job_cell_t) * THREAD_POOL_QUEUE_SIZE);
+    if (!pool->threads || !pool->cells) {
+        perror("malloc thread_pool");
+        exit(EXIT_FAILURE);
+    }
+    pool->mask = THREAD_POOL_QUEUE_SIZE - 1;
+    for (size_t i = 0; i < THREAD_POOL_QUEUE_SIZE; i++) {
+        atomic_init(&pool->cells[i].seq, i);
+        pool->cells[i].conn = NULL;
+    }
+    atomic_init(&pool->enqueue_pos, 0);
+    atomic_init(&pool->dequeue_pos, 0);
+    atomic_init(&pool->wake_seq, 0);
+    atomic_init(&pool->idle_threads, 0);
+    atomic_init(&pool->stop, false);
+    pool->done_head = NULL;
+
+#ifndef __linux__
+    pthread_mutex_init(&pool->park_mutex, NULL);
+    pthread_cond_init(&pool->park_cond, NULL);
+#endif
+    pthread_mutex_init(&pool->done_mutex, NULL);
+
+    if (create_notify_fd(&pool->notify_read_fd, &pool->notify_write_fd) < 0) {
+        exit(EXIT_FAILURE);
+    }
 
     for (int i = 0; i < num_threads; i++) {
         pthread_create(&pool->threads[i], NULL, thread_pool_worker, pool);
     }
 }
 
-void thread_pool_add_job(thread_pool_t *pool, int client_fd) {
-    job_t *new_job = (job_t *)malloc(sizeof(job_t));
-    new_job->client_fd = client_fd;
-    new_job->next = NULL;
+void thread_pool_add_jobs(thread_pool_t *pool, connection_t **conns, int count) {
+    int pushed = 0;
+    while (pushed < count) {
+        if (queue_push(pool, conns[pushed])) {
+            pushed++;
+            continue;
+        }
+        // Coda piena: svegliamo i thread e lasciamo loro la CPU
+        unpark(pool, pool->thread_count);
+        sched_yield();
+    }
+    if (count > 0) {
+        unpark(pool, count);
+    }
+}
 
-    pthread_mutex_lock(&pool->queue_mutex);
+void thread_pool_add_job(thread_pool_t *pool, connection_t *conn) {
+    thread_pool_add_jobs(pool, &conn, 1);
+}
 
-    if (pool->job_queue_tail == NULL) {
-        pool->job_queue_head = new_job;
-        pool->job_queue_tail = new_job;
-    } else {
-        pool->job_queue_tail->next = new_job;
-        pool->job_queue_tail = new_job;
-    }
+size_t thread_pool_queue_depth(thread_pool_t *pool) {
+    size_t tail = atomic_load_explicit(&pool->enqueue_pos, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&pool->dequeue_pos, memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+connection_t *thread_pool_collect(thread_pool_t *pool) {
+    drain_notify_fd(pool->notify_read_fd);
+
+    pthread_mutex_lock(&pool->done_mutex);
+    connection_t *list = pool->done_head;
+    pool->done_head = NULL;
+    pthread_mutex_unlock(&pool->done_mutex);
 
-    pthread_cond_signal(&pool->queue_cond);
-    pthread_mutex_unlock(&pool->queue_mutex);
+    return list;
 }
 
 void thread_pool_destroy(thread_pool_t *pool) {
-    pthread_mutex_lock(&pool->queue_mutex);
-    pool->stop = true;
-    pthread_cond_broadcast(&pool->queue_cond);
-    pthread_mutex_unlock(&pool->queue_mutex);
+    atomic_store(&pool->stop, true);
+    unpark(pool, pool->thread_count);
 
     // Join threads
     for (int i = 0; i < pool->thread_count; i++) {
         pthread_join(pool->threads[i], NULL);
     }
 
+    // I job residui non si liberano: le connessioni restano di proprietà dell'event loop
     free(pool->threads);
+    free(pool->cells);
 
-    // Libera la coda residua
-    while (pool->job_queue_head) {
-        job_t *tmp = pool->job_queue_head;
-        pool->job_queue_head = pool->job_queue_head->next;
-        free(tmp);
+    if (pool->notify_write_fd != pool->notify_read_fd) {
+        close(pool->notify_write_fd);
     }
+    close(pool->notify_read_fd);
 
-    pthread_mutex_destroy(&pool->queue_mutex);
-    pthread_cond_destroy(&pool->queue_cond);
+#ifndef __linux__
+    pthread_mutex_destroy(&pool->park_mutex);
+    pthread_cond_destroy(&pool->park_cond);
+#endif
+    pthread_mutex_destroy(&pool->done_mutex);
 }
@@ -3,32 +3,51 @@
 
 #include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "connection.h"
+
+#define THREAD_POOL_QUEUE_SIZE 1024 // celle della coda dei job (potenza di 2)
 
 /**
- * @brief Definizione di una struttura di lavoro (job).
- *        In questo caso, contiene semplicemente il file descriptor
- *        del client da servire.
+ * @brief Cella della coda dei job: il numero di sequenza dice se la cella è
+ *        libera per il produttore (seq == pos) o pronta per un consumatore
+ *        (seq == pos + 1).
  */
-typedef struct job_t {
-    int client_fd;
-    struct job_t *next; // Linked list
-} job_t;
+typedef struct {
+    atomic_size_t seq;
+    connection_t *conn;
+} job_cell_t;
 
 /**
- * @brief Struttura thread pool. Contiene un array di thread, una coda di job,
- *        e le primitive di sincronizzazione.
+ * @brief Struttura thread pool. Contiene un array di thread, una coda di job
+ *        limitata e senza lock (MPMC, una cella per connessione pronta, nessuna
+ *        allocazione per job), la lista delle connessioni già servite da
+ *        restituire all'event loop e le primitive di sincronizzazione.
+ *        I thread senza lavoro si addormentano su una futex (condvar fuori da Linux).
  */
 typedef struct {
     pthread_t *threads;
     int thread_count;
 
-    job_t *job_queue_head;
-    job_t *job_queue_tail;
+    job_cell_t *cells;
+    size_t mask;
+    _Alignas(64) atomic_size_t enqueue_pos;
+    _Alignas(64) atomic_size_t dequeue_pos;
+
+    _Alignas(64) atomic_uint wake_seq; // incrementato a ogni inserimento (parola della futex)
+    atomic_int idle_threads;           // thread addormentati o in procinto di farlo
+#ifndef __linux__
+    pthread_mutex_t park_mutex;
+    pthread_cond_t park_cond;
+#endif
 
-    pthread_mutex_t queue_mutex;
-    pthread_cond_t queue_cond;
+    connection_t *done_head;   // connessioni servite, in attesa dell'event loop
+    pthread_mutex_t done_mutex;
+    int notify_read_fd;        // da registrare nell'event loop
+    int notify_write_fd;
 
-    bool stop;
+    atomic_bool stop;
 } thread_pool_t;
 
 /**
@@ -40,12 +59,36 @@ typedef struct {
 void thread_pool_init(thread_pool_t *pool, int num_threads);
 
 /**
- * @brief Aggiunge un job (client_fd) alla coda del thread pool.
+ * @brief Aggiunge un job (connessione pronta) alla coda del thread pool.
  *
  * @param pool puntatore al thread_pool_t.
- * @param client_fd file descriptor del client.
+ * @param conn connessione da servire.
  */
-void thread_pool_add_job(thread_pool_t *pool, int client_fd);
+void thread_pool_add_job(thread_pool_t *pool, connection_t *conn);
+
+/**
+ * @brief Aggiunge più job in un colpo solo, svegliando al più un thread per job
+ *        con un'unica notifica. Se la coda è piena attende che i thread la svuotino.
+ *
+ * @param pool puntatore al thread_pool_t.
+ * @param conns connessioni da servire.
+ * @param count numero di connessioni.
+ */
+void thread_pool_add_jobs(thread_pool_t *pool, connection_t **conns, int count);
+
+/**
+ * @brief Numero di job in coda e non ancora prelevati (indicativo).
+ */
+size_t thread_pool_queue_depth(thread_pool_t *pool);
+
+/**
+ * @brief Preleva le connessioni già servite dai thread (da chiamare quando
+ *        pool->notify_read_fd è pronto).
+ *
+ * @param pool puntatore al thread_pool_t.
+ * @return lista (collegata tramite conn->next) delle connessioni completate, o NULL.
+ */
+connection_t *thread_pool_collect(thread_pool_t *pool);
 
 /**
  * @brief Chiude il thread pool e rilascia le risorse.
@@ -55,4 +98,3 @@ void thread_pool_add_job(thread_pool_t *pool, int client_fd);
 void thread_pool_destroy(thread_pool_t *pool);
 
 #endif // THREAD_POOL_H
-
@@ -0,0 +1,123 @@
+#include "timer_wheel.h"
+#include <time.h>
+
+uint64_t timer_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+void timer_init(timer_node_t *timer) {
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->expires = 0;
+}
+
+void timer_wheel_init(timer_wheel_t *wheel, uint64_t now_ms) {
+    wheel->now = 0;
+    wheel->origin_ms = now_ms;
+    wheel->armed = 0;
+    for (int l = 0; l < TIMER_WHEEL_LEVELS; l++) {
+        for (int s = 0; s < TIMER_WHEEL_SLOTS; s++) {
+            wheel->slots[l][s].next = &wheel->slots[l][s];
+            wheel->slots[l][s].prev = &wheel->slots[l][s];
+        }
+    }
+}
+
+static void unlink_node(timer_node_t *timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+/**
+ * @brief Inserisce il timer nello slot che corrisponde alla sua distanza dal tick corrente.
+ */
+static void place(timer_wheel_t *wheel, timer_node_t *timer) {
+    uint64_t expires = timer->expires > wheel->now ? timer->expires : wheel->now + 1;
+    uint64_t delta = expires - wheel->now;
+
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 &&
+           delta >= (uint64_t)1 << (TIMER_WHEEL_BITS * (level + 1))) {
+        level++;
+    }
+    if (level == TIMER_WHEEL_LEVELS - 1) {
+        // Oltre l'orizzonte: parcheggiato nello slot più lontano, ricontrollato alla cascata
+        uint64_t max = ((uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+        if (delta > max) {
+            expires = wheel->now + max;
+        }
+    }
+    timer_node_t *head = &wheel->slots[level][(expires >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+void timer_wheel_arm(timer_wheel_t *wheel, timer_node_t *timer, uint64_t deadline_ms) {
+    if (timer_armed(timer)) {
+        unlink_node(timer);
+    } else {
+        wheel->armed++;
+    }
+    uint64_t ms = deadline_ms > wheel->origin_ms ? deadline_ms - wheel->origin_ms : 0;
+    timer->expires = (ms + TIMER_WHEEL_TICK_MS - 1) / TIMER_WHEEL_TICK_MS;
+    place(wheel, timer);
+}
+
+void timer_wheel_cancel(timer_wheel_t *wheel, timer_node_t *timer) {
+    if (timer_armed(timer)) {
+        unlink_node(timer);
+        wheel->armed--;
+    }
+}
+
+/**
+ * @brief Ridistribuisce i timer dello slot del livello level che copre il tick corrente.
+ */
+static void cascade(timer_wheel_t *wheel, int level) {
+    timer_node_t *head = &wheel->slots[level][(wheel->now >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+    timer_node_t *timer = head->next;
+    head->next = head;
+    head->prev = head;
+    while (timer != head) {
+        timer_node_t *next = timer->next;
+        place(wheel, timer);
+        timer = next;
+    }
+}
+
+timer_node_t *timer_wheel_advance(timer_wheel_t *wheel, uint64_t now_ms) {
+    uint64_t target = now_ms > wheel->origin_ms ? (now_ms - wheel->origin_ms) / TIMER_WHEEL_TICK_MS : 0;
+    timer_node_t *expired = NULL;
+
+    while (wheel->now < target) {
+        wheel->now++;
+
+        // A ogni giro completo di un livello scende lo slot corrente del successivo
+        for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+            if ((wheel->now & (((uint64_t)1 << (TIMER_WHEEL_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            cascade(wheel, level);
+        }
+
+        timer_node_t *head = &wheel->slots[0][wheel->now & (TIMER_WHEEL_SLOTS - 1)];
+        while (head->next != head) {
+            timer_node_t *timer = head->next;
+            unlink_node(timer);
+            wheel->armed--;
+            timer->next = expired; // prev resta NULL: il timer risulta disarmato
+            expired = timer;
+        }
+
+        if (wheel->armed == 0) {
+            wheel->now = target; // niente da scadere: saltiamo i tick rimanenti
+        }
+    }
+    return expired;
+}
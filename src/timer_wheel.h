@@ -0,0 +1,75 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIMER_WHEEL_TICK_MS 100   // risoluzione delle scadenze
+#define TIMER_WHEEL_BITS 6        // 64 slot per livello
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4      // 64^4 tick = ~19 giorni, oltre nell'ultimo slot
+
+/**
+ * @brief Timer da incorporare nell'oggetto che scade (lista doppia intrusiva:
+ *        armare e cancellare costano O(1), nessuna allocazione).
+ */
+typedef struct timer_node {
+    struct timer_node *next;
+    struct timer_node *prev;
+    uint64_t expires;           // tick di scadenza
+} timer_node_t;
+
+/**
+ * @brief Timing wheel gerarchica: il livello 0 ha uno slot per tick, ogni
+ *        livello successivo copre 64 volte il precedente. Quando il livello 0
+ *        compie un giro, lo slot corrente del livello superiore viene
+ *        redistribuito verso il basso (cascata). Usata da un solo thread.
+ */
+typedef struct {
+    uint64_t now;               // tick corrente
+    uint64_t origin_ms;         // tempo monotonic del tick 0
+    unsigned long armed;        // timer attivi
+    timer_node_t slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; // sentinelle
+} timer_wheel_t;
+
+/**
+ * @brief Millisecondi da un istante fisso (CLOCK_MONOTONIC).
+ */
+uint64_t timer_now_ms(void);
+
+/**
+ * @brief Inizializza la wheel all'istante now_ms.
+ */
+void timer_wheel_init(timer_wheel_t *wheel, uint64_t now_ms);
+
+/**
+ * @brief Inizializza un timer non armato.
+ */
+void timer_init(timer_node_t *timer);
+
+/**
+ * @brief true se il timer è armato.
+ */
+static inline bool timer_armed(const timer_node_t *timer) {
+    return timer->prev != NULL;
+}
+
+/**
+ * @brief Arma (o sposta) il timer perché scada a deadline_ms (arrotondato al tick successivo).
+ */
+void timer_wheel_arm(timer_wheel_t *wheel, timer_node_t *timer, uint64_t deadline_ms);
+
+/**
+ * @brief Disarma il timer (nessun effetto se non è armato).
+ */
+void timer_wheel_cancel(timer_wheel_t *wheel, timer_node_t *timer);
+
+/**
+ * @brief Avanza la wheel fino a now_ms e restituisce i timer scaduti, già
+ *        disarmati, in una lista collegata con next (NULL se nessuno).
+ *        Chi la scorre deve leggere next prima di riarmare un timer.
+ */
+timer_node_t *timer_wheel_advance(timer_wheel_t *wheel, uint64_t now_ms);
+
+#endif // TIMER_WHEEL_H
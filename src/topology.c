@@ -0,0 +1,450 @@
+#ifdef __linux__
+#define _GNU_SOURCE // sched_getaffinity, CPU_SET
+#endif
+#include "topology.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+#define SYSFS_NODE "/sys/devices/system/node"
+
+extern bool g_verbose;
+
+/**
+ * @brief CPU utilizzabile con le chiavi di ordinamento.
+ */
+typedef struct {
+    int cpu;
+    int rank;   // posizione tra i thread dello stesso core (0 = primo)
+    int node;
+    int l3;
+} cpu_info_t;
+
+static void bit_set(unsigned char *map, int bit) {
+    map[bit / 8] |= (unsigned char)(1u << (bit % 8));
+}
+
+static bool bit_test(const unsigned char *map, int bit) {
+    return (map[bit / 8] >> (bit % 8)) & 1u;
+}
+
+/**
+ * @brief Legge la prima riga del file path in buf.
+ * @return true se letta.
+ */
+static bool read_line(const char *path, char *buf, size_t size) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    bool ok = fgets(buf, (int)size, f) != NULL;
+    fclose(f);
+    if (ok) {
+        buf[strcspn(buf, "\n")] = '\0';
+    }
+    return ok;
+}
+
+/**
+ * @brief Interpreta una lista di CPU nel formato di /sys ("0-3,8,10-11").
+ */
+static void parse_cpu_list(const char *list, unsigned char *map) {
+    const char *p = list;
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+        }
+        for (long cpu = first; cpu <= last && cpu < TOPOLOGY_MAX_CPUS; cpu++) {
+            if (cpu >= 0) {
+                bit_set(map, (int)cpu);
+            }
+        }
+        p = *end == ',' ? end + 1 : end;
+        if (end == p && *p) {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Nodo NUMA di ogni CPU (0 se /sys non li elenca: macchina a un nodo).
+ */
+static void read_nodes(int *cpu_node) {
+    memset(cpu_node, 0, sizeof(int) * TOPOLOGY_MAX_CPUS);
+    for (int node = 0; node < TOPOLOGY_MAX_NODES; node++) {
+        char path[128];
+        char list[4096];
+        snprintf(path, sizeof(path), SYSFS_NODE "/node%d/cpulist", node);
+        if (!read_line(path, list, sizeof(list))) {
+            continue;
+        }
+        unsigned char map[TOPOLOGY_MAX_CPUS / 8];
+        memset(map, 0, sizeof(map));
+        parse_cpu_list(list, map);
+        for (int cpu = 0; cpu < TOPOLOGY_MAX_CPUS; cpu++) {
+            if (bit_test(map, cpu)) {
+                cpu_node[cpu] = node;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Id del dominio L3 della CPU: il campo "id" della cache di livello 3,
+ *        oppure la prima CPU che la condivide sui kernel che non lo espongono.
+ * @return id, -1 se la CPU non ha una L3 nota.
+ */
+static int read_l3(int cpu) {
+    for (int index = 0; index < 8; index++) {
+        char path[128];
+        char line[4096];
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/level", cpu, index);
+        if (!read_line(path, line, sizeof(line))) {
+            break;
+        }
+        if (atoi(line) != 3) {
+            continue;
+        }
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/id", cpu, index);
+        if (read_line(path, line, sizeof(line))) {
+            return atoi(line);
+        }
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+        if (read_line(path, line, sizeof(line))) {
+            return atoi(line);
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Posizione della CPU tra i thread SMT del suo core (0 per il primo).
+ */
+static int read_smt_rank(int cpu) {
+    char path[128];
+    char list[4096];
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/thread_siblings_list", cpu);
+    if (!read_line(path, list, sizeof(list))) {
+        return 0;
+    }
+    unsigned char map[TOPOLOGY_MAX_CPUS / 8];
+    memset(map, 0, sizeof(map));
+    parse_cpu_list(list, map);
+    int rank = 0;
+    for (int other = 0; other < cpu; other++) {
+        rank += bit_test(map, other);
+    }
+    return rank;
+}
+
+/**
+ * @brief CPU concesse dalla quota del cgroup v2 (cpu.max), arrotondate per eccesso.
+ * @return numero di CPU, 0 se non c'è una quota.
+ */
+static int read_cpu_quota(void) {
+    char line[128];
+    if (!read_line("/sys/fs/cgroup/cpu.max", line, sizeof(line))) {
+        return 0;
+    }
+    long quota, period;
+    if (sscanf(line, "%ld %ld", &quota, &period) != 2 || quota <= 0 || period <= 0) {
+        return 0; // "max": nessun limite
+    }
+    return (int)((quota + period - 1) / period);
+}
+
+/**
+ * @brief Ordine delle CPU: prima un thread per ogni core, poi per nodo, L3 e id,
+ *        così worker consecutivi non finiscono su due thread dello stesso core.
+ */
+static int compare_cpus(const void *a, const void *b) {
+    const cpu_info_t *x = (const cpu_info_t *)a;
+    const cpu_info_t *y = (const cpu_info_t *)b;
+    if (x->rank != y->rank) {
+        return x->rank - y->rank;
+    }
+    if (x->node != y->node) {
+        return x->node - y->node;
+    }
+    if (x->l3 != y->l3) {
+        return x->l3 - y->l3;
+    }
+    return x->cpu - y->cpu;
+}
+
+/**
+ * @brief Chiave di raggruppamento della CPU per la modalità di pinning.
+ */
+static int group_key(const topology_t *topo, int cpu) {
+    return topo->pin == TOPOLOGY_PIN_L3 ? topo->cpu_l3[cpu] : topo->cpu_node[cpu];
+}
+
+/**
+ * @brief Assegna le CPU ai worker secondo topo->pin.
+ */
+static void assign_workers(topology_t *topo) {
+    memset(topo->worker_cpus, 0, sizeof(topo->worker_cpus));
+    if (topo->pin == TOPOLOGY_PIN_NONE) {
+        for (int w = 0; w < topo->workers; w++) {
+            for (int j = 0; j < topo->cpu_count; j++) {
+                bit_set(topo->worker_cpus[w], topo->cpus[j]);
+            }
+        }
+    } else if (topo->pin == TOPOLOGY_PIN_CORE) {
+        for (int w = 0; w < topo->workers; w++) {
+            bit_set(topo->worker_cpus[w], topo->cpus[w % topo->cpu_count]);
+        }
+    } else {
+        // Gruppi (L3 o nodo) nell'ordine in cui compaiono le loro CPU; i worker a turno
+        int groups[TOPOLOGY_MAX_CPUS];
+        int group_count = 0;
+        for (int j = 0; j < topo->cpu_count; j++) {
+            int key = group_key(topo, topo->cpus[j]);
+            bool seen = false;
+            for (int g = 0; g < group_count && !seen; g++) {
+                seen = groups[g] == key;
+            }
+            if (!seen) {
+                groups[group_count++] = key;
+            }
+        }
+        for (int w = 0; w < topo->workers; w++) {
+            int key = groups[w % group_count];
+            for (int j = 0; j < topo->cpu_count; j++) {
+                if (group_key(topo, topo->cpus[j]) == key) {
+                    bit_set(topo->worker_cpus[w], topo->cpus[j]);
+                }
+            }
+        }
+    }
+
+    for (int w = 0; w < topo->workers; w++) {
+        topo->worker_node[w] = -2;
+        for (int j = 0; j < topo->cpu_count; j++) {
+            int cpu = topo->cpus[j];
+            if (!bit_test(topo->worker_cpus[w], cpu)) {
+                continue;
+            }
+            if (topo->worker_node[w] == -2) {
+                topo->worker_node[w] = topo->cpu_node[cpu];
+            } else if (topo->worker_node[w] != topo->cpu_node[cpu]) {
+                topo->worker_node[w] = -1;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Sceglie per ogni CPU il worker che accetta le connessioni arrivate
+ *        lì: uno di quelli che ci girano, altrimenti uno dello stesso nodo.
+ */
+static void assign_incoming(topology_t *topo) {
+    for (int cpu = 0; cpu < TOPOLOGY_MAX_CPUS; cpu++) {
+        topo->cpu_worker[cpu] = -1;
+    }
+    for (int j = 0; j < topo->cpu_count; j++) {
+        int cpu = topo->cpus[j];
+        int candidates[TOPOLOGY_MAX_WORKERS];
+        int count = 0;
+        for (int w = 0; w < topo->workers; w++) {
+            if (bit_test(topo->worker_cpus[w], cpu)) {
+                candidates[count++] = w;
+            }
+        }
+        for (int w = 0; count == 0 && w < topo->workers; w++) {
+            if (topo->worker_node[w] == topo->cpu_node[cpu]) {
+                candidates[count++] = w;
+            }
+        }
+        topo->cpu_worker[cpu] = count > 0 ? candidates[j % count] : j % topo->workers;
+    }
+}
+
+int topology_init(topology_t *topo, int workers, int threads, topology_pin_t pin) {
+    memset(topo, 0, sizeof(*topo));
+    topo->pin = pin;
+
+    // CPU su cui possiamo girare: cpuset del cgroup, taskset, ...
+    static cpu_info_t info[TOPOLOGY_MAX_CPUS];
+    int n = 0;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        perror("sched_getaffinity");
+        return -1;
+    }
+    read_nodes(topo->cpu_node);
+    for (int cpu = 0; cpu < TOPOLOGY_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            topo->cpu_l3[cpu] = read_l3(cpu);
+            info[n].cpu = cpu;
+            info[n].rank = read_smt_rank(cpu);
+            info[n].node = topo->cpu_node[cpu];
+            info[n].l3 = topo->cpu_l3[cpu];
+            n++;
+        }
+    }
+#else
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int cpu = 0; cpu < online && cpu < TOPOLOGY_MAX_CPUS; cpu++) {
+        info[n].cpu = cpu;
+        info[n].rank = info[n].node = 0;
+        info[n].l3 = -1;
+        topo->cpu_l3[cpu] = -1;
+        n++;
+    }
+    if (pin != TOPOLOGY_PIN_NONE) {
+        fprintf(stderr, "[topology] Pinning non supportato su questa piattaforma\n");
+        topo->pin = TOPOLOGY_PIN_NONE;
+    }
+#endif
+    if (n == 0) {
+        n = 1;
+        info[0].cpu = info[0].rank = info[0].node = 0;
+        info[0].l3 = -1;
+    }
+    qsort(info, (size_t)n, sizeof(info[0]), compare_cpus);
+    topo->cpu_count = n;
+    for (int j = 0; j < n; j++) {
+        topo->cpus[j] = info[j].cpu;
+        if (info[j].node < TOPOLOGY_MAX_NODES && !(topo->node_mask & (1ul << info[j].node))) {
+            topo->node_mask |= 1ul << info[j].node;
+            topo->node_count++;
+        }
+    }
+
+    if (workers <= 0) {
+        // Un worker per CPU utilizzabile, non oltre la quota del cgroup
+        int quota = read_cpu_quota();
+        workers = (quota > 0 && quota < n) ? quota : n;
+    }
+    if (workers > TOPOLOGY_MAX_WORKERS) {
+        fprintf(stderr, "[topology] Al massimo %d worker\n", TOPOLOGY_MAX_WORKERS);
+        return -1;
+    }
+    topo->workers = workers;
+    assign_workers(topo);
+    assign_incoming(topo);
+
+    if (threads <= 0) {
+        // Quante sono le CPU del worker (senza pinning, quelle utilizzabili divise tra i worker)
+        int cpus = 0;
+        for (int j = 0; j < n; j++) {
+            cpus += bit_test(topo->worker_cpus[0], topo->cpus[j]);
+        }
+        threads = topo->pin == TOPOLOGY_PIN_NONE ? n / workers : cpus;
+        if (threads < 1) {
+            threads = 1;
+        }
+    }
+    topo->threads = threads;
+    return 0;
+}
+
+void topology_bind_worker(const topology_t *topo, int worker) {
+#ifdef __linux__
+    if (topo->pin == TOPOLOGY_PIN_NONE) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int j = 0; j < topo->cpu_count; j++) {
+        if (bit_test(topo->worker_cpus[worker], topo->cpus[j])) {
+            CPU_SET(topo->cpus[j], &set);
+        }
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        perror("sched_setaffinity");
+    }
+    // Con la prima scrittura (first touch) le pagine finirebbero già sul nodo
+    // della CPU: la preferenza vale anche per quelle toccate dal kernel
+    int node = topo->worker_node[worker];
+    if (node >= 0 && topo->node_count > 1) {
+        unsigned long mask = 1ul << node;
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8 + 1) < 0) {
+            perror("set_mempolicy");
+        }
+    }
+#else
+    (void)topo;
+    (void)worker;
+#endif
+}
+
+int topology_worker_cpu(const topology_t *topo, int worker) {
+    if (topo->pin == TOPOLOGY_PIN_NONE) {
+        return -1;
+    }
+    for (int j = 0; j < topo->cpu_count; j++) {
+        if (bit_test(topo->worker_cpus[worker], topo->cpus[j])) {
+            return topo->cpus[j];
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Scrive in buf la lista delle CPU della bitmap ("0-3,8").
+ */
+static void format_cpus(const unsigned char *map, char *buf, size_t size) {
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int cpu = 0; cpu < TOPOLOGY_MAX_CPUS && len < size; cpu++) {
+        if (!bit_test(map, cpu)) {
+            continue;
+        }
+        int last = cpu;
+        while (last + 1 < TOPOLOGY_MAX_CPUS && bit_test(map, last + 1)) {
+            last++;
+        }
+        int n = last > cpu ? snprintf(buf + len, size - len, "%s%d-%d", len ? "," : "", cpu, last)
+                           : snprintf(buf + len, size - len, "%s%d", len ? "," : "", cpu);
+        len += n > 0 ? (size_t)n : 0;
+        cpu = last;
+    }
+}
+
+void topology_print(const topology_t *topo) {
+    static const char *pin_names[] = { "nessun pinning", "pinning per core", "pinning per L3", "pinning per nodo" };
+    unsigned char all[TOPOLOGY_MAX_CPUS / 8];
+    memset(all, 0, sizeof(all));
+    for (int j = 0; j < topo->cpu_count; j++) {
+        bit_set(all, topo->cpus[j]);
+    }
+    char cpus[256];
+    format_cpus(all, cpus, sizeof(cpus));
+    printf("[topology] %d worker x %d thread, %s; CPU %s (%d), %d nodi NUMA\n", topo->workers, topo->threads,
+           pin_names[topo->pin], cpus, topo->cpu_count, topo->node_count);
+    if (topo->pin != TOPOLOGY_PIN_NONE && g_verbose) {
+        for (int w = 0; w < topo->workers; w++) {
+            format_cpus(topo->worker_cpus[w], cpus, sizeof(cpus));
+            printf("[topology]   worker %d: CPU %s, nodo %d\n", w, cpus, topo->worker_node[w]);
+        }
+    }
+}
+
+bool topology_parse_pin(const char *name, topology_pin_t *pin) {
+    static const char *names[] = { "none", "core", "l3", "node" };
+    for (int i = 0; i < 4; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *pin = (topology_pin_t)i;
+            return true;
+        }
+    }
+    return false;
+}
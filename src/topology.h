@@ -0,0 +1,78 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdbool.h>
+
+#define TOPOLOGY_MAX_CPUS 1024      // id di CPU gestiti (come CPU_SETSIZE)
+#define TOPOLOGY_MAX_WORKERS 256
+#define TOPOLOGY_MAX_NODES 64
+
+/**
+ * @brief A cosa viene vincolato ciascun worker (con i suoi thread).
+ */
+typedef enum {
+    TOPOLOGY_PIN_NONE,  // il kernel sposta i worker liberamente
+    TOPOLOGY_PIN_CORE,  // un worker per CPU
+    TOPOLOGY_PIN_L3,    // ai core che condividono la cache L3 (CCX)
+    TOPOLOGY_PIN_NODE   // ai core di un nodo NUMA
+} topology_pin_t;
+
+/**
+ * @brief Disposizione dei worker sulle CPU, calcolata nel master prima del fork.
+ *
+ *        Le CPU considerate sono quelle su cui il processo può girare
+ *        (sched_getaffinity: riflette il cpuset del cgroup e taskset); nodo
+ *        NUMA e dominio L3 di ciascuna si leggono da /sys. Un worker vincolato
+ *        a CPU di un solo nodo alloca le proprie strutture (connessioni,
+ *        buffer, file aperti, stack dei thread) su quel nodo.
+ */
+typedef struct {
+    int workers;
+    int threads;                            // thread del pool per worker
+    topology_pin_t pin;
+
+    int cpu_count;
+    int cpus[TOPOLOGY_MAX_CPUS];            // CPU utilizzabili: prima un thread per core, per nodo e L3
+    int cpu_node[TOPOLOGY_MAX_CPUS];        // per id di CPU
+    int cpu_l3[TOPOLOGY_MAX_CPUS];          // id del dominio L3 (-1 se sconosciuto)
+    int node_count;                         // nodi con almeno una CPU utilizzabile
+    unsigned long node_mask;                // bit dei nodi con CPU utilizzabili
+
+    unsigned char worker_cpus[TOPOLOGY_MAX_WORKERS][TOPOLOGY_MAX_CPUS / 8]; // bitmap delle CPU per worker
+    int worker_node[TOPOLOGY_MAX_WORKERS];  // nodo di tutte le CPU del worker, -1 se più nodi
+    int cpu_worker[TOPOLOGY_MAX_CPUS];      // worker che accetta le connessioni arrivate su ogni CPU (-1)
+} topology_t;
+
+/**
+ * @brief Calcola la disposizione.
+ * @param workers numero di worker, 0 = uno per CPU utilizzabile (limitato dalla
+ *        quota CPU del cgroup, cpu.max).
+ * @param threads thread per worker, 0 = quante sono le CPU del worker.
+ * @return 0 se ok, -1 in caso di errore (messaggio su stderr).
+ */
+int topology_init(topology_t *topo, int workers, int threads, topology_pin_t pin);
+
+/**
+ * @brief Vincola il processo chiamante (un worker appena creato, prima dei
+ *        suoi thread, che lo ereditano) alle CPU del worker e, se stanno su un
+ *        solo nodo, preferisce quel nodo per la memoria allocata da qui in poi.
+ */
+void topology_bind_worker(const topology_t *topo, int worker);
+
+/**
+ * @brief Prima CPU del worker (per SO_INCOMING_CPU), -1 se non vincolato.
+ */
+int topology_worker_cpu(const topology_t *topo, int worker);
+
+/**
+ * @brief Stampa la disposizione scelta.
+ */
+void topology_print(const topology_t *topo);
+
+/**
+ * @brief Legge il nome di una modalità ("none", "core", "l3", "node").
+ * @return true se riconosciuta.
+ */
+bool topology_parse_pin(const char *name, topology_pin_t *pin);
+
+#endif // TOPOLOGY_H
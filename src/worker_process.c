@@ -8,21 +8,213 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <string.h>
+#include <stddef.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 
 extern bool g_verbose;
+extern atomic_bool g_draining; // letto dalle connessioni nei thread del pool
+
+static volatile sig_atomic_t g_drain_requested = 0;
+
+static void on_sigterm(int sig) {
+    (void)sig;
+    g_drain_requested = 1;
+}
+
+/**
+ * @brief SIGTERM (dal master: riavvio o aggiornamento) => uscita graduale;
+ *        gli altri segnali del master non riguardano il worker.
+ */
+void worker_process_init_signals(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigterm;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGUSR1, SIG_DFL);
+    signal(SIGHUP, SIG_DFL);
+    signal(SIGUSR2, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+}
+
+/**
+ * @brief La connessione torna ad aspettare nell'event loop: arma la sua
+ *        scadenza e, se aspetta dati dal client, la mette in fondo alla lista
+ *        LRU (chi sta ricevendo una risposta non è inattivo).
+ */
+static void wait_start(worker_process_t *worker, connection_t *conn) {
+    timer_wheel_arm(&worker->timers, &conn->timer, conn->deadline_ms);
+    if (conn->state == CONN_STATE_WRITING) {
+        return;
+    }
+    conn->lru_next = NULL;
+    conn->lru_prev = worker->lru_tail;
+    if (worker->lru_tail) {
+        worker->lru_tail->lru_next = conn;
+    } else {
+        worker->lru_head = conn;
+    }
+    worker->lru_tail = conn;
+}
+
+/**
+ * @brief La connessione smette di aspettare (passa al pool o viene chiusa):
+ *        disarma la scadenza e la toglie dalla lista LRU, se c'è.
+ */
+static void wait_end(worker_process_t *worker, connection_t *conn) {
+    timer_wheel_cancel(&worker->timers, &conn->timer);
+    if (!conn->lru_prev && worker->lru_head != conn) {
+        return;
+    }
+    if (conn->lru_prev) {
+        conn->lru_prev->lru_next = conn->lru_next;
+    } else {
+        worker->lru_head = conn->lru_next;
+    }
+    if (conn->lru_next) {
+        conn->lru_next->lru_prev = conn->lru_prev;
+    } else {
+        worker->lru_tail = conn->lru_prev;
+    }
+    conn->lru_prev = conn->lru_next = NULL;
+}
+
+/**
+ * @brief Chiude subito con un reset: il kernel scarta la coda di invio, e
+ *        con essa i riferimenti alle pagine della cache.
+ */
+static void abort_connection(connection_t *conn) {
+    struct linger lg = { 1, 0 };
+    setsockopt(conn->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    connection_destroy(conn);
+}
+
+/**
+ * @brief Rimuove la connessione dalla tabella e la chiude. Se il socket deve
+ *        ancora consegnare byte inviati con sendfile() dalla cache, la chiusura
+ *        è solo in scrittura (il FIN parte dopo i dati) e il socket resta
+ *        aperto, fuori dalla tabella, finché il client non li conferma:
+ *        rilasciare prima le voci permetterebbe di riusarne la memoria
+ *        mentre il kernel la sta ancora trasmettendo.
+ */
+static void close_connection(worker_process_t *worker, connection_t *conn) {
+    wait_end(worker, conn);
+    atomic_fetch_sub_explicit(&worker->stats->active_connections, 1, memory_order_relaxed);
+    worker->connections--;
+    worker->conns[conn->fd] = NULL;
+
+    output_queue_in_flight(&conn->out, conn->fd); // rilascia quelle già confermate
+    if (!output_queue_pinned(&conn->out)) {
+        connection_destroy(conn);
+        return;
+    }
+    shutdown(conn->fd, SHUT_WR);
+    conn->deadline_ms = timer_now_ms() + CONN_WRITE_TIMEOUT_MS;
+    conn->next = worker->lingering;
+    worker->lingering = conn;
+}
+
+/**
+ * @brief Chiude i socket della lista lingering che hanno consegnato i dati
+ *        della cache. Chi non fa progressi entro CONN_WRITE_TIMEOUT_MS (o
+ *        tutti, con force) viene chiuso con un reset.
+ */
+static void release_lingering(worker_process_t *worker, bool force) {
+    uint64_t now = timer_now_ms();
+    connection_t **link = &worker->lingering;
+    while (*link) {
+        connection_t *conn = *link;
+        bool progress = output_queue_in_flight(&conn->out, conn->fd);
+        if (!output_queue_pinned(&conn->out)) {
+            *link = conn->next;
+            connection_destroy(conn);
+            continue;
+        }
+        if (progress) {
+            conn->deadline_ms = now + CONN_WRITE_TIMEOUT_MS;
+        } else if (force || now >= conn->deadline_ms) {
+            *link = conn->next;
+            abort_connection(conn);
+            continue;
+        }
+        link = &conn->next;
+    }
+}
+
+/**
+ * @brief Chiude la connessione in attesa di dati da più tempo, per liberare un fd.
+ * @return true se c'era una connessione da chiudere.
+ */
+static bool evict_oldest_connection(worker_process_t *worker) {
+    connection_t *conn = worker->lru_head;
+    if (!conn) {
+        return false;
+    }
+    if (g_verbose) {
+        printf("[worker] Vicino al limite di fd: chiudo fd=%d (inattiva da più tempo)\n", conn->fd);
+    }
+    atomic_fetch_add_explicit(&worker->stats->evictions, 1, memory_order_relaxed);
+    remove_event(worker->event_loop_fd, conn->fd);
+    close_connection(worker, conn);
+    return true;
+}
+
+/**
+ * @brief Crea la connessione per un client appena accettato e la registra
+ *        nell'event loop. I socket client sono non bloccanti: nessun thread
+ *        resta fermo su una connessione keep-alive inattiva.
+ * @param non_blocking true se il fd è già non bloccante (accept di io_uring).
+ */
+static void register_connection(worker_process_t *worker, int client_fd, bool non_blocking) {
+    atomic_fetch_add_explicit(&worker->stats->accepted, 1, memory_order_relaxed);
+
+    // Teniamo sempre qualche fd libero (file da servire, nuove accept)
+    if (client_fd >= worker->max_conns - CONN_FD_RESERVE) {
+        evict_oldest_connection(worker);
+    }
+
+    if (client_fd >= worker->max_conns || (!non_blocking && set_non_blocking(client_fd) < 0) ||
+        set_tcp_nodelay(client_fd) < 0) {
+        close(client_fd);
+        return;
+    }
+
+    connection_t *conn = connection_create(client_fd);
+    if (!conn) {
+        close(client_fd);
+        return;
+    }
+    worker->conns[client_fd] = conn;
+    worker->connections++;
+    atomic_fetch_add_explicit(&worker->stats->active_connections, 1, memory_order_relaxed);
+
+    // Il client viene servito dal thread pool solo quando ha dati pronti
+    if (add_oneshot_event(worker->event_loop_fd, client_fd) < 0) {
+        close_connection(worker, conn);
+        return;
+    }
+    wait_start(worker, conn);
+}
 
 /**
  * @brief Accetta tutte le connessioni pendenti dal socket di ascolto
- *        e le passa al thread pool. Usa socket bloccanti per i client,
- *        così da poter gestire in modo semplice il keep-alive nei thread.
+ *        e le registra nell'event loop.
  */
 static void accept_connections(worker_process_t *worker) {
-    while (1) {
+    for (int accepted = 0; worker->accept_batch == 0 || accepted < worker->accept_batch; accepted++) {
         struct sockaddr_in client_addr;
         socklen_t client_len = sizeof(client_addr);
         int client_fd = accept(worker->listen_fd, (struct sockaddr*)&client_addr, &client_len);
         if (client_fd < 0) {
+            // Finiti gli fd: chiudiamo la connessione inattiva più vecchia e riproviamo
+            if ((errno == EMFILE || errno == ENFILE) && evict_oldest_connection(worker)) {
+                continue;
+            }
             // Nessuna connessione pendente o errore
             break;
         }
@@ -35,19 +227,112 @@ static void accept_connections(worker_process_t *worker) {
                    ip_str, ntohs(client_addr.sin_port), client_fd);
         }
 
-        // (RIMOSSO) Imposta non-bloccante? --> No, per keep-alive è più semplice bloccare.
-        // int flags = fcntl(client_fd, F_GETFL, 0);
-        // fcntl(client_fd, F_SETFL, flags | O_NONBLOCK);
+        register_connection(worker, client_fd, false);
+    }
+}
+
+/**
+ * @brief Registra i client già accettati dall'event loop (accept multishot di io_uring).
+ */
+static void take_accepted_connections(worker_process_t *worker, int *fds) {
+    int n;
+    while ((n = take_accepted_fds(worker->event_loop_fd, fds, MAX_EVENTS)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (g_verbose) {
+                printf("[worker] Connessione accettata (fd=%d)\n", fds[i]);
+            }
+            register_connection(worker, fds[i], true);
+        }
+    }
+}
+
+/**
+ * @brief Riprende le connessioni servite dal thread pool: le riarma
+ *        nell'event loop (in scrittura se hanno risposte in coda) oppure le chiude.
+ */
+static void collect_completed(worker_process_t *worker) {
+    connection_t *conn = thread_pool_collect(worker->thread_pool);
 
-        // Passiamo la connessione (file descriptor) al thread pool
-        thread_pool_add_job(worker->thread_pool, client_fd);
+    while (conn) {
+        connection_t *next = conn->next;
+        conn->next = NULL;
+        conn->in_pool = false;
+
+        int rc = -1;
+        if (conn->state == CONN_STATE_WRITING) {
+            rc = rearm_write_event(worker->event_loop_fd, conn->fd);
+        } else if (conn->state != CONN_STATE_CLOSING) {
+            rc = rearm_event(worker->event_loop_fd, conn->fd);
+        }
+        if (rc < 0) {
+            close_connection(worker, conn);
+        } else {
+            wait_start(worker, conn);
+        }
+        conn = next;
     }
 }
 
 /**
- * @brief Funzione del processo worker: crea un event loop (kqueue/epoll)
- *        ma lo usa solo per registrare il socket di ascolto, così da accorgersi
- *        di nuove connessioni in arrivo. I client vengono gestiti dal thread pool.
+ * @brief Aggiorna nei contatori condivisi la profondità della coda del thread pool
+ *        (valore attuale e massimo osservato).
+ */
+static void update_queue_depth(worker_process_t *worker) {
+    unsigned long depth = (unsigned long)thread_pool_queue_depth(worker->thread_pool);
+    atomic_store_explicit(&worker->stats->queue_depth, depth, memory_order_relaxed);
+    if (depth > atomic_load_explicit(&worker->stats->queue_depth_peak, memory_order_relaxed)) {
+        atomic_store_explicit(&worker->stats->queue_depth_peak, depth, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Chiude le connessioni in attesa nell'event loop la cui scadenza è
+ *        passata (keep-alive inattivo, header o body non arrivati in tempo).
+ */
+static void close_expired_connections(worker_process_t *worker) {
+    timer_node_t *timer = timer_wheel_advance(&worker->timers, timer_now_ms());
+    while (timer) {
+        timer_node_t *next = timer->next;
+        connection_t *conn = (connection_t *)((char *)timer - offsetof(connection_t, timer));
+        if (output_queue_in_flight(&conn->out, conn->fd)) {
+            // Il client sta ancora ricevendo la risposta: aspettiamo finché fa progressi
+            timer_wheel_arm(&worker->timers, &conn->timer, timer_now_ms() + CONN_WRITE_TIMEOUT_MS);
+            timer = next;
+            continue;
+        }
+        if (g_verbose) {
+            printf("[worker] Timeout su fd=%d. Chiudo.\n", conn->fd);
+        }
+        if (conn->state != CONN_STATE_LINGERING) {
+            atomic_fetch_add_explicit(&worker->stats->timeouts, 1, memory_order_relaxed);
+        }
+        remove_event(worker->event_loop_fd, conn->fd);
+        close_connection(worker, conn);
+        timer = next;
+    }
+}
+
+/**
+ * @brief Inizia l'uscita graduale (SIGTERM): il worker smette di accettare e
+ *        ogni connessione riceve "Connection: close" sulla prossima risposta.
+ *        Quelle keep-alive non vengono chiuse subito, perché il client
+ *        potrebbe aver già inviato la richiesta successiva: si chiudono dopo
+ *        averla servita, oppure alla normale scadenza dell'attesa.
+ */
+static void start_drain(worker_process_t *worker) {
+    worker->draining = true;
+    worker->drain_deadline_ms = timer_now_ms() + WORKER_DRAIN_TIMEOUT_MS;
+    atomic_store_explicit(&g_draining, true, memory_order_relaxed);
+    remove_accept_event(worker->event_loop_fd, worker->listen_fd);
+    if (g_verbose) {
+        printf("[worker %d] Uscita graduale: %d connessioni aperte\n", worker->id, worker->connections);
+    }
+}
+
+/**
+ * @brief Funzione del processo worker: crea un event loop (kqueue/epoll/io_uring)
+ *        in cui registra il socket di ascolto, i client e il canale di notifica
+ *        del thread pool. I thread del pool eseguono solo lavoro già pronto.
  */
 void run_worker_process(worker_process_t *worker) {
     worker->event_loop_fd = create_event_loop();
@@ -56,37 +341,101 @@ void run_worker_process(worker_process_t *worker) {
         exit(EXIT_FAILURE);
     }
 
-    // Registriamo il socket di ascolto nell'event loop
-    if (add_event(worker->event_loop_fd, worker->listen_fd) < 0) {
+    // Tabella delle connessioni indicizzata per fd
+    struct rlimit rl;
+    worker->max_conns = 1024;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+        worker->max_conns = (int)rl.rlim_cur;
+    }
+    worker->lru_head = worker->lru_tail = NULL;
+    timer_wheel_init(&worker->timers, timer_now_ms());
+    worker->conns = (connection_t **)calloc(worker->max_conns, sizeof(connection_t *));
+    if (!worker->conns) {
+        perror("calloc conns");
+        exit(EXIT_FAILURE);
+    }
+
+    // Registriamo il socket di ascolto: se è condiviso con gli altri worker usiamo
+    // EPOLLEXCLUSIVE (un solo worker svegliato per connessione) e accettiamo a lotti,
+    // lasciando il resto agli altri; se è un socket SO_REUSEPORT nostro, edge-triggered.
+    // Con io_uring le accept le fa il ring (accept multishot).
+    int rc = add_accept_event(worker->event_loop_fd, worker->listen_fd);
+    if (rc == 1) {
+        worker->accept_batch = 0; // se il kernel non ha l'accept multishot, il ring segnala il socket pronto
+        rc = 0;
+    } else if (rc == 0 && worker->listen_shared) {
+        rc = add_exclusive_event(worker->event_loop_fd, worker->listen_fd);
+        worker->accept_batch = (rc == 1) ? ACCEPT_BATCH : 0;
+    } else if (rc == 0) {
+        rc = add_event(worker->event_loop_fd, worker->listen_fd);
+        worker->accept_batch = 0;
+    }
+
+    // Registriamo la notifica del thread pool
+    if (rc < 0 || add_event(worker->event_loop_fd, worker->thread_pool->notify_read_fd) < 0) {
         close(worker->event_loop_fd);
         exit(EXIT_FAILURE);
     }
 
     int *active_fds = (int*)malloc(sizeof(int) * MAX_EVENTS);
-    if (!active_fds) {
+    int *accepted_fds = (int*)malloc(sizeof(int) * MAX_EVENTS);
+    connection_t **ready = (connection_t **)malloc(sizeof(connection_t *) * MAX_EVENTS);
+    if (!active_fds || !accepted_fds || !ready) {
         perror("malloc active_fds");
         exit(EXIT_FAILURE);
     }
 
     // Loop principale di attesa eventi
-    while (1) {
-        int n = wait_for_events(worker->event_loop_fd, MAX_EVENTS, -1, active_fds);
+    while (!worker->draining ||
+           ((worker->connections > 0 || worker->lingering || accept_event_pending(worker->event_loop_fd)) &&
+            timer_now_ms() < worker->drain_deadline_ms)) {
+        // Con scadenze armate (o socket in chiusura) ci svegliamo almeno a ogni tick della wheel
+        int timeout_ms = worker->timers.armed > 0 || worker->lingering ? TIMER_WHEEL_TICK_MS : 1000;
+        int n = wait_for_events(worker->event_loop_fd, MAX_EVENTS, timeout_ms, active_fds);
         if (n < 0) {
             perror("wait_for_events");
             continue;
         }
+        if (g_drain_requested && !worker->draining) {
+            start_drain(worker);
+        }
+        take_accepted_connections(worker, accepted_fds);
 
-        // Controlliamo gli fd "attivi"
+        // Controlliamo gli fd "attivi": i client pronti vengono raccolti e
+        // passati al thread pool tutti insieme, con un'unica sveglia
+        int ready_count = 0;
         for (int i = 0; i < n; i++) {
-            // Se l'fd è quello di ascolto, accettiamo le nuove connessioni
-            if (active_fds[i] == worker->listen_fd) {
-                accept_connections(worker);
+            int fd = active_fds[i];
+            if (fd == worker->listen_fd) {
+                // Nuove connessioni (non più durante l'uscita graduale)
+                if (!worker->draining) {
+                    accept_connections(worker);
+                }
+            } else if (fd == worker->thread_pool->notify_read_fd) {
+                // Job completati dal thread pool
+                collect_completed(worker);
+            } else if (fd >= 0 && fd < worker->max_conns && worker->conns[fd]) {
+                // Client pronto: lo passiamo al thread pool
+                connection_t *conn = worker->conns[fd];
+                if (!conn->in_pool) {
+                    wait_end(worker, conn);
+                    conn->in_pool = true;
+                    ready[ready_count++] = conn;
+                }
             }
-            // (Altri fd client, se volessimo gestire I/O via epoll/kqueue,
-            //  ma qui li passiamo subito al thread pool.)
         }
+        if (ready_count > 0) {
+            thread_pool_add_jobs(worker->thread_pool, ready, ready_count);
+        }
+        update_queue_depth(worker);
+        close_expired_connections(worker);
+        release_lingering(worker, false);
     }
+    release_lingering(worker, true);
 
     free(active_fds);
+    free(accepted_fds);
+    free(ready);
+    free(worker->conns);
     close(worker->event_loop_fd);
 }
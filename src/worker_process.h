@@ -1,24 +1,63 @@
 #ifndef WORKER_PROCESS_H
 #define WORKER_PROCESS_H
 
+#include <stdatomic.h>
 #include "thread_pool.h"
+#include "connection.h"
+#include "timer_wheel.h"
+#include "metrics.h"    // worker_stats_t
+
+#define WORKER_DRAIN_TIMEOUT_MS 30000 // dopo SIGTERM, attesa massima delle connessioni aperte
 
 /**
  * @brief Struttura che rappresenta un processo worker.
  *        Ogni processo ha un fd dell'event loop (epoll/kqueue) e un riferimento
- *        al socket in ascolto (listen_fd) e al thread pool.
+ *        al socket in ascolto (listen_fd, condiviso oppure SO_REUSEPORT proprio)
+ *        e al thread pool.
+ *        Le connessioni client sono indicizzate per fd nella tabella conns,
+ *        posseduta dal solo thread dell'event loop, come la timer wheel con le
+ *        loro scadenze e la lista LRU di quelle in attesa di dati.
  */
 typedef struct {
+    int id;              // indice del worker (0..workers-1)
     int event_loop_fd;
     int listen_fd;
+    bool listen_shared;  // true se listen_fd è condiviso da tutti i worker
+    int accept_batch;    // max accept per evento (0 = finché EAGAIN)
     thread_pool_t *thread_pool;
+    worker_stats_t *stats;
+
+    connection_t **conns;
+    int max_conns;
+    int connections;     // aperte da questo processo (i contatori in stats sono per posto)
+    bool draining;       // SIGTERM ricevuto: niente nuove accept né keep-alive
+    uint64_t drain_deadline_ms;
+
+    timer_wheel_t timers;
+    connection_t *lru_head; // connessione in attesa da più tempo (prima da chiudere)
+    connection_t *lru_tail;
+    connection_t *lingering; // chiuse dal server, con dati della cache ancora da confermare
 } worker_process_t;
 
+/**
+ * @brief Installa i gestori dei segnali del worker, da chiamare nel figlio
+ *        subito dopo il fork e prima di sbloccare i segnali: un SIGTERM
+ *        arrivato mentre il worker si prepara avvia l'uscita graduale appena
+ *        parte il loop.
+ */
+void worker_process_init_signals(void);
+
 /**
  * @brief Funzione che esegue il loop principale di un processo worker:
- *        - Registra il socket di ascolto nell'event loop
- *        - Attende eventi (accetta nuove connessioni)
- *        - Inserisce i socket accettati nella coda del thread pool
+ *        - Registra il socket di ascolto e i client nell'event loop
+ *        - Attende eventi (nuove connessioni, client pronti, job completati)
+ *        - Passa al thread pool solo le connessioni con dati pronti
+ *        - Chiude le connessioni la cui scadenza (keep-alive, header, body) è passata
+ *        - Vicino al limite di fd chiude le connessioni in attesa da più tempo
+ *        Con SIGTERM il worker esce senza interrompere nessuno: smette di
+ *        accettare (le nuove connessioni vanno agli altri worker), annuncia
+ *        la chiusura sulla prossima risposta di ogni connessione e ritorna
+ *        quando sono tutte chiuse, o al più dopo WORKER_DRAIN_TIMEOUT_MS.
  */
 void run_worker_process(worker_process_t *worker);
 